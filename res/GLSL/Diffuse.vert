@@ -7,13 +7,31 @@ uniform mat4 _Model;
 uniform mat4 _View;
 uniform mat4 _Proj;
 
+// Vertex decode (see Renderer::setVertexDecode): compact formats store positions relative to the mesh's bounding box
+uniform vec3 _PosScale;
+uniform vec3 _PosBias;
+uniform bool _OctNormals;
+
+// Unfolds an octahedral-encoded normal back onto the unit sphere
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
 out vec3 fragCoord;
 out vec3 normalDir;
 
 void main()
 {
-	gl_Position = _Proj * _View * _Model * vec4(position, 1.0f);
+	vec3 localPos = position * _PosScale + _PosBias;
+	vec3 localNormal = _OctNormals ? octDecode(normal.xy) : normal;
+
+	gl_Position = _Proj * _View * _Model * vec4(localPos, 1.0f);
 	
-	fragCoord = vec4(_Model * vec4(position, 1.0f)).xyz;
-	normalDir = normalize(mat3(transpose(inverse(_Model))) * normal);
+	fragCoord = vec4(_Model * vec4(localPos, 1.0f)).xyz;
+	normalDir = normalize(mat3(transpose(inverse(_Model))) * localNormal);
 }
\ No newline at end of file
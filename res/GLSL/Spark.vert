@@ -9,11 +9,16 @@ uniform mat4 _Model;
 uniform mat4 _View;
 uniform mat4 _Proj;
 
+// Vertex decode (see Renderer::setVertexDecode): compact formats store positions relative to the mesh's bounding box
+uniform vec3 _PosScale;
+uniform vec3 _PosBias;
+
 out vec3 fragCoord;
 out vec3 center;
 
 void main()
 {
-	gl_Position = _Proj * _View * _Model * vec4(position, 1.0f);
-	fragCoord = vec4(_Model * vec4(position, 1.0f)).xyz;
+	vec3 localPos = position * _PosScale + _PosBias;
+	gl_Position = _Proj * _View * _Model * vec4(localPos, 1.0f);
+	fragCoord = vec4(_Model * vec4(localPos, 1.0f)).xyz;
 }
\ No newline at end of file
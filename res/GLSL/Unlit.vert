@@ -7,10 +7,15 @@ uniform mat4 _Model;
 uniform mat4 _View;
 uniform mat4 _Proj;
 
+// Vertex decode (see Renderer::setVertexDecode): compact formats store positions relative to the mesh's bounding box
+uniform vec3 _PosScale;
+uniform vec3 _PosBias;
+
 uniform mat4 _MVP;
 
 void main()
 {
-	gl_Position = _Proj * _View * _Model * vec4(position, 1.0f);
-	//gl_Position = _MVP * vec4(position, 1.0f);
+	vec3 localPos = position * _PosScale + _PosBias;
+	gl_Position = _Proj * _View * _Model * vec4(localPos, 1.0f);
+	//gl_Position = _MVP * vec4(localPos, 1.0f);
 }
\ No newline at end of file
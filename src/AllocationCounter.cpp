@@ -0,0 +1,95 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace Pinball;
+
+namespace
+{
+	std::atomic<size_t> sAllocationCount(0);
+	std::atomic<size_t> sAllocationBytes(0);
+
+	void* countedAlloc(size_t size)
+	{
+		sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+		sAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+		// malloc(0) may return nullptr, operator new must not
+		return malloc(size > 0 ? size : 1);
+	}
+}
+
+size_t AllocationCounter::Count()
+{
+	return sAllocationCount.load(std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::Bytes()
+{
+	return sAllocationBytes.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::Reset()
+{
+	sAllocationCount.store(0, std::memory_order_relaxed);
+	sAllocationBytes.store(0, std::memory_order_relaxed);
+}
+
+// Replacements for the global allocation functions
+
+void* operator new(size_t size)
+{
+	void* ptr = countedAlloc(size);
+	if (ptr == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Pinball
+{
+	// Counts heap allocations made through the global operator new (replaced in AllocationCounter.cpp).
+	// Used to check that loading and per-frame code don't allocate or copy more than expected.
+	class AllocationCounter
+	{
+	public:
+		// Number of allocations since the last Reset()
+		static size_t Count();
+		// Bytes requested by those allocations
+		static size_t Bytes();
+		static void Reset();
+	};
+}
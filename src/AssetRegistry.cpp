@@ -0,0 +1,399 @@
+#include "AssetRegistry.h"
+#include "Renderer.h"
+#include "TaskPool.h"
+#include "ConvexDecomposition.h"
+#include "Util.h"
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+using namespace Pinball;
+
+MeshAsset Model::Find(const std::string& name) const
+{
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i]->Name() == name)
+		{
+			return meshes[i];
+		}
+	}
+	return nullptr;
+}
+
+AssetRegistry::AssetRegistry()
+{
+	mBudget = std::numeric_limits<size_t>::max();
+	mClock = 0;
+	mStats = { 0, 0, 0, 0, 0.0 };
+}
+
+AssetRegistry& AssetRegistry::Global()
+{
+	static AssetRegistry registry;
+	return registry;
+}
+
+size_t AssetRegistry::meshBytes(const Mesh& mesh)
+{
+	return mesh.GetVertices().bytes() + mesh.GetIndices().bytes() + mesh.GetLodIndices().bytes();
+}
+
+std::shared_ptr<const void> AssetRegistry::get(const std::string& key, const std::function<std::shared_ptr<const void>(size_t& bytes)>& load, const std::function<size_t(const std::shared_ptr<const void>&)>& countRefs)
+{
+	std::shared_future<std::shared_ptr<const void>> asset;
+	std::promise<std::shared_ptr<const void>> promise;
+	bool isNew = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mClock++;
+
+		auto it = mEntries.find(key);
+		if (it != mEntries.end())
+		{
+			mStats.duplicateRequests++;
+			it->second.requests++;
+			it->second.lastRequest = mClock;
+			asset = it->second.asset;
+		}
+		else
+		{
+			// Registered before it's loaded, so other threads requesting it wait on the future instead of loading it again
+			Entry entry;
+			entry.asset = promise.get_future().share();
+			entry.countRefs = countRefs;
+			entry.bytes = 0;
+			entry.loadMs = 0.0;
+			entry.requests = 1;
+			entry.lastRequest = mClock;
+			entry.loaded = false;
+
+			asset = entry.asset;
+			mEntries[key] = entry;
+			isNew = true;
+		}
+	}
+
+	// Loaded outside the lock, so requests for other assets aren't held up
+	if (isNew)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t bytes = 0;
+		promise.set_value(load(bytes));
+		std::chrono::duration<double, std::milli> loadTime = std::chrono::high_resolution_clock::now() - start;
+
+		std::cout << "Loaded asset " << key << " in " << loadTime.count() << " ms (" << bytes << " bytes)" << std::endl;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStats.loads++;
+		mStats.loadMs += loadTime.count();
+		auto it = mEntries.find(key);
+		if (it != mEntries.end())
+		{
+			it->second.bytes = bytes;
+			it->second.loadMs = loadTime.count();
+			// Trimmed before the asset is marked loaded, as nothing holds it until it's returned below
+			trim();
+			it->second.loaded = true;
+		}
+	}
+
+	return asset.get();
+}
+
+void AssetRegistry::trim()
+{
+	size_t total = 0;
+	for (auto it = mEntries.begin(); it != mEntries.end(); it++)
+	{
+		total += it->second.bytes;
+	}
+
+	while (total > mBudget)
+	{
+		auto oldest = mEntries.end();
+		for (auto it = mEntries.begin(); it != mEntries.end(); it++)
+		{
+			const Entry& entry = it->second;
+			if (entry.loaded && entry.countRefs(entry.asset.get()) == 0 && (oldest == mEntries.end() || entry.lastRequest < oldest->second.lastRequest))
+			{
+				oldest = it;
+			}
+		}
+
+		// Everything left is in use
+		if (oldest == mEntries.end())
+		{
+			break;
+		}
+
+		std::cout << "Evicting asset " << oldest->first << " (" << oldest->second.bytes << " bytes)" << std::endl;
+		total -= oldest->second.bytes;
+		mEntries.erase(oldest);
+		mStats.evictions++;
+	}
+}
+
+ModelAsset AssetRegistry::GetModel(const std::string& filePath, physx::PxCooking* cooking, const AssetRegistry::ModelOptions& options)
+{
+	std::ostringstream key;
+	// The thread count doesn't change the result, so it isn't part of the key
+	key << "model " << filePath << " (vertex format " << options.vertexFormat << ", " << options.lodCount << " LODs" << (options.updatePx ? ", PhysX" : "") << (options.convexHulls ? ", convex hulls" : "");
+	if (options.collisionProxyError > 0.0f)
+	{
+		key << ", collision proxies within " << options.collisionProxyError;
+	}
+	if (options.heightFieldCellSize > 0.0f && !options.heightFieldMeshes.empty())
+	{
+		key << ", heightfields every " << options.heightFieldCellSize << " for";
+		for (size_t i = 0; i < options.heightFieldMeshes.size(); i++)
+		{
+			key << " " << std::hex << options.heightFieldMeshes[i] << std::dec;
+		}
+	}
+	key << ")";
+
+	std::shared_ptr<const void> asset = get(key.str(),
+		[&](size_t& bytes)
+		{
+			// Imported without cooking: the meshes are processed & cooked below, on options.threadCount threads
+			std::vector<Mesh> meshes = Mesh::fromFile(filePath, cooking, false);
+
+			std::shared_ptr<const ConvexDecomposition> decomposition;
+			if (options.convexHulls && options.updatePx)
+			{
+				decomposition = ConvexDecomposition::open(filePath);
+				if (!decomposition && ConvexDecomposition::bake(filePath, ConvexDecomposition::defaultOptions()))
+				{
+					decomposition = ConvexDecomposition::open(filePath);
+				}
+			}
+
+			// Authored collision proxies aren't meshes of their own, they're matched with their meshes by name,
+			// before the meshes are processed in parallel so each task only touches its own mesh's slot
+			std::vector<Mesh> authoredProxies;
+			std::string suffix = Mesh::CollisionProxySuffix;
+			for (size_t i = 0; i < meshes.size();)
+			{
+				std::string name = meshes[i].Name();
+				if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+				{
+					authoredProxies.push_back(std::move(meshes[i]));
+					meshes.erase(meshes.begin() + i);
+				}
+				else
+				{
+					i++;
+				}
+			}
+
+			std::vector<Mesh> proxies(meshes.size());
+			std::vector<char> hasProxy(meshes.size(), 0);
+			for (size_t j = 0; j < authoredProxies.size(); j++)
+			{
+				std::string name = authoredProxies[j].Name();
+				for (size_t i = 0; i < meshes.size(); i++)
+				{
+					if (!hasProxy[i] && meshes[i].Name() + suffix == name)
+					{
+						proxies[i] = std::move(authoredProxies[j]);
+						hasProxy[i] = 1;
+						break;
+					}
+				}
+			}
+
+			// Render data: each mesh's vertex format & levels of detail, independent of the others
+			TaskPool::parallelFor(meshes.size(), options.threadCount, [&](size_t i)
+			{
+				meshes[i].SetVertexFormat(options.vertexFormat);
+				if (options.lodCount > 1)
+				{
+					meshes[i].GenerateLods(options.lodCount);
+				}
+			});
+
+			// Collision: what each mesh collides through, then the cooking of it
+			TaskPool::parallelFor(options.updatePx ? meshes.size() : 0, options.threadCount, [&](size_t i)
+			{
+				Mesh& mesh = meshes[i];
+
+				// Heightfields take precedence over anything else, as the surfaces they're asked for are known to be flat enough
+				std::string name = mesh.Name();
+				Mesh::HeightFieldStats stats;
+				if (options.heightFieldCellSize > 0.0f && mesh.GetMeshType() == Mesh::MeshType::TriangleList
+					&& std::find(options.heightFieldMeshes.begin(), options.heightFieldMeshes.end(), hashBytes(name.data(), name.size())) != options.heightFieldMeshes.end()
+					&& mesh.HeightFieldProxy(cooking, options.heightFieldCellSize, proxies[i], stats))
+				{
+					hasProxy[i] = 1;
+					std::cout << "Mesh " << name << ": " << stats.rows << "x" << stats.columns << " heightfield, " << stats.holeCount << " holes, error "
+						<< stats.maxError << " max / " << stats.meanError << " mean, " << stats.bytes << " bytes" << std::endl;
+					return;
+				}
+
+				// Convex decompositions take precedence over proxies, as they're made from the full detail mesh.
+				// The mesh is still cooked, in case one of its hulls can't be.
+				if (decomposition && mesh.GetMeshType() == Mesh::MeshType::TriangleList)
+				{
+					mesh.SetConvexHulls(decomposition->Cook(mesh.Name(), cooking));
+				}
+
+				if (!mesh.GetConvexHulls().empty())
+				{
+					// Hulls replace an authored proxy too
+					proxies[i] = Mesh();
+					hasProxy[i] = 0;
+				}
+				else if (!hasProxy[i] && options.collisionProxyError > 0.0f && mesh.GetMeshType() == Mesh::MeshType::TriangleList)
+				{
+					proxies[i] = mesh.SimplifiedProxy(options.collisionProxyError);
+					// Not worth a proxy if the simplifier couldn't remove anything
+					hasProxy[i] = proxies[i].GetIndexCount() < mesh.GetIndexCount();
+				}
+
+				// Meshes with a proxy only cook the proxy. Meshes with convex hulls still cook their full triangle mesh, as the fallback above.
+				if (hasProxy[i])
+				{
+					proxies[i].UpdatePx(cooking);
+				}
+				else
+				{
+					mesh.UpdatePx(cooking);
+				}
+			});
+
+			std::shared_ptr<Model> model = std::make_shared<Model>();
+			model->meshes.reserve(meshes.size());
+			model->collisionProxies.resize(meshes.size());
+			for (size_t i = 0; i < meshes.size(); i++)
+			{
+				bytes += meshBytes(meshes[i]);
+				model->meshes.push_back(Mesh::makeAsset(std::move(meshes[i])));
+				if (hasProxy[i])
+				{
+					bytes += meshBytes(proxies[i]);
+					model->collisionProxies[i] = Mesh::makeAsset(std::move(proxies[i]));
+				}
+			}
+			return std::shared_ptr<const void>(model);
+		},
+		[](const std::shared_ptr<const void>& asset)
+		{
+			// The model itself, plus its meshes & collision proxies held by GameObjects
+			const Model* model = static_cast<const Model*>(asset.get());
+			size_t refs = asset.use_count() - 1;
+			for (size_t i = 0; i < model->meshes.size(); i++)
+			{
+				refs += model->meshes[i].use_count() - 1;
+				if (model->collisionProxies[i])
+				{
+					refs += model->collisionProxies[i].use_count() - 1;
+				}
+			}
+			return refs;
+		});
+
+	return std::static_pointer_cast<const Model>(asset);
+}
+
+ImageAsset AssetRegistry::GetImage(const std::string& filePath)
+{
+	std::shared_ptr<const void> asset = get("image " + filePath,
+		[&](size_t& bytes)
+		{
+			std::shared_ptr<Image> image = std::make_shared<Image>(filePath);
+			// Loaded as RGBA
+			bytes = (size_t)image->Width() * image->Height() * 4;
+			return std::shared_ptr<const void>(image);
+		},
+		[](const std::shared_ptr<const void>& asset) { return (size_t)asset.use_count() - 1; });
+
+	// Images are handed out mutable, as the renderer stores their texture handle in them
+	return std::const_pointer_cast<Image>(std::static_pointer_cast<const Image>(asset));
+}
+
+MeshAsset AssetRegistry::GetMesh(const std::string& name, const std::function<Mesh()>& build)
+{
+	std::shared_ptr<const void> asset = get("mesh " + name,
+		[&](size_t& bytes)
+		{
+			MeshAsset mesh = Mesh::makeAsset(build());
+			bytes = meshBytes(*mesh);
+			return std::shared_ptr<const void>(mesh);
+		},
+		[](const std::shared_ptr<const void>& asset) { return (size_t)asset.use_count() - 1; });
+
+	return std::static_pointer_cast<const Mesh>(asset);
+}
+
+void AssetRegistry::SetBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBudget = bytes;
+	trim();
+}
+
+void AssetRegistry::Trim()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	trim();
+}
+
+size_t AssetRegistry::GetBudget()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBudget;
+}
+
+AssetRegistry::Stats AssetRegistry::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Stats ret = mStats;
+	ret.bytes = 0;
+	for (auto it = mEntries.begin(); it != mEntries.end(); it++)
+	{
+		ret.bytes += it->second.bytes;
+	}
+	return ret;
+}
+
+std::vector<AssetRegistry::AssetInfo> AssetRegistry::GetAssets()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<AssetInfo> ret;
+	for (auto it = mEntries.begin(); it != mEntries.end(); it++)
+	{
+		const Entry& entry = it->second;
+		if (!entry.loaded)
+		{
+			continue;
+		}
+
+		AssetInfo info = { it->first, entry.countRefs(entry.asset.get()), entry.bytes, entry.loadMs, entry.requests };
+		ret.push_back(info);
+	}
+	return ret;
+}
+
+void AssetRegistry::PrintReport()
+{
+	std::vector<AssetInfo> assets = GetAssets();
+	Stats stats = GetStats();
+
+	std::cout << "Assets:" << std::endl;
+	for (size_t i = 0; i < assets.size(); i++)
+	{
+		const AssetInfo& asset = assets[i];
+		std::cout << "  " << asset.key << ": " << asset.loadMs << " ms, " << asset.bytes << " bytes, " << asset.refs << " handles, " << asset.requests << " requests" << std::endl;
+	}
+	std::cout << "  " << stats.loads << " loads in " << stats.loadMs << " ms, " << stats.duplicateRequests << " duplicate requests, "
+		<< stats.evictions << " evictions, " << stats.bytes << " bytes" << std::endl;
+}
+
+void AssetRegistry::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries.clear();
+}
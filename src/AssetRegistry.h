@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Mesh.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+namespace Pinball
+{
+	class Image;
+
+	// Meshes imported from a model file, in file order
+	struct Model
+	{
+		std::vector<MeshAsset> meshes;
+		// What each mesh collides through instead of itself (see GameObject::CollisionProxy), or nullptr. Same order as meshes.
+		std::vector<MeshAsset> collisionProxies;
+
+		// Returns the mesh with the given name, or nullptr
+		MeshAsset Find(const std::string& name) const;
+	};
+
+	typedef std::shared_ptr<const Model> ModelAsset;
+	typedef std::shared_ptr<Image> ImageAsset;
+
+	// Loads each asset (model file, image, named procedural mesh) once and hands out shared handles to it.
+	// Tracks how many handles are held outside the registry and how much memory each asset uses;
+	// once the total goes over the budget, the least recently requested assets that nothing else holds are evicted.
+	// Thread-safe: concurrent requests for the same asset wait for a single load.
+	class AssetRegistry
+	{
+	public:
+		// Processing applied to every mesh of a model. Models loaded with different options are separate assets.
+		struct ModelOptions
+		{
+			Mesh::VertexFormat vertexFormat;
+			// Levels of detail to generate (1 for none)
+			size_t lodCount;
+			// Create the PhysX geometry (needs a PxCooking)
+			bool updatePx;
+			// Threads the meshes are processed & cooked on, in parallel (one per hardware thread if 0)
+			unsigned int threadCount;
+			// Collide triangle-list meshes through the convex decomposition baked for the model (see ConvexDecomposition), baking it if needed
+			bool convexHulls;
+			// Collide meshes through collision proxies: the model's authored ones (see Mesh::CollisionProxySuffix), and for other triangle-list meshes
+			// ones simplified to within this error in mesh units (see Mesh::SimplifiedProxy), unless it's 0. Meshes with proxies aren't cooked themselves.
+			float collisionProxyError;
+			// Collide the meshes whose name hashes (hashBytes) are listed through heightfields sampled every heightFieldCellSize mesh units
+			// (see Mesh::HeightFieldProxy), instead of any other proxy or hulls. None if the cell size is 0.
+			float heightFieldCellSize;
+			std::vector<uint64_t> heightFieldMeshes;
+		};
+
+		struct AssetInfo
+		{
+			std::string key;
+			// Handles held outside the registry (for models, including handles to their meshes)
+			size_t refs;
+			size_t bytes;
+			double loadMs;
+			// Number of requests, including the one that loaded it
+			size_t requests;
+		};
+
+		struct Stats
+		{
+			size_t loads;
+			// Requests served by an asset that was already loaded (or being loaded)
+			size_t duplicateRequests;
+			size_t evictions;
+			// Memory used by the assets currently registered
+			size_t bytes;
+			// Total time spent loading
+			double loadMs;
+		};
+	private:
+		struct Entry
+		{
+			std::shared_future<std::shared_ptr<const void>> asset;
+			// Counts the handles to the asset held outside the registry
+			std::function<size_t(const std::shared_ptr<const void>&)> countRefs;
+			size_t bytes;
+			double loadMs;
+			size_t requests;
+			// Request clock value of the latest request, for least recently used eviction
+			uint64_t lastRequest;
+			bool loaded;
+		};
+
+		std::map<std::string, Entry> mEntries;
+		std::mutex mMutex;
+		size_t mBudget;
+		uint64_t mClock;
+		Stats mStats;
+
+		// Returns the asset stored under key, calling load (outside the lock) if it isn't registered yet.
+		// load returns the asset and sets its size in bytes.
+		std::shared_ptr<const void> get(const std::string& key, const std::function<std::shared_ptr<const void>(size_t& bytes)>& load, const std::function<size_t(const std::shared_ptr<const void>&)>& countRefs);
+		// Evicts unreferenced assets, least recently requested first, until the total is within budget. Expects mMutex to be held.
+		void trim();
+	public:
+		AssetRegistry();
+
+		// Registry used by the game
+		static AssetRegistry& Global();
+
+		// Imports the meshes of a model file (see Mesh::fromFile) & processes them with options
+		ModelAsset GetModel(const std::string& filePath, physx::PxCooking* cooking, const ModelOptions& options);
+		// Loads an image file (RGBA)
+		ImageAsset GetImage(const std::string& filePath);
+		// Mesh built by code, registered under name. build is only called if the name isn't registered yet.
+		MeshAsset GetMesh(const std::string& name, const std::function<Mesh()>& build);
+
+		// Maximum memory used by unreferenced assets before they get evicted (no limit by default, see --asset-budget)
+		void SetBudget(size_t bytes);
+		size_t GetBudget();
+		// Evicts unreferenced assets until the total is within budget. Assets are also trimmed after each load,
+		// but this lets the ones a released level held go right away (see LevelLoader::Poll).
+		void Trim();
+
+		Stats GetStats();
+		std::vector<AssetInfo> GetAssets();
+		// Prints every asset's load time, size, handles & requests, then the totals
+		void PrintReport();
+
+		// Drops the registry's references (assets still held elsewhere stay alive until released)
+		void Clear();
+
+		// Memory used by a mesh's vertices & indices
+		static size_t meshBytes(const Mesh& mesh);
+	};
+}
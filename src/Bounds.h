@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Vertex.h"
+#include <PxPhysicsAPI.h>
+#include <cstddef>
+
+namespace Pinball
+{
+	// Bounding volumes of a mesh's vertices. Computed once when the vertices are set (see Mesh::GetBounds),
+	// for use by placement, LOD selection, culling & broadphase bounds.
+	struct Bounds
+	{
+		// Axis-aligned bounding box
+		physx::PxVec3 min, max;
+		// Average vertex position
+		physx::PxVec3 centroid;
+		// Bounding sphere, centred on the box
+		physx::PxVec3 sphereCenter;
+		float sphereRadius;
+
+		physx::PxVec3 Center() const;
+		physx::PxVec3 HalfExtents() const;
+
+		// Computes the bounds with the SSE kernel where the build targets SSE2, otherwise with computeScalar.
+		static Bounds compute(const Vertex* vertices, size_t count);
+		// Reference implementation of compute, one component at a time.
+		static Bounds computeScalar(const Vertex* vertices, size_t count);
+		// True if compute uses the SSE kernel in this build
+		static bool simdEnabled();
+
+		// Times compute against computeScalar on random meshes of 1k to 1M vertices and prints the results.
+		static void benchmark();
+	};
+}
@@ -0,0 +1,651 @@
+#include "ConvexDecomposition.h"
+#include "CookingCache.h"
+#include "CookingProfiles.h"
+#include "GameObject.h"
+#include "PlacementTable.h"
+#include "ResourcePack.h"
+#include "Util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace Pinball;
+
+namespace
+{
+	// File layout (native endianness):
+	//	FileHeader
+	//	MeshRecord * meshCount, sorted by nameHash
+	//	HullRecord * hullCount
+	//	PxVec3 * pointCount
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t meshCount;
+		uint32_t hullCount;
+		uint32_t pointCount;
+		uint32_t padding;
+		// Source file the hulls were baked from
+		uint64_t sourceSize;
+		int64_t sourceTime;
+	};
+
+	const char Magic[4] = { 'P', 'B', 'C', 'D' };
+
+	struct Triangle
+	{
+		unsigned int indices[3];
+		physx::PxVec3 normal;
+		physx::PxVec3 centroid;
+		float area;
+	};
+
+	physx::PxVec3 position(const Vertex& vertex)
+	{
+		return physx::PxVec3(vertex.pX(), vertex.pY(), vertex.pZ());
+	}
+
+	// Area of the convex hull of 2D points (monotone chain). Sorts the points.
+	float convexHullArea(std::vector<std::pair<float, float>>& points)
+	{
+		std::sort(points.begin(), points.end());
+		points.erase(std::unique(points.begin(), points.end()), points.end());
+		if (points.size() < 3)
+		{
+			return 0.0f;
+		}
+
+		auto turn = [](const std::pair<float, float>& o, const std::pair<float, float>& a, const std::pair<float, float>& b)
+		{
+			return (a.first - o.first) * (b.second - o.second) - (a.second - o.second) * (b.first - o.first);
+		};
+
+		// Lower hull, then upper hull
+		std::vector<std::pair<float, float>> hull(points.size() * 2);
+		size_t count = 0;
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			while (count >= 2 && turn(hull[count - 2], hull[count - 1], points[i]) <= 0.0f)
+			{
+				count--;
+			}
+			hull[count++] = points[i];
+		}
+		for (size_t i = points.size() - 1, lower = count + 1; i > 0; i--)
+		{
+			while (count >= lower && turn(hull[count - 2], hull[count - 1], points[i - 1]) <= 0.0f)
+			{
+				count--;
+			}
+			hull[count++] = points[i - 1];
+		}
+
+		float area = 0.0f;
+		for (size_t i = 0; i + 1 < count; i++)
+		{
+			area += hull[i].first * hull[i + 1].second - hull[i + 1].first * hull[i].second;
+		}
+		return std::fabs(area) * 0.5f;
+	}
+
+	// True if extruding the patch leaves its surface exactly as it is: no triangle has a vertex of the patch above its plane
+	// (the hull would fill the dip in), and the patch's outline seen along normal is convex (the hull would fill gaps like a drain or lane in,
+	// which shows as the outline's convex hull being larger than the triangles' projected area)
+	bool isConvexPatch(Span<const Vertex> vertices, const std::vector<Triangle>& triangles, size_t begin, size_t end, const std::vector<unsigned int>& used,
+		const physx::PxVec3& normal, float tolerance)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			float plane = triangles[i].normal.dot(position(vertices[triangles[i].indices[0]]));
+			for (size_t j = 0; j < used.size(); j++)
+			{
+				if (triangles[i].normal.dot(position(vertices[used[j]])) - plane > tolerance)
+				{
+					return false;
+				}
+			}
+		}
+
+		physx::PxVec3 u = normal.cross(std::fabs(normal.x) < 0.9f ? physx::PxVec3(1.0f, 0.0f, 0.0f) : physx::PxVec3(0.0f, 1.0f, 0.0f)).getNormalized();
+		physx::PxVec3 v = normal.cross(u);
+
+		float area = 0.0f;
+		for (size_t i = begin; i < end; i++)
+		{
+			area += triangles[i].area * std::fabs(triangles[i].normal.dot(normal));
+		}
+
+		std::vector<std::pair<float, float>> projected(used.size());
+		for (size_t i = 0; i < used.size(); i++)
+		{
+			physx::PxVec3 point = position(vertices[used[i]]);
+			projected[i] = std::make_pair(point.dot(u), point.dot(v));
+		}
+		// Allows for float error in the areas
+		return convexHullArea(projected) <= area * 1.01f;
+	}
+
+	// Splits triangles [begin, end) at the median of their centroids along the longest axis until each part is small, flat & convex enough
+	// (see isConvexPatch), then extrudes each part against its average normal into a hull
+	void split(Span<const Vertex> vertices, std::vector<Triangle>& triangles, size_t begin, size_t end, size_t maxTriangles, float minNormalDot, float thickness,
+		std::vector<std::vector<physx::PxVec3>>& hulls)
+	{
+		physx::PxVec3 normal(0.0f);
+		physx::PxVec3 boundsMin(PX_MAX_F32), boundsMax(-PX_MAX_F32);
+		for (size_t i = begin; i < end; i++)
+		{
+			normal += triangles[i].normal * triangles[i].area;
+			boundsMin = boundsMin.minimum(triangles[i].centroid);
+			boundsMax = boundsMax.maximum(triangles[i].centroid);
+		}
+		// Opposite faces cancel out: fall back on any one of them, the part can't be flat anyway
+		normal = normal.magnitude() > 0.0f ? normal.getNormalized() : triangles[begin].normal;
+
+		bool flat = true;
+		for (size_t i = begin; i < end && flat; i++)
+		{
+			flat = triangles[i].normal.dot(normal) >= minNormalDot;
+		}
+
+		std::vector<unsigned int> used;
+		used.reserve((end - begin) * 3);
+		for (size_t i = begin; i < end; i++)
+		{
+			used.insert(used.end(), triangles[i].indices, triangles[i].indices + 3);
+		}
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+
+		physx::PxVec3 extent = boundsMax - boundsMin;
+		int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+		bool fits = end - begin <= maxTriangles && flat && isConvexPatch(vertices, triangles, begin, end, used, normal, thickness * 0.01f);
+		if (!fits && end - begin > 1 && extent[axis] > 0.0f)
+		{
+			size_t middle = (begin + end) / 2;
+			std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end,
+				[axis](const Triangle& a, const Triangle& b) { return a.centroid[axis] < b.centroid[axis]; });
+			split(vertices, triangles, begin, middle, maxTriangles, minNormalDot, thickness, hulls);
+			split(vertices, triangles, middle, end, maxTriangles, minNormalDot, thickness, hulls);
+			return;
+		}
+
+		// The surface itself stays where it is, the hull grows behind it
+		std::vector<physx::PxVec3> hull;
+		hull.reserve(used.size() * 2);
+		for (size_t i = 0; i < used.size(); i++)
+		{
+			physx::PxVec3 point = position(vertices[used[i]]);
+			hull.push_back(point);
+			hull.push_back(point - normal * thickness);
+		}
+		hulls.push_back(std::move(hull));
+	}
+
+	// Contacts (including CCD) between everything, for the benchmark's scenes
+	physx::PxFilterFlags ccdFilterShader(physx::PxFilterObjectAttributes attribs0, physx::PxFilterData filterData0,
+		physx::PxFilterObjectAttributes attribs1, physx::PxFilterData filterData1,
+		physx::PxPairFlags& pairFlags, const void* constantBlock, physx::PxU32 constantBlockSz)
+	{
+		pairFlags = physx::PxPairFlag::eCONTACT_DEFAULT | physx::PxPairFlag::eDETECT_CCD_CONTACT;
+		return physx::PxFilterFlag::eDEFAULT;
+	}
+}
+
+ConvexDecomposition::ConvexDecomposition()
+{
+}
+
+ConvexDecomposition::Options ConvexDecomposition::defaultOptions()
+{
+	Options options;
+	options.maxTrianglesPerHull = 32;
+	options.maxNormalAngle = 20.0f;
+	options.thickness = 0.02f;
+	return options;
+}
+
+std::vector<std::vector<physx::PxVec3>> ConvexDecomposition::decompose(Span<const Vertex> vertices, Span<const unsigned int> indices, const ConvexDecomposition::Options& options)
+{
+	std::vector<std::vector<physx::PxVec3>> hulls;
+
+	// Degenerate triangles have no normal to extrude along, and no area to collide with
+	std::vector<Triangle> triangles;
+	triangles.reserve(indices.size() / 3);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		Triangle triangle;
+		physx::PxVec3 a = position(vertices[indices[i]]), b = position(vertices[indices[i + 1]]), c = position(vertices[indices[i + 2]]);
+		physx::PxVec3 cross = (b - a).cross(c - a);
+		triangle.area = cross.magnitude() * 0.5f;
+		if (triangle.area <= 0.0f)
+		{
+			continue;
+		}
+		triangle.normal = cross.getNormalized();
+		triangle.centroid = (a + b + c) / 3.0f;
+		memcpy(triangle.indices, &indices[i], sizeof(triangle.indices));
+		triangles.push_back(triangle);
+	}
+	if (triangles.empty())
+	{
+		return hulls;
+	}
+
+	float thickness = options.thickness * Bounds::compute(vertices.data(), vertices.size()).sphereRadius;
+	float minNormalDot = std::cos(options.maxNormalAngle * physx::PxPi / 180.0f);
+	split(vertices, triangles, 0, triangles.size(), options.maxTrianglesPerHull, minNormalDot, thickness, hulls);
+	return hulls;
+}
+
+std::string ConvexDecomposition::pathFor(const std::string& sourcePath)
+{
+	return sourcePath + ".hulls";
+}
+
+bool ConvexDecomposition::parse(const std::string& sourcePath, Span<const unsigned char> data, Span<const unsigned char> packedSource)
+{
+	if (data.size() < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data.data(), sizeof(FileHeader));
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version)
+	{
+		std::cout << "Convex decomposition " << pathFor(sourcePath) << " is from another version, ignoring it." << std::endl;
+		return false;
+	}
+
+	// Packed decompositions are baked right before packing (see --build-pack), so they're checked against the source's packed size & time
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	bool found = packedSource.empty() ? statFile(sourcePath, sourceSize, sourceTime) : ResourcePack::findSourceInfo(sourcePath, sourceSize, sourceTime);
+	if (!found || sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+	{
+		std::cout << "Convex decomposition " << pathFor(sourcePath) << " is out of date." << std::endl;
+		return false;
+	}
+
+	size_t hullsOffset = sizeof(FileHeader) + (size_t)header.meshCount * sizeof(MeshRecord);
+	size_t pointsOffset = hullsOffset + (size_t)header.hullCount * sizeof(HullRecord);
+	if ((uint64_t)pointsOffset + (uint64_t)header.pointCount * sizeof(physx::PxVec3) > data.size())
+	{
+		std::cout << "Convex decomposition " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+		return false;
+	}
+
+	mMeshes = Span<const MeshRecord>((const MeshRecord*)(data.data() + sizeof(FileHeader)), header.meshCount);
+	mHulls = Span<const HullRecord>((const HullRecord*)(data.data() + hullsOffset), header.hullCount);
+	mPoints = Span<const physx::PxVec3>((const physx::PxVec3*)(data.data() + pointsOffset), header.pointCount);
+
+	for (size_t i = 0; i < mMeshes.size(); i++)
+	{
+		if ((uint64_t)mMeshes[i].firstHull + mMeshes[i].hullCount > mHulls.size() || (i > 0 && mMeshes[i - 1].nameHash > mMeshes[i].nameHash))
+		{
+			std::cout << "Convex decomposition " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < mHulls.size(); i++)
+	{
+		if ((uint64_t)mHulls[i].firstPoint + mHulls[i].pointCount > mPoints.size())
+		{
+			std::cout << "Convex decomposition " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<const ConvexDecomposition> ConvexDecomposition::open(const std::string& sourcePath)
+{
+	std::shared_ptr<ConvexDecomposition> decomposition(new ConvexDecomposition());
+
+	// Packed decompositions stay mapped as long as their pack is mounted, ie. until the program exits
+	Span<const unsigned char> packedSource = ResourcePack::find(sourcePath);
+	if (!packedSource.empty())
+	{
+		if (!decomposition->parse(sourcePath, ResourcePack::find(pathFor(sourcePath)), packedSource))
+		{
+			return nullptr;
+		}
+		return decomposition;
+	}
+
+	decomposition->mFile = MappedFile::open(pathFor(sourcePath));
+	if (!decomposition->mFile || !decomposition->parse(sourcePath, Span<const unsigned char>(decomposition->mFile->Data(), decomposition->mFile->Size()), Span<const unsigned char>()))
+	{
+		return nullptr;
+	}
+	return decomposition;
+}
+
+bool ConvexDecomposition::bake(const std::string& sourcePath, const ConvexDecomposition::Options& options)
+{
+	FileHeader header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.padding = 0;
+	if (!statFile(sourcePath, header.sourceSize, header.sourceTime))
+	{
+		std::cerr << "Couldn't find " << sourcePath << " to decompose" << std::endl;
+		return false;
+	}
+
+	// The same (welded) meshes the game loads, so the hulls line up with them
+	std::vector<Mesh> meshes = Mesh::fromFile(sourcePath, nullptr, false);
+
+	std::vector<MeshRecord> meshRecords;
+	std::vector<HullRecord> hullRecords;
+	std::vector<physx::PxVec3> points;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].GetMeshType() != Mesh::MeshType::TriangleList)
+		{
+			continue;
+		}
+
+		std::vector<std::vector<physx::PxVec3>> hulls = decompose(meshes[i].GetVertices(), meshes[i].GetIndices(), options);
+		std::string name = meshes[i].Name();
+		MeshRecord meshRecord = { hashBytes(name.data(), name.size()), (uint32_t)hullRecords.size(), (uint32_t)hulls.size() };
+		meshRecords.push_back(meshRecord);
+
+		for (size_t j = 0; j < hulls.size(); j++)
+		{
+			HullRecord hullRecord = { (uint32_t)points.size(), (uint32_t)hulls[j].size() };
+			hullRecords.push_back(hullRecord);
+			points.insert(points.end(), hulls[j].begin(), hulls[j].end());
+		}
+		std::cout << "Decomposed " << name << ": " << meshes[i].GetIndexCount() / 3 << " triangles -> " << hulls.size() << " hulls" << std::endl;
+	}
+
+	std::sort(meshRecords.begin(), meshRecords.end(), [](const MeshRecord& a, const MeshRecord& b) { return a.nameHash < b.nameHash; });
+	header.meshCount = (uint32_t)meshRecords.size();
+	header.hullCount = (uint32_t)hullRecords.size();
+	header.pointCount = (uint32_t)points.size();
+
+	// Levels loading in the background may map the file while it's rebaked
+	std::string path = pathFor(sourcePath);
+	bool written = writeFileAtomic(path, [&](std::ostream& out)
+	{
+		out.write((const char*)&header, sizeof(FileHeader));
+		out.write((const char*)meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+		out.write((const char*)hullRecords.data(), hullRecords.size() * sizeof(HullRecord));
+		out.write((const char*)points.data(), points.size() * sizeof(physx::PxVec3));
+	});
+	if (!written)
+	{
+		std::cerr << "Failed to write convex decomposition " << path << std::endl;
+		return false;
+	}
+
+	std::cout << "Baked " << hullRecords.size() << " hulls into " << path << std::endl;
+	return true;
+}
+
+const ConvexDecomposition::MeshRecord* ConvexDecomposition::Find(const std::string& name) const
+{
+	uint64_t hash = hashBytes(name.data(), name.size());
+	const MeshRecord* mesh = std::lower_bound(mMeshes.begin(), mMeshes.end(), hash, [](const MeshRecord& m, uint64_t h) { return m.nameHash < h; });
+	return (mesh != mMeshes.end() && mesh->nameHash == hash) ? mesh : nullptr;
+}
+
+std::vector<physx::PxConvexMesh*> ConvexDecomposition::Cook(const std::string& name, physx::PxCooking* cooking) const
+{
+	std::vector<physx::PxConvexMesh*> convexMeshes;
+	const MeshRecord* mesh = Find(name);
+	if (mesh == nullptr)
+	{
+		return convexMeshes;
+	}
+
+	// Hulls are cooked as convex meshes of the mesh's name, so convex cooking profile rules apply to them.
+	// The profile's vertex limit isn't, as dropping hull vertices would move the surface.
+	cooking = CookingProfiles::Global().CookingFor(name, Mesh::MeshType::Convex, cooking);
+
+	convexMeshes.reserve(mesh->hullCount);
+	for (uint32_t i = mesh->firstHull; i < mesh->firstHull + mesh->hullCount; i++)
+	{
+		physx::PxConvexMeshDesc desc;
+		desc.points.count = mHulls[i].pointCount;
+		desc.points.data = &mPoints[mHulls[i].firstPoint];
+		desc.points.stride = sizeof(physx::PxVec3);
+		desc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
+
+		physx::PxConvexMesh* convexMesh = CookingCache::Global().ConvexMesh(cooking, desc);
+		if (convexMesh == nullptr)
+		{
+			// A compound with a hole in it would let the ball through, so the mesh keeps its triangle mesh
+			std::cerr << "Failed to cook hull " << i - mesh->firstHull << " of " << name << ", keeping its triangle mesh" << std::endl;
+			for (size_t j = 0; j < convexMeshes.size(); j++)
+			{
+				convexMeshes[j]->release();
+			}
+			convexMeshes.clear();
+			return convexMeshes;
+		}
+		convexMeshes.push_back(convexMesh);
+	}
+	return convexMeshes;
+}
+
+Span<const ConvexDecomposition::MeshRecord> ConvexDecomposition::Meshes() const
+{
+	return mMeshes;
+}
+
+Span<const ConvexDecomposition::HullRecord> ConvexDecomposition::Hulls() const
+{
+	return mHulls;
+}
+
+Span<const physx::PxVec3> ConvexDecomposition::Points() const
+{
+	return mPoints;
+}
+
+void ConvexDecomposition::benchmark(physx::PxCooking* cooking, const std::string& modelPath, const std::string& originPath)
+{
+	std::shared_ptr<const ConvexDecomposition> decomposition = open(modelPath);
+	if (!decomposition && bake(modelPath, defaultOptions()))
+	{
+		decomposition = open(modelPath);
+	}
+	if (!decomposition)
+	{
+		std::cerr << "Couldn't decompose " << modelPath << std::endl;
+		return;
+	}
+	std::shared_ptr<const PlacementTable> placements = PlacementTable::open(originPath);
+
+	// Side A: the triangle-list meshes as the game cooks them. Side B: the same meshes with their hulls.
+	std::vector<Mesh> meshes = Mesh::fromFile(modelPath, cooking, true);
+	std::vector<MeshAsset> triangleMeshes, convexMeshes;
+	float ballRadius = 0.25f;
+	size_t triangleCount = 0, hullCount = 0;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].GetMeshType() == Mesh::MeshType::Sphere)
+		{
+			ballRadius = meshes[i].GetBounds().sphereRadius;
+		}
+		if (meshes[i].GetMeshType() != Mesh::MeshType::TriangleList)
+		{
+			continue;
+		}
+
+		Mesh convexMesh = meshes[i];
+		convexMesh.SetConvexHulls(decomposition->Cook(meshes[i].Name(), cooking));
+		triangleCount += meshes[i].GetIndexCount() / 3;
+		hullCount += convexMesh.GetConvexHulls().size();
+		triangleMeshes.push_back(Mesh::makeAsset(std::move(meshes[i])));
+		convexMeshes.push_back(Mesh::makeAsset(std::move(convexMesh)));
+	}
+
+	struct Table
+	{
+		physx::PxDefaultCpuDispatcher* dispatcher;
+		physx::PxScene* scene;
+		std::vector<std::unique_ptr<GameObject>> objects;
+		physx::PxRigidDynamic* ball;
+		// Where the ball is launched from
+		physx::PxVec3 boundsMin, boundsMax;
+	};
+
+	// A scene set up like the game's (gravity, CCD) with the meshes placed as in the level, and a ball
+	physx::PxMaterial* ballMaterial = PxGetPhysics().createMaterial(0.0f, 0.0f, 0.9f);
+	auto createTable = [&](const std::vector<MeshAsset>& assets, Table& table)
+	{
+		table.dispatcher = physx::PxDefaultCpuDispatcherCreate(1);
+		physx::PxSceneDesc sceneDesc = physx::PxSceneDesc(physx::PxTolerancesScale());
+		sceneDesc.gravity = physx::PxVec3(0.0f, -9.81f, 9.81f);
+		sceneDesc.filterShader = ccdFilterShader;
+		sceneDesc.cpuDispatcher = table.dispatcher;
+		sceneDesc.flags = physx::PxSceneFlag::eENABLE_CCD;
+		table.scene = PxGetPhysics().createScene(sceneDesc);
+
+		table.boundsMin = physx::PxVec3(PX_MAX_F32);
+		table.boundsMax = physx::PxVec3(-PX_MAX_F32);
+		for (size_t i = 0; i < assets.size(); i++)
+		{
+			const PlacementTable::Placement* placement = placements ? placements->Find(assets[i]->Name()) : nullptr;
+			physx::PxTransform transform(physx::PxIdentity);
+			std::unique_ptr<GameObject> object(new GameObject());
+			if (placement)
+			{
+				object->Scale().X(placement->scale[0]);
+				object->Scale().Y(placement->scale[1]);
+				object->Scale().Z(placement->scale[2]);
+				transform = physx::PxTransform(physx::PxVec3(placement->position[0], placement->position[1], placement->position[2]),
+					physx::PxQuat(placement->rotation[0], placement->rotation[1], placement->rotation[2], placement->rotation[3]));
+			}
+			// The table's physics material
+			object->Geometry(assets[i], GameObject::Static, 0.2f, 0.4f, 0.3f);
+			object->Transform(transform);
+			table.scene->addActor(*object->GetPxActor());
+
+			physx::PxBounds3 bounds = object->GetPxRigidActor()->getWorldBounds();
+			table.boundsMin = table.boundsMin.minimum(bounds.minimum);
+			table.boundsMax = table.boundsMax.maximum(bounds.maximum);
+			table.objects.push_back(std::move(object));
+		}
+
+		table.ball = PxGetPhysics().createRigidDynamic(physx::PxTransform(physx::PxIdentity));
+		physx::PxShape* shape = PxGetPhysics().createShape(physx::PxSphereGeometry(ballRadius), *ballMaterial, true);
+		table.ball->attachShape(*shape);
+		shape->release();
+		physx::PxRigidBodyExt::updateMassAndInertia(*table.ball, 1.0f);
+		table.ball->setRigidBodyFlag(physx::PxRigidBodyFlag::eENABLE_CCD, true);
+		table.scene->addActor(*table.ball);
+	};
+	auto releaseTable = [](Table& table)
+	{
+		table.ball->release();
+		// Releasing the objects' actors also removes them from the scene
+		table.objects.clear();
+		table.scene->release();
+		table.dispatcher->release();
+	};
+
+	const int trajectoryCount = 16;
+	const int stepsPerTrajectory = 300;
+	const float stepSize = 1.0f / 60.0f;
+
+	// Record: launch the ball from random points above the triangle-mesh table and keep its state before every step
+	struct BallState
+	{
+		physx::PxTransform pose;
+		physx::PxVec3 linearVelocity, angularVelocity;
+	};
+	std::vector<BallState> states;
+	states.reserve(trajectoryCount * (stepsPerTrajectory + 1));
+	{
+		Table table;
+		createTable(triangleMeshes, table);
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int trajectory = 0; trajectory < trajectoryCount; trajectory++)
+		{
+			physx::PxVec3 start(
+				table.boundsMin.x + (table.boundsMax.x - table.boundsMin.x) * unit(rng),
+				table.boundsMax.y + ballRadius * 2.0f,
+				table.boundsMin.z + (table.boundsMax.z - table.boundsMin.z) * unit(rng));
+			table.ball->setGlobalPose(physx::PxTransform(start));
+			table.ball->setLinearVelocity(physx::PxVec3(unit(rng) - 0.5f, 0.0f, unit(rng) - 0.5f) * 10.0f);
+			table.ball->setAngularVelocity(physx::PxVec3(0.0f));
+
+			for (int step = 0; step <= stepsPerTrajectory; step++)
+			{
+				BallState state = { table.ball->getGlobalPose(), table.ball->getLinearVelocity(), table.ball->getAngularVelocity() };
+				states.push_back(state);
+				if (step < stepsPerTrajectory)
+				{
+					table.scene->simulate(stepSize);
+					table.scene->fetchResults(true);
+				}
+			}
+		}
+		releaseTable(table);
+	}
+
+	// Replay: put the ball in each recorded state and step once, on each side.
+	// The position error is how far the ball ends up from where the recording had it a step later.
+	typedef std::chrono::high_resolution_clock Clock;
+	const char* const sideNames[] = { "triangle mesh", "convex hulls" };
+	const std::vector<MeshAsset>* sideMeshes[] = { &triangleMeshes, &convexMeshes };
+	std::vector<std::string> results;
+	for (int side = 0; side < 2; side++)
+	{
+		Table table;
+		createTable(*sideMeshes[side], table);
+
+		double stepMs = 0.0, positionError = 0.0;
+		size_t contactPairs = 0, stepCount = 0;
+		for (int trajectory = 0; trajectory < trajectoryCount; trajectory++)
+		{
+			for (int step = 0; step < stepsPerTrajectory; step++)
+			{
+				const BallState& state = states[trajectory * (stepsPerTrajectory + 1) + step];
+				const BallState& next = states[trajectory * (stepsPerTrajectory + 1) + step + 1];
+				table.ball->setGlobalPose(state.pose);
+				table.ball->setLinearVelocity(state.linearVelocity);
+				table.ball->setAngularVelocity(state.angularVelocity);
+
+				auto start = Clock::now();
+				table.scene->simulate(stepSize);
+				table.scene->fetchResults(true);
+				stepMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+				physx::PxSimulationStatistics stats;
+				table.scene->getSimulationStatistics(stats);
+				contactPairs += stats.nbDiscreteContactPairsWithContacts;
+				positionError += (table.ball->getGlobalPose().p - next.pose.p).magnitude();
+				stepCount++;
+			}
+		}
+		releaseTable(table);
+
+		std::ostringstream result;
+		result << "  " << sideNames[side] << " (" << (side == 0 ? triangleCount : hullCount) << (side == 0 ? " triangles" : " hulls") << "): "
+			<< stepMs / stepCount << " ms/step, " << (double)contactPairs / stepCount << " contact pairs/step, "
+			<< positionError / stepCount << " mean position error/step";
+		results.push_back(result.str());
+	}
+	ballMaterial->release();
+
+	// Printed last, as loading & cooking log every mesh
+	std::cout << "Table collision benchmark, " << modelPath << " (" << trajectoryCount << " trajectories of " << stepsPerTrajectory << " steps):" << std::endl;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		std::cout << results[i] << std::endl;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "Span.h"
+#include <PxPhysicsAPI.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace Pinball
+{
+	// Approximate convex decomposition of a model's triangle-list meshes, baked offline (see bake) and written next to the model as <model>.hulls.
+	// Each mesh is split into patches of nearly coplanar triangles, and each patch is extruded against its normal into a thin convex hull.
+	// Patches are split until their outline is convex and they have no dips, so the hull doesn't fill gaps (like the drain or a lane) or hollows in,
+	// and the surface the ball rolls on is kept exactly. A mesh's hulls are cooked into a compound of convex shapes that replaces its
+	// PxTriangleMesh (see Mesh::SetConvexHulls), which is cheaper to collide against with CCD.
+	// The file is rebaked when the model's size & modification time change.
+	class ConvexDecomposition
+	{
+	public:
+		// Bump whenever the file layout (or how meshes are decomposed) changes
+		static const uint32_t Version = 2;
+
+		struct Options
+		{
+			// Most triangles in one hull (their vertices are also extruded, so at most 42 keeps hulls within PhysX's 255 vertex limit)
+			size_t maxTrianglesPerHull;
+			// Most a triangle's normal can turn away from its patch's average normal, in degrees
+			float maxNormalAngle;
+			// How deep patches are extruded, as a fraction of the mesh's bounding sphere radius
+			float thickness;
+		};
+
+		// One mesh's hulls
+		struct MeshRecord
+		{
+			// hashBytes of the mesh's name
+			uint64_t nameHash;
+			// Range of Hulls()
+			uint32_t firstHull, hullCount;
+		};
+
+		// One hull's points, a range of Points()
+		struct HullRecord
+		{
+			uint32_t firstPoint, pointCount;
+		};
+	private:
+		// Mapped file, or null if the decomposition is read from a mounted ResourcePack
+		std::unique_ptr<MappedFile> mFile;
+		Span<const MeshRecord> mMeshes;
+		Span<const HullRecord> mHulls;
+		Span<const physx::PxVec3> mPoints;
+
+		ConvexDecomposition();
+
+		// Checks the header against the source file (or its packed contents, if packedSource isn't empty) and finds the tables
+		bool parse(const std::string& sourcePath, Span<const unsigned char> data, Span<const unsigned char> packedSource);
+	public:
+		static Options defaultOptions();
+
+		// Splits a triangle list into convex hulls (each a point cloud, to be cooked with eCOMPUTE_CONVEX)
+		static std::vector<std::vector<physx::PxVec3>> decompose(Span<const Vertex> vertices, Span<const unsigned int> indices, const Options& options);
+
+		// Path of the decomposition baked from a model file
+		static std::string pathFor(const std::string& sourcePath);
+
+		// Maps the decomposition baked from sourcePath. Returns nullptr if there's none, or it's out of date or unreadable.
+		static std::shared_ptr<const ConvexDecomposition> open(const std::string& sourcePath);
+
+		// Imports a model and decomposes each of its triangle-list meshes into its decomposition file
+		static bool bake(const std::string& sourcePath, const Options& options);
+
+		// Hull ranges of the named mesh, or nullptr
+		const MeshRecord* Find(const std::string& name) const;
+		// Cooks the named mesh's hulls (through the cooking cache, with the cooking profile rules pick for its convex meshes). Empty if the mesh wasn't decomposed or a hull failed to cook.
+		// The caller owns the hulls (Mesh::SetConvexHulls releases them with the mesh).
+		std::vector<physx::PxConvexMesh*> Cook(const std::string& name, physx::PxCooking* cooking) const;
+
+		Span<const MeshRecord> Meshes() const;
+		Span<const HullRecord> Hulls() const;
+		Span<const physx::PxVec3> Points() const;
+
+		// Records ball trajectories on the model's triangle-list meshes (placed as in originPath's placement table, if there is one),
+		// then replays every recorded ball state against the triangle meshes & against the convex hulls, reporting the step time & contact pairs of each
+		static void benchmark(physx::PxCooking* cooking, const std::string& modelPath, const std::string& originPath);
+	};
+}
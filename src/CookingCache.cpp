@@ -0,0 +1,285 @@
+#include "CookingCache.h"
+#include "MappedFile.h"
+#include "Util.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace Pinball;
+
+namespace
+{
+	// Cache file layout: FileHeader, followed by the cooked stream
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t physxVersion;
+		// How long the mesh took to cook, to report the time saved by hits
+		float cookMs;
+		uint64_t key;
+		// Size of the cooked stream following the header, so truncated files are rejected
+		uint64_t payloadSize;
+	};
+
+	const char Magic[4] = { 'P', 'B', 'C', 'K' };
+
+	// Distinguishes the mesh kinds in the key
+	enum MeshKind { ConvexKind = 1, TriangleKind = 2 };
+
+	template <typename T>
+	uint64_t hashValue(const T& value, uint64_t hash)
+	{
+		return hashBytes(&value, sizeof(T), hash);
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+CookingCache::CookingCache(std::string directory)
+{
+	mDirectory = std::move(directory);
+	mDirectoryCreated = false;
+	mEnabled = true;
+	ResetStats();
+}
+
+CookingCache& CookingCache::Global()
+{
+	static CookingCache cache("CookingCache");
+	return cache;
+}
+
+std::string CookingCache::pathFor(uint64_t key) const
+{
+	std::ostringstream path;
+	path << mDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".cooked";
+	return path.str();
+}
+
+uint64_t CookingCache::hashParams(const physx::PxCookingParams& params, uint64_t hash)
+{
+	// Field by field, as the struct has padding
+	hash = hashValue(params.areaTestEpsilon, hash);
+	hash = hashValue(params.planeTolerance, hash);
+	hash = hashValue((uint32_t)params.convexMeshCookingType, hash);
+	hash = hashValue(params.suppressTriangleMeshRemapTable, hash);
+	hash = hashValue(params.buildTriangleAdjacencies, hash);
+	hash = hashValue(params.buildGPUData, hash);
+	hash = hashValue(params.scale.length, hash);
+	hash = hashValue(params.scale.speed, hash);
+	hash = hashValue((uint32_t)params.meshPreprocessParams, hash);
+	hash = hashValue(params.meshWeldTolerance, hash);
+	// Only the active member of the midphase union is meaningful, but all of its fields change the cooked output
+	hash = hashValue((uint32_t)params.midphaseDesc.getType(), hash);
+	if (params.midphaseDesc.getType() == physx::PxMeshMidPhase::eBVH34)
+	{
+		hash = hashValue(params.midphaseDesc.mBVH34Desc.numTrisPerLeaf, hash);
+	}
+	else
+	{
+		hash = hashValue(params.midphaseDesc.mBVH33Desc.meshSizePerformanceTradeOff, hash);
+		hash = hashValue((uint32_t)params.midphaseDesc.mBVH33Desc.meshCookingHint, hash);
+	}
+	hash = hashValue(params.gaussMapLimit, hash);
+	return hash;
+}
+
+uint64_t CookingCache::hashData(const physx::PxBoundedData& data, size_t elementSize, uint64_t hash)
+{
+	hash = hashValue(data.count, hash);
+	if (data.data == nullptr)
+	{
+		return hash;
+	}
+
+	size_t stride = data.stride != 0 ? data.stride : elementSize;
+	const unsigned char* element = (const unsigned char*)data.data;
+	for (physx::PxU32 i = 0; i < data.count; i++, element += stride)
+	{
+		hash = hashBytes(element, elementSize, hash);
+	}
+	return hash;
+}
+
+physx::PxBase* CookingCache::getOrCook(uint64_t key, const std::function<bool(physx::PxOutputStream&)>& cook, const std::function<physx::PxBase*(physx::PxInputData&)>& create)
+{
+	std::string path = pathFor(key);
+
+	// Hit: create the mesh straight from the mapped file
+	Clock::time_point start = Clock::now();
+	std::unique_ptr<MappedFile> file = mEnabled ? MappedFile::open(path) : nullptr;
+	if (file && file->Size() > sizeof(FileHeader))
+	{
+		FileHeader header;
+		memcpy(&header, file->Data(), sizeof(FileHeader));
+		if (memcmp(header.magic, Magic, sizeof(Magic)) == 0 && header.version == Version && header.physxVersion == PX_PHYSICS_VERSION && header.key == key
+			&& header.payloadSize == file->Size() - sizeof(FileHeader))
+		{
+			// PxDefaultMemoryInputData only reads from the buffer, despite taking it as non-const
+			physx::PxDefaultMemoryInputData input((physx::PxU8*)(file->Data() + sizeof(FileHeader)), (physx::PxU32)(file->Size() - sizeof(FileHeader)));
+			physx::PxBase* mesh = create(input);
+			if (mesh != nullptr)
+			{
+				double loadMs = millisecondsSince(start);
+
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStats.hits++;
+				mStats.loadMs += loadMs;
+				mStats.savedMs += header.cookMs - loadMs;
+				return mesh;
+			}
+		}
+		std::cout << "Ignoring invalid cooked mesh " << path << std::endl;
+	}
+	file.reset();
+
+	// Miss: cook, create, then store the cooked stream for next time
+	start = Clock::now();
+	physx::PxDefaultMemoryOutputStream buf;
+	if (!cook(buf))
+	{
+		return nullptr;
+	}
+	double cookMs = millisecondsSince(start);
+
+	physx::PxDefaultMemoryInputData input(buf.getData(), buf.getSize());
+	physx::PxBase* mesh = create(input);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStats.misses++;
+		mStats.cookMs += cookMs;
+	}
+
+	// Only streams PhysX could create a mesh from are worth storing
+	if (mesh == nullptr || !mEnabled)
+	{
+		return mesh;
+	}
+
+	FileHeader header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.physxVersion = PX_PHYSICS_VERSION;
+	header.cookMs = (float)cookMs;
+	header.key = key;
+	header.payloadSize = buf.getSize();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mDirectoryCreated)
+		{
+			// Fails harmlessly if the directory already exists
+#ifdef _WIN32
+			_mkdir(mDirectory.c_str());
+#else
+			mkdir(mDirectory.c_str(), 0755);
+#endif
+			mDirectoryCreated = true;
+		}
+	}
+
+	// Other threads may be cooking the same mesh, or mapping the file, while it's written
+	bool written = writeFileAtomic(path, [&](std::ostream& out)
+	{
+		out.write((const char*)&header, sizeof(FileHeader));
+		out.write((const char*)buf.getData(), buf.getSize());
+	});
+	if (!written)
+	{
+		std::cerr << "Failed to write cooked mesh " << path << std::endl;
+	}
+
+	return mesh;
+}
+
+physx::PxConvexMesh* CookingCache::ConvexMesh(physx::PxCooking* cooking, const physx::PxConvexMeshDesc& desc)
+{
+	size_t indexSize = (desc.flags & physx::PxConvexFlag::e16_BIT_INDICES) ? sizeof(physx::PxU16) : sizeof(physx::PxU32);
+
+	uint64_t key = hashValue((uint32_t)ConvexKind, hashBytes(nullptr, 0));
+	key = hashParams(cooking->getParams(), key);
+	key = hashData(desc.points, sizeof(physx::PxVec3), key);
+	key = hashData(desc.indices, indexSize, key);
+	key = hashValue((uint32_t)desc.flags, key);
+	key = hashValue(desc.vertexLimit, key);
+
+	physx::PxBase* mesh = getOrCook(key,
+		[&](physx::PxOutputStream& out)
+		{
+			bool cooked = cooking->cookConvexMesh(desc, out);
+			if (cooked)
+			{
+				std::cout << "Cooking PhysX convex mesh successful." << std::endl;
+			}
+			else
+			{
+				std::cerr << "Cooking PhysX convex mesh failed." << std::endl;
+			}
+			return cooked;
+		},
+		[](physx::PxInputData& in) -> physx::PxBase* { return PxGetPhysics().createConvexMesh(in); });
+
+	return static_cast<physx::PxConvexMesh*>(mesh);
+}
+
+physx::PxTriangleMesh* CookingCache::TriangleMesh(physx::PxCooking* cooking, const physx::PxTriangleMeshDesc& desc)
+{
+	size_t triangleSize = 3 * ((desc.flags & physx::PxMeshFlag::e16_BIT_INDICES) ? sizeof(physx::PxU16) : sizeof(physx::PxU32));
+
+	uint64_t key = hashValue((uint32_t)TriangleKind, hashBytes(nullptr, 0));
+	key = hashParams(cooking->getParams(), key);
+	key = hashData(desc.points, sizeof(physx::PxVec3), key);
+	key = hashData(desc.triangles, triangleSize, key);
+	key = hashValue((uint32_t)desc.flags, key);
+
+	physx::PxBase* mesh = getOrCook(key,
+		[&](physx::PxOutputStream& out)
+		{
+			bool cooked = cooking->cookTriangleMesh(desc, out);
+			if (cooked)
+			{
+				std::cout << "Cooking PhysX triangle mesh successful." << std::endl;
+			}
+			else
+			{
+				std::cerr << "Cooking PhysX triangle mesh failed." << std::endl;
+			}
+			return cooked;
+		},
+		[](physx::PxInputData& in) -> physx::PxBase* { return PxGetPhysics().createTriangleMesh(in); });
+
+	return static_cast<physx::PxTriangleMesh*>(mesh);
+}
+
+void CookingCache::SetEnabled(bool enabled)
+{
+	mEnabled = enabled;
+}
+
+CookingCache::Stats CookingCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void CookingCache::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats = { 0, 0, 0.0, 0.0, 0.0 };
+}
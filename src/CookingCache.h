@@ -0,0 +1,63 @@
+#pragma once
+
+#include <PxPhysicsAPI.h>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+namespace Pinball
+{
+	// Persistent cache of cooked PhysX meshes. The cooked stream of each mesh is stored in a file of the cache directory,
+	// named after a hash of the mesh data, its type & flags and the cooking parameters.
+	// Later requests for the same mesh create it straight from the memory-mapped file, without cooking.
+	// Thread-safe.
+	class CookingCache
+	{
+	public:
+		struct Stats
+		{
+			// Meshes created from cached data
+			size_t hits;
+			// Meshes that had to be cooked
+			size_t misses;
+			// Time spent cooking (misses) and creating meshes from cached data (hits)
+			double cookMs, loadMs;
+			// Cooking time avoided by the hits, minus the time they took to load
+			double savedMs;
+		};
+	private:
+		// Bump whenever the file layout or the key changes
+		static const uint32_t Version = 3;
+
+		std::string mDirectory;
+		bool mDirectoryCreated;
+		std::atomic<bool> mEnabled;
+		std::mutex mMutex;
+		Stats mStats;
+
+		std::string pathFor(uint64_t key) const;
+		// Creates the mesh stored under key with create, or cooks it with cook, creates it & stores the cooked data
+		physx::PxBase* getOrCook(uint64_t key, const std::function<bool(physx::PxOutputStream&)>& cook, const std::function<physx::PxBase*(physx::PxInputData&)>& create);
+
+		static uint64_t hashParams(const physx::PxCookingParams& params, uint64_t hash);
+		// Hashes count elements of elementSize bytes, stride bytes apart (elementSize apart if stride is 0)
+		static uint64_t hashData(const physx::PxBoundedData& data, size_t elementSize, uint64_t hash);
+	public:
+		CookingCache(std::string directory);
+
+		// Cache used by the game, in the CookingCache directory under the working directory
+		static CookingCache& Global();
+
+		// Return the mesh for desc, cooking it only if it isn't cached yet. nullptr if cooking fails.
+		physx::PxConvexMesh* ConvexMesh(physx::PxCooking* cooking, const physx::PxConvexMeshDesc& desc);
+		physx::PxTriangleMesh* TriangleMesh(physx::PxCooking* cooking, const physx::PxTriangleMeshDesc& desc);
+
+		// When disabled, every mesh is cooked and nothing is read from or written to the cache (eg. to benchmark cooking itself)
+		void SetEnabled(bool enabled);
+
+		Stats GetStats();
+		void ResetStats();
+	};
+}
@@ -0,0 +1,474 @@
+#include "CookingProfiles.h"
+#include "Mesh.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <random>
+
+using namespace Pinball;
+
+namespace
+{
+	const char* const MeshTypeNames[] = { "Plane", "Box", "Sphere", "Convex", "TriangleList" };
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+CookingProfile CookingProfile::defaults(const std::string& name)
+{
+	CookingProfile profile;
+	profile.name = name;
+	profile.midphase = physx::PxMeshMidPhase::eBVH33;
+	profile.trianglesPerLeaf = 4;
+	profile.meshSizePerformanceTradeOff = 0.55f;
+	profile.cleanMesh = true;
+	profile.weldVertices = false;
+	profile.weldTolerance = 0.0f;
+	profile.activeEdges = true;
+	profile.convexVertexLimit = 255;
+	profile.gaussMapLimit = 32;
+	return profile;
+}
+
+physx::PxCookingParams CookingProfile::Params(const physx::PxTolerancesScale& scale) const
+{
+	physx::PxCookingParams params(scale);
+
+	params.midphaseDesc.setToDefault(midphase);
+	if (midphase == physx::PxMeshMidPhase::eBVH34)
+	{
+		params.midphaseDesc.mBVH34Desc.numTrisPerLeaf = trianglesPerLeaf;
+	}
+	else
+	{
+		params.midphaseDesc.mBVH33Desc.meshSizePerformanceTradeOff = meshSizePerformanceTradeOff;
+	}
+
+	params.meshPreprocessParams = physx::PxMeshPreprocessingFlags();
+	if (!cleanMesh)
+	{
+		params.meshPreprocessParams |= physx::PxMeshPreprocessingFlag::eDISABLE_CLEAN_MESH;
+	}
+	if (weldVertices)
+	{
+		params.meshPreprocessParams |= physx::PxMeshPreprocessingFlag::eWELD_VERTICES;
+		params.meshWeldTolerance = weldTolerance;
+	}
+	if (!activeEdges)
+	{
+		params.meshPreprocessParams |= physx::PxMeshPreprocessingFlag::eDISABLE_ACTIVE_EDGES_PRECOMPUTE;
+	}
+
+	params.gaussMapLimit = gaussMapLimit;
+	return params;
+}
+
+CookingProfiles::CookingProfiles()
+{
+	Add(CookingProfile::defaults("default"));
+
+	// Faster midphase queries than BVH33, for the large static meshes the ball rolls over
+	CookingProfile bvh34 = CookingProfile::defaults("bvh34");
+	bvh34.midphase = physx::PxMeshMidPhase::eBVH34;
+	Add(bvh34);
+
+	// As bvh34, merging vertices less than a millimetre apart (eg. seams left by the modelling tool)
+	CookingProfile welded = bvh34;
+	welded.name = "bvh34-welded";
+	welded.weldVertices = true;
+	welded.weldTolerance = 0.001f;
+	Add(welded);
+
+	// Skips cleaning & active edges: cooks fastest, for meshes already welded by MeshOptimizer, at some cost per step
+	CookingProfile fastCook = bvh34;
+	fastCook.name = "fast-cook";
+	fastCook.trianglesPerLeaf = 15;
+	fastCook.cleanMesh = false;
+	fastCook.activeEdges = false;
+	Add(fastCook);
+
+	// Small hulls without gauss maps, for convexes that are hit rarely
+	CookingProfile convexLean = CookingProfile::defaults("convex-lean");
+	convexLean.convexVertexLimit = 64;
+	convexLean.gaussMapLimit = 255;
+	Add(convexLean);
+
+	// Gauss maps on every hull, for convexes in constant contact (eg. flippers)
+	CookingProfile convexGauss = CookingProfile::defaults("convex-gauss");
+	convexGauss.gaussMapLimit = 4;
+	Add(convexGauss);
+}
+
+CookingProfiles& CookingProfiles::Global()
+{
+	static CookingProfiles profiles;
+	return profiles;
+}
+
+CookingProfiles::Entry* CookingProfiles::find(const std::string& name)
+{
+	for (size_t i = 0; i < mEntries.size(); i++)
+	{
+		if (mEntries[i]->profile.name == name)
+		{
+			return mEntries[i].get();
+		}
+	}
+	return nullptr;
+}
+
+bool CookingProfiles::Add(const CookingProfile& profile)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Entry* entry = find(profile.name);
+	if (entry != nullptr)
+	{
+		// Meshes may already have been cooked with it
+		if (entry->cooking != nullptr)
+		{
+			return false;
+		}
+		entry->profile = profile;
+		return true;
+	}
+
+	std::unique_ptr<Entry> newEntry(new Entry());
+	newEntry->profile = profile;
+	newEntry->cooking = nullptr;
+	mEntries.push_back(std::move(newEntry));
+	return true;
+}
+
+std::vector<std::string> CookingProfiles::Names()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<std::string> names;
+	for (size_t i = 0; i < mEntries.size(); i++)
+	{
+		names.push_back(mEntries[i]->profile.name);
+	}
+	return names;
+}
+
+bool CookingProfiles::Get(const std::string& name, CookingProfile& profile)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Entry* entry = find(name);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+	profile = entry->profile;
+	return true;
+}
+
+bool CookingProfiles::AssignType(int meshType, const std::string& profile)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (find(profile) == nullptr)
+	{
+		return false;
+	}
+
+	Rule rule = { "", meshType, profile };
+	mRules.push_back(rule);
+	return true;
+}
+
+bool CookingProfiles::AssignName(const std::string& namePart, const std::string& profile)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (namePart.empty() || find(profile) == nullptr)
+	{
+		return false;
+	}
+
+	// Ahead of the type rules, after the other name rules
+	size_t i = 0;
+	while (i < mRules.size() && !mRules[i].namePart.empty())
+	{
+		i++;
+	}
+	Rule rule = { namePart, -1, profile };
+	mRules.insert(mRules.begin() + i, rule);
+	return true;
+}
+
+bool CookingProfiles::AssignRule(const std::string& rule)
+{
+	size_t separator = rule.find('=');
+	if (separator == std::string::npos)
+	{
+		std::cerr << "Cooking profile rule " << rule << " isn't of the form <mesh name or type>=<profile>" << std::endl;
+		return false;
+	}
+
+	std::string target = rule.substr(0, separator), profile = rule.substr(separator + 1);
+	bool assigned = false;
+	bool isType = false;
+	for (int type = 0; type < (int)(sizeof(MeshTypeNames) / sizeof(MeshTypeNames[0])); type++)
+	{
+		if (target == MeshTypeNames[type])
+		{
+			assigned = AssignType(type, profile);
+			isType = true;
+		}
+	}
+	if (!isType)
+	{
+		assigned = AssignName(target, profile);
+	}
+
+	if (!assigned)
+	{
+		std::cerr << "Unknown cooking profile " << profile << std::endl;
+	}
+	return assigned;
+}
+
+void CookingProfiles::ClearRules()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mRules.clear();
+}
+
+physx::PxCooking* CookingProfiles::CookingFor(const std::string& meshName, int meshType, physx::PxCooking* fallback, const CookingProfile** profile)
+{
+	std::string match;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (size_t i = 0; i < mRules.size(); i++)
+		{
+			const Rule& rule = mRules[i];
+			if (rule.namePart.empty() ? rule.meshType == meshType : meshName.find(rule.namePart) != std::string::npos)
+			{
+				match = rule.profile;
+				break;
+			}
+		}
+	}
+
+	if (match.empty())
+	{
+		return fallback;
+	}
+
+	physx::PxCooking* cooking = Cooking(match);
+	if (profile != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		*profile = &find(match)->profile;
+	}
+	return cooking;
+}
+
+physx::PxCooking* CookingProfiles::Cooking(const std::string& profile)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Entry* entry = find(profile);
+	if (entry == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (entry->cooking == nullptr)
+	{
+		physx::PxCookingParams params = entry->profile.Params(PxGetPhysics().getTolerancesScale());
+		entry->cooking = PxCreateCooking(PX_PHYSICS_VERSION, PxGetPhysics().getFoundation(), params);
+	}
+	return entry->cooking;
+}
+
+void CookingProfiles::ReleaseAll()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (size_t i = 0; i < mEntries.size(); i++)
+	{
+		if (mEntries[i]->cooking != nullptr)
+		{
+			mEntries[i]->cooking->release();
+			mEntries[i]->cooking = nullptr;
+		}
+	}
+}
+
+void CookingProfiles::benchmark(const std::string& modelPath)
+{
+	CookingProfiles& profiles = Global();
+	std::vector<Mesh> meshes = Mesh::importFile(modelPath, Mesh::GetImportBackend(), nullptr, false);
+
+	// Balls are sized like the model's ball, if it has one
+	float ballRadius = 0.25f;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].GetMeshType() == Mesh::MeshType::Sphere)
+		{
+			ballRadius = meshes[i].GetBounds().sphereRadius;
+		}
+	}
+
+	// Where the balls are dropped from: a grid over the triangle meshes' bounds
+	physx::PxVec3 boundsMin(PX_MAX_F32), boundsMax(-PX_MAX_F32);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].GetMeshType() == Mesh::MeshType::TriangleList)
+		{
+			boundsMin = boundsMin.minimum(meshes[i].GetBounds().min);
+			boundsMax = boundsMax.maximum(meshes[i].GetBounds().max);
+		}
+	}
+
+	const int ballGrid = 8;
+	const int stepCount = 600;
+	const float stepSize = 1.0f / 60.0f;
+
+	std::vector<std::string> names = profiles.Names();
+	std::vector<std::string> results;
+	for (size_t p = 0; p < names.size(); p++)
+	{
+		CookingProfile profile;
+		profiles.Get(names[p], profile);
+		physx::PxCooking* cooking = profiles.Cooking(names[p]);
+
+		// Cook every mesh straight from its buffers, bypassing the cooking cache
+		double triangleCookMs = 0.0, convexCookMs = 0.0;
+		size_t triangleBytes = 0, convexBytes = 0;
+		std::vector<physx::PxTriangleMesh*> triangleMeshes;
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const Mesh& mesh = meshes[i];
+			Span<const Vertex> vertices = mesh.GetVertices();
+			Span<const unsigned int> indices = mesh.GetIndices();
+			physx::PxDefaultMemoryOutputStream out;
+
+			if (mesh.GetMeshType() == Mesh::MeshType::TriangleList)
+			{
+				physx::PxTriangleMeshDesc desc;
+				desc.points.count = (physx::PxU32)vertices.size();
+				desc.points.data = vertices.data();
+				desc.points.stride = sizeof(Vertex);
+				desc.triangles.count = (physx::PxU32)indices.size() / 3;
+				desc.triangles.data = indices.data();
+				desc.triangles.stride = sizeof(unsigned int) * 3;
+
+				Clock::time_point start = Clock::now();
+				if (!cooking->cookTriangleMesh(desc, out))
+				{
+					continue;
+				}
+				triangleCookMs += millisecondsSince(start);
+				triangleBytes += out.getSize();
+
+				physx::PxDefaultMemoryInputData in(out.getData(), out.getSize());
+				triangleMeshes.push_back(PxGetPhysics().createTriangleMesh(in));
+			}
+			else if (mesh.GetMeshType() == Mesh::MeshType::Convex)
+			{
+				physx::PxConvexMeshDesc desc;
+				desc.points.count = (physx::PxU32)vertices.size();
+				desc.points.data = vertices.data();
+				desc.points.stride = sizeof(Vertex);
+				desc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
+				desc.vertexLimit = profile.convexVertexLimit;
+
+				Clock::time_point start = Clock::now();
+				if (cooking->cookConvexMesh(desc, out))
+				{
+					convexCookMs += millisecondsSince(start);
+					convexBytes += out.getSize();
+				}
+			}
+		}
+
+		// Ball vs table: a grid of balls dropped onto the triangle meshes with the game's gravity.
+		// Broadphase & solving cost the same for every profile, so differences in step time are down to midphase & contact generation.
+		physx::PxDefaultCpuDispatcher* dispatcher = physx::PxDefaultCpuDispatcherCreate(1);
+		physx::PxSceneDesc sceneDesc = physx::PxSceneDesc(physx::PxTolerancesScale());
+		sceneDesc.gravity = physx::PxVec3(0.0f, -9.81f, 9.81f);
+		sceneDesc.filterShader = physx::PxDefaultSimulationFilterShader;
+		sceneDesc.cpuDispatcher = dispatcher;
+		physx::PxScene* scene = PxGetPhysics().createScene(sceneDesc);
+
+		physx::PxMaterial* tableMaterial = PxGetPhysics().createMaterial(0.2f, 0.4f, 0.3f);
+		physx::PxMaterial* ballMaterial = PxGetPhysics().createMaterial(0.0f, 0.0f, 0.9f);
+
+		physx::PxRigidStatic* table = PxGetPhysics().createRigidStatic(physx::PxTransform(physx::PxIdentity));
+		for (size_t i = 0; i < triangleMeshes.size(); i++)
+		{
+			physx::PxShape* shape = PxGetPhysics().createShape(physx::PxTriangleMeshGeometry(triangleMeshes[i]), *tableMaterial, true);
+			table->attachShape(*shape);
+			shape->release();
+		}
+		scene->addActor(*table);
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+		std::vector<physx::PxRigidDynamic*> balls;
+		for (int z = 0; z < ballGrid; z++)
+		{
+			for (int x = 0; x < ballGrid; x++)
+			{
+				physx::PxVec3 position(
+					boundsMin.x + (boundsMax.x - boundsMin.x) * (x + 0.5f) / ballGrid,
+					boundsMax.y + ballRadius * 2.0f,
+					boundsMin.z + (boundsMax.z - boundsMin.z) * (z + 0.5f) / ballGrid);
+				physx::PxRigidDynamic* ball = PxGetPhysics().createRigidDynamic(physx::PxTransform(position));
+				physx::PxShape* shape = PxGetPhysics().createShape(physx::PxSphereGeometry(ballRadius), *ballMaterial, true);
+				ball->attachShape(*shape);
+				shape->release();
+				physx::PxRigidBodyExt::updateMassAndInertia(*ball, 1.0f);
+				ball->setLinearVelocity(physx::PxVec3(jitter(rng), 0.0f, jitter(rng)) * 3.0f);
+				scene->addActor(*ball);
+				balls.push_back(ball);
+			}
+		}
+
+		double simulateMs = 0.0;
+		size_t contactPairs = 0;
+		for (int step = 0; step < stepCount; step++)
+		{
+			Clock::time_point start = Clock::now();
+			scene->simulate(stepSize);
+			scene->fetchResults(true);
+			simulateMs += millisecondsSince(start);
+
+			physx::PxSimulationStatistics stats;
+			scene->getSimulationStatistics(stats);
+			contactPairs += stats.nbDiscreteContactPairsWithContacts;
+		}
+
+		for (size_t i = 0; i < balls.size(); i++)
+		{
+			balls[i]->release();
+		}
+		table->release();
+		scene->release();
+		dispatcher->release();
+		for (size_t i = 0; i < triangleMeshes.size(); i++)
+		{
+			triangleMeshes[i]->release();
+		}
+		tableMaterial->release();
+		ballMaterial->release();
+
+		std::ostringstream result;
+		result << std::fixed << std::setprecision(3) << "  " << std::left << std::setw(14) << names[p] << std::right
+			<< " triangle: " << std::setw(9) << triangleCookMs << " ms " << std::setw(9) << triangleBytes << " bytes"
+			<< "  convex: " << std::setw(9) << convexCookMs << " ms " << std::setw(9) << convexBytes << " bytes"
+			<< "  step: " << simulateMs / stepCount << " ms (" << (double)contactPairs / stepCount << " contact pairs)";
+		results.push_back(result.str());
+	}
+
+	// Printed last, as importing logs every mesh
+	std::cout << "Cooking profiles for " << modelPath << " (" << ballGrid * ballGrid << " balls, " << stepCount << " steps):" << std::endl;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		std::cout << results[i] << std::endl;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <PxPhysicsAPI.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace Pinball
+{
+	// A named set of PhysX cooking options, trading cooking time & cooked size against simulation cost
+	struct CookingProfile
+	{
+		std::string name;
+
+		// Triangle meshes: midphase structure & its main tuning knob
+		physx::PxMeshMidPhase::Enum midphase;
+		// BVH34: triangles per leaf (4 to 15, fewer is faster to query & bigger)
+		physx::PxU32 trianglesPerLeaf;
+		// BVH33: 0 favours size, 1 favours query speed
+		physx::PxReal meshSizePerformanceTradeOff;
+
+		// Triangle meshes: remove degenerate & duplicate triangles (only safe to skip for meshes known to be clean)
+		bool cleanMesh;
+		// Triangle meshes: weld vertices closer than weldTolerance while cleaning
+		bool weldVertices;
+		physx::PxReal weldTolerance;
+		// Triangle meshes: precompute active edges, so contacts against internal edges are filtered at cooking time rather than every step
+		bool activeEdges;
+
+		// Convex meshes: hull vertex limit (at most 255)
+		physx::PxU16 convexVertexLimit;
+		// Convex meshes: hulls with more vertices than this get a gauss map, which speeds up contact generation but takes more memory
+		physx::PxU32 gaussMapLimit;
+
+		// PhysX's defaults
+		static CookingProfile defaults(const std::string& name);
+		// Cooking parameters for this profile
+		physx::PxCookingParams Params(const physx::PxTolerancesScale& scale) const;
+	};
+
+	// Registry of cooking profiles and the rules choosing one for each mesh, by mesh name or by Mesh::MeshType.
+	// Each profile gets its own PxCooking (created on first use), so meshes with different profiles can be cooked concurrently.
+	// Meshes no rule matches are cooked with the PxCooking they were given, as before. Thread-safe.
+	class CookingProfiles
+	{
+	private:
+		struct Entry
+		{
+			CookingProfile profile;
+			physx::PxCooking* cooking;
+		};
+
+		struct Rule
+		{
+			// Matched against the mesh name (substring) if not empty, otherwise against the type
+			std::string namePart;
+			int meshType;
+			std::string profile;
+		};
+
+		std::mutex mMutex;
+		// Entries are never removed, so their addresses stay valid
+		std::vector<std::unique_ptr<Entry>> mEntries;
+		// Name rules first, in the order they were added, then type rules
+		std::vector<Rule> mRules;
+
+		Entry* find(const std::string& name);
+	public:
+		// Registers the built-in profiles: default, bvh34, bvh34-welded, fast-cook, convex-lean & convex-gauss
+		CookingProfiles();
+		CookingProfiles(const CookingProfiles&) = delete;
+		CookingProfiles& operator=(const CookingProfiles&) = delete;
+
+		// Profiles & rules used by the game
+		static CookingProfiles& Global();
+
+		// Adds a profile, or replaces the one with the same name. False if that one has already cooked meshes.
+		bool Add(const CookingProfile& profile);
+		// Names of all profiles, in the order they were added
+		std::vector<std::string> Names();
+		// False if there's no profile with that name
+		bool Get(const std::string& name, CookingProfile& profile);
+
+		// Cooks meshes of the given Mesh::MeshType with a profile. False if there's no such profile.
+		bool AssignType(int meshType, const std::string& profile);
+		// Cooks meshes whose name contains namePart with a profile, ahead of any type rule. False if there's no such profile.
+		bool AssignName(const std::string& namePart, const std::string& profile);
+		// Parses "<mesh name part or type>=<profile>" (eg. "TriangleList=bvh34" or "Table=fast-cook"), as given to --cooking-profile
+		bool AssignRule(const std::string& rule);
+		void ClearRules();
+
+		// The profile & PxCooking for a mesh. Returns fallback (and profile stays unset) if no rule matches.
+		physx::PxCooking* CookingFor(const std::string& meshName, int meshType, physx::PxCooking* fallback, const CookingProfile** profile = nullptr);
+		// The PxCooking of a profile, created on first use. nullptr if there's no such profile.
+		physx::PxCooking* Cooking(const std::string& profile);
+		// Releases the profiles' PxCookings, which are created again on next use. Call before the PxFoundation is released,
+		// while nothing is cooking with them.
+		void ReleaseAll();
+
+		// Cooks the triangle & convex meshes of a model with every profile and reports cook time & cooked size,
+		// then rolls balls over its triangle meshes with each profile to report the simulation cost per step
+		static void benchmark(const std::string& modelPath);
+	};
+}
@@ -1,49 +1,108 @@
 #include "GameObject.h"
 #include "Middleware.h"
 #include <glm/glm.hpp>
+#include <iostream>
 
 using namespace Pinball;
 
 GameObject::GameObject()
 {
 	mActor = nullptr;
+	mActorType = Type::Dynamic;
 	mName = "";
+	mLodLevel = 0;
+	Color(0.0f, 0.0f, 0.0f);
 }
 
-GameObject::GameObject(Mesh& geometry, GameObject::Type type, float sf, float df, float cor, std::string name, GameObject::ColliderType colliderType)
+GameObject::GameObject(MeshAsset geometry, GameObject::Type type, float sf, float df, float cor, std::string name, GameObject::ColliderType colliderType)
 {
 	mActor = nullptr;
+	mActorType = type;
 	mName = name;
+	mLodLevel = 0;
+	Color(0.0f, 0.0f, 0.0f);
 
-	Geometry(geometry, type, sf, df, cor, colliderType);
+	Geometry(std::move(geometry), type, sf, df, cor, colliderType);
 }
 
-Mesh GameObject::Geometry()
+const Mesh& GameObject::Geometry()
+{
+	return *mMesh;
+}
+
+MeshAsset GameObject::GeometryAsset()
 {
 	return mMesh;
 }
 
-void GameObject::Geometry(Mesh& mesh, GameObject::Type type, float sf, float df, float cor, GameObject::ColliderType colliderType)
+void GameObject::Geometry(MeshAsset mesh, GameObject::Type type, float sf, float df, float cor, GameObject::ColliderType colliderType)
 {
-	mMesh = Mesh(mesh);
+	mMesh = std::move(mesh);
+	const Mesh& collisionMesh = mCollisionProxy ? *mCollisionProxy : *mMesh;
 
+	// Apply this object's scale to its own copy of the PhysX geometry
+	mPxGeometry.storeAny(*collisionMesh.GetPxGeometry());
 	physx::PxMeshScale scale = physx::PxMeshScale(mObjScale.mScale);
 
-	switch (mMesh.GetPxGeometry()->getType())
+	switch (mPxGeometry.getType())
 	{
 	case physx::PxGeometryType::eCONVEXMESH:
-		((physx::PxConvexMeshGeometry*)mMesh.GetPxGeometry())->scale = scale;
+		mPxGeometry.convexMesh().scale = scale;
+		break;
 	case physx::PxGeometryType::eTRIANGLEMESH:
-		((physx::PxTriangleMeshGeometry*)mMesh.GetPxGeometry())->scale = scale;
+		mPxGeometry.triangleMesh().scale = scale;
+		break;
+	case physx::PxGeometryType::eHEIGHTFIELD:
+		// Heightfields have no mesh scale: scale their sample spacing & heights instead
+		mPxGeometry.heightField().rowScale *= mObjScale.mScale.x;
+		mPxGeometry.heightField().heightScale *= mObjScale.mScale.y;
+		mPxGeometry.heightField().columnScale *= mObjScale.mScale.z;
+		break;
 	}
 
-	mShapes = { PxGetPhysics().createShape(*mMesh.GetPxGeometry(), *PxGetPhysics().createMaterial(sf, df, cor), true) }; // TODO: won't this cause a memory leak on reinitialisation?
+	// Materials & shapes are shared with every other object made the same way (see PhysicsRegistry)
+	PhysicsRegistry& registry = PhysicsRegistry::Global();
+	mMaterial = registry.Material(sf, df, cor);
 
-	if (mMesh.GetMeshType() == Mesh::MeshType::Plane)
+	physx::PxTransform localPose(physx::PxIdentity);
+	if (mMesh->GetMeshType() == Mesh::MeshType::Plane)
+	{
+		localPose = physx::PxTransform(0.0f, 0.0f, 0.0f, physx::PxQuat(glm::radians(90.0f), physx::PxVec3(0.0f, 0.0f, 1.0f)));
+	}
+	else if (collisionMesh.GetMeshType() == Mesh::MeshType::HeightField)
+	{
+		// The heightfield's origin is the corner of the surface it was sampled from
+		localPose = collisionMesh.GetPxLocalPose();
+		localPose.p = localPose.p.multiply(mObjScale.mScale);
+	}
+
+	mShapes.clear();
+	const std::vector<physx::PxConvexMesh*>& hulls = collisionMesh.GetConvexHulls();
+	if (!hulls.empty())
+	{
+		// Compound of the mesh's convex decomposition, in place of its triangle mesh
+		for (size_t i = 0; i < hulls.size(); i++)
+		{
+			mShapes.push_back(registry.Shape(physx::PxConvexMeshGeometry(hulls[i], scale), mMaterial, localPose, mFilterData));
+		}
+	}
+	else
 	{
-		mShapes[0]->setLocalPose(physx::PxTransform(0.0f, 0.0f, 0.0f, physx::PxQuat(glm::radians(90.0f), physx::PxVec3(0.0f, 0.0f, 1.0f))));
+		mShapes.push_back(registry.Shape(mPxGeometry.any(), mMaterial, localPose, mFilterData));
+	}
+	// PhysX rejects invalid geometry (eg. a heightfield scaled down too far): the object is left without that shape rather than crashing
+	for (size_t i = 0; i < mShapes.size();)
+	{
+		if (mShapes[i])
+		{
+			i++;
+			continue;
+		}
+		std::cerr << "Failed to create a collision shape for " << mMesh->Name() << std::endl;
+		mShapes.erase(mShapes.begin() + i);
 	}
 
+	mActorType = type;
 	if (type == GameObject::Type::Static)
 	{
 		mActor = (physx::PxActor*)PxGetPhysics().createRigidStatic(physx::PxTransform(physx::PxIdentity));
@@ -66,11 +125,58 @@ void GameObject::Geometry(Mesh& mesh, GameObject::Type type, float sf, float df,
 	mActor->setName(mName.c_str());
 }
 
+void GameObject::CollisionProxy(MeshAsset proxy)
+{
+	mCollisionProxy = std::move(proxy);
+}
+
+MeshAsset GameObject::CollisionProxy()
+{
+	return mCollisionProxy;
+}
+
+size_t GameObject::CollisionTriangleCount()
+{
+	const Mesh& collisionMesh = mCollisionProxy ? *mCollisionProxy : *mMesh;
+	if (collisionMesh.GetMeshType() != Mesh::MeshType::TriangleList || !collisionMesh.GetConvexHulls().empty())
+	{
+		return 0;
+	}
+	return collisionMesh.GetIndexCount() / 3;
+}
+
+void GameObject::Color(float r, float g, float b)
+{
+	mColor[0] = r;
+	mColor[1] = g;
+	mColor[2] = b;
+}
+
+const float* GameObject::Color()
+{
+	return mColor;
+}
+
+unsigned int GameObject::LodLevel()
+{
+	return mLodLevel;
+}
+
+void GameObject::LodLevel(unsigned int level)
+{
+	mLodLevel = level;
+}
+
 physx::PxActor* GameObject::GetPxActor()
 {
 	return mActor;
 }
 
+GameObject::Type GameObject::ActorType()
+{
+	return (Type)mActorType;
+}
+
 physx::PxRigidActor* GameObject::GetPxRigidActor()
 {
 	return (physx::PxRigidActor*)mActor;
@@ -83,12 +189,12 @@ std::string GameObject::Name()
 
 void GameObject::Name(std::string name)
 {
-	mName = name;
+	mName = std::move(name);
 
-	const char* cName = new const char[name.length() + 1];
-	memcpy((void*)cName, name.c_str(), name.length() * sizeof(const char));
+	const char* cName = new const char[mName.length() + 1];
+	memcpy((void*)cName, mName.c_str(), mName.length() * sizeof(const char));
 	const char nullTerminator = '\0';
-	memcpy((void*)(cName + name.length()), &nullTerminator, sizeof(const char));
+	memcpy((void*)(cName + mName.length()), &nullTerminator, sizeof(const char));
 
 	mActor->setName(cName);
 }
@@ -109,20 +215,20 @@ void GameObject::SetupFiltering(unsigned int filterGroup, unsigned int filterMas
 	filterData.word0 = filterGroup; // the FilterGroup this object identifies with
 	filterData.word1 = filterMask; // the FilterGroup this object needs to collide with
 
-	physx::PxRigidActor* actor = GetPxRigidActor();
-	const physx::PxU32 numShapes = actor->getNbShapes();
-	physx::PxShape** shapes = new physx::PxShape * [numShapes];
-
-	actor->getShapes(shapes, numShapes);
+	mFilterData = filterData;
 
-	// Set this filter data for all shapes of this object
-	for (int i = 0; i < numShapes; i++)
+	// Shared shapes can't be changed, so each one is swapped for the shape with the same geometry & this filter data
+	physx::PxRigidActor* actor = GetPxRigidActor();
+	for (size_t i = 0; i < mShapes.size() && actor != nullptr; i++)
 	{
-		physx::PxShape* shape = shapes[i];
-		shape->setSimulationFilterData(filterData);
+		ShapeHandle shape = PhysicsRegistry::Global().Shape(mShapes[i]->getGeometry().any(), mMaterial, mShapes[i]->getLocalPose(), mFilterData);
+		if (shape && shape != mShapes[i])
+		{
+			actor->detachShape(*mShapes[i]);
+			actor->attachShape(*shape);
+			mShapes[i] = std::move(shape);
+		}
 	}
-
-	delete[] shapes;
 }
 
 ObjectScale& GameObject::Scale()
@@ -132,17 +238,14 @@ ObjectScale& GameObject::Scale()
 
 void GameObject::destroy()
 {
-	for (size_t i = 0; i < mShapes.size(); i++)
+	// Releasing the actor detaches its shapes. Shared shapes (and their material) are released with their last handle.
+	if (mActor != nullptr)
 	{
-		if (mShapes[i] != nullptr && mShapes[i]->isReleasable())
-		{
-			if (mShapes[i]->getActor() != NULL)
-			{
-				mShapes[i]->getActor()->release();
-			}
-			//mShapes[i]->release();
-		}
+		mActor->release();
+		mActor = nullptr;
 	}
+	mShapes.clear();
+	mMaterial.reset();
 }
 
 GameObject::~GameObject()
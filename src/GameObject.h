@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Mesh.h"
+#include "PhysicsRegistry.h"
 
 namespace Pinball
 {
@@ -39,10 +40,26 @@ namespace Pinball
 	class GameObject
 	{
 	private:
-		Mesh mMesh;
+		// Shared geometry. Per-instance data (colour, scale) is kept on the GameObject itself.
+		MeshAsset mMesh;
+		// Simplified geometry the object collides through instead of mMesh, if any
+		MeshAsset mCollisionProxy;
+
+		// Per-instance copy of the mesh's PhysX geometry, so the object's scale can be applied without touching the shared asset
+		physx::PxGeometryHolder mPxGeometry;
+
+		float mColor[3];
+
+		// Level of detail this object was last drawn with (see Renderer::selectLod)
+		unsigned int mLodLevel;
 
 		physx::PxActor* mActor;
-		std::vector<physx::PxShape*> mShapes;
+		// Shared with the other objects made the same way (see PhysicsRegistry)
+		MaterialHandle mMaterial;
+		std::vector<ShapeHandle> mShapes;
+		// Collision filtering the shapes are made with (see SetupFiltering)
+		physx::PxFilterData mFilterData;
+		int mActorType;
 
 		float mSf, mDf; // static & dynamic friction
 		float mCOR; // coefficient of restitution
@@ -57,16 +74,35 @@ namespace Pinball
 		enum ColliderType { Trigger = 0, Collider, ColliderTrigger };
 
 		GameObject();
-		GameObject(Mesh& geometry, Type actorType = Type::Dynamic, float staticFriction = 0.f, float kineticFriction = 0.f, float restitution = 0.f, std::string name = "", ColliderType colliderType = ColliderType::Collider);
-		Mesh Geometry();
-		void Geometry(Mesh& mesh, Type actorType = Type::Dynamic, float staticFriction = 0.f, float kineticFriction = 0.f, float restitution = 0.f, ColliderType colliderType = ColliderType::Collider);
+		GameObject(MeshAsset geometry, Type actorType = Type::Dynamic, float staticFriction = 0.f, float kineticFriction = 0.f, float restitution = 0.f, std::string name = "", ColliderType colliderType = ColliderType::Collider);
+		// Returns the shared mesh (no copy is made). Only valid once geometry has been assigned.
+		const Mesh& Geometry();
+		MeshAsset GeometryAsset();
+		void Geometry(MeshAsset mesh, Type actorType = Type::Dynamic, float staticFriction = 0.f, float kineticFriction = 0.f, float restitution = 0.f, ColliderType colliderType = ColliderType::Collider);
+		// Optional collision proxy: a (cooked) mesh the object's shapes are made from instead of its render mesh, which is still drawn in full detail.
+		// Should be set before Geometry(), nullptr for none.
+		void CollisionProxy(MeshAsset proxy);
+		MeshAsset CollisionProxy();
+		// Triangles the object's shapes collide against (0 for primitive, convex & heightfield shapes)
+		size_t CollisionTriangleCount();
+
+		// Per-instance colour
+		void Color(float r, float g, float b);
+		const float* Color();
+
+		// Per-instance level of detail, kept between frames so LOD switches can use hysteresis
+		unsigned int LodLevel();
+		void LodLevel(unsigned int level);
 		physx::PxActor* GetPxActor();
+		// Static or Dynamic, as passed to Geometry()
+		Type ActorType();
 		physx::PxRigidActor* GetPxRigidActor();
 		std::string Name();
 		void Name(std::string name);
 		physx::PxTransform Transform();
 		void Transform(physx::PxTransform transform);
 
+		// Can be called before Geometry(), so the shapes are made with this filtering straight away
 		void SetupFiltering(unsigned int filterGroup, unsigned int filterMask);
 
 		ObjectScale& Scale();
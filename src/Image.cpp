@@ -1,6 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "Renderer.h"
+#include "ResourcePack.h"
 
 using namespace Pinball;
 
@@ -22,14 +23,59 @@ Image::Image(std::string filePath)
 	Load(filePath);
 }
 
+Image::~Image()
+{
+	if (mData != nullptr)
+	{
+		stbi_image_free(mData);
+	}
+}
+
 void Image::Load(std::string filePath)
 {
-	mData = stbi_load(filePath.c_str(), &mWidth, &mHeight, &mSpectrum, 4);
+	// Pixels are always RGBA8
+	mSpectrum = 4;
+
+	mCache = TextureCache::open(filePath);
+	if (mCache)
+	{
+		mWidth = mCache->Width();
+		mHeight = mCache->Height();
+		return;
+	}
+
+	// Decoded straight from the mapped pack if it has the file
+	Span<const unsigned char> packed = ResourcePack::find(filePath);
+	if (!packed.empty())
+	{
+		int channels;
+		mData = stbi_load_from_memory(packed.data(), (int)packed.size(), &mWidth, &mHeight, &channels, 4);
+		return;
+	}
+
+	int channels;
+	mData = stbi_load(filePath.c_str(), &mWidth, &mHeight, &channels, 4);
+	if (mData == nullptr)
+	{
+		std::cerr << "Failed to load image " << filePath << std::endl;
+		return;
+	}
+
+	// Later launches map the decoded pixels & mip chain instead
+	if (TextureCache::write(filePath, mData, mWidth, mHeight))
+	{
+		mCache = TextureCache::open(filePath);
+		if (mCache)
+		{
+			stbi_image_free(mData);
+			mData = nullptr;
+		}
+	}
 }
 
-unsigned char* Image::GetData() 
+const unsigned char* Image::GetData() 
 {
-	return mData;
+	return mCache ? mCache->Pixels().data() : mData;
 }
 
 unsigned int& Image::GetTexture()
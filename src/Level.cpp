@@ -1,43 +1,119 @@
 #include "Level.h"
 #include "Util.h"
+#include "AssetRegistry.h"
+#include "TaskPool.h"
+#include "CookingCache.h"
+#include "PlacementTable.h"
+#include <random>
+#include <cstring>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <thread>
 
 using namespace Pinball;
 
-// Initialise pointers
+namespace
+{
+	// Physics material & collision filtering for the named object, as baked into its placement
+	void placementRules(const std::string& meshName, PlacementTable::Material& material, PlacementTable::Placement& placement)
+	{
+		// physic material properties
+		material.staticFriction = material.dynamicFriction = material.restitution = 0.0f;
+
+		// Set different properties for different types of objects
+		if (strContains("Ball", meshName))
+		{
+			material.restitution = 0.9f;
+		}
+		else if (strContains("Table", meshName))
+		{
+			material.restitution = 0.3f;
+			material.dynamicFriction = 0.4f;
+			material.staticFriction = 0.2f;
+		}
+		else if (strContains(meshName, "Bumper"))
+		{
+			material.restitution = 1.0f;
+		}
+
+		// Set collision filtering flags
+		placement.filterGroup = placement.filterMask = 0;
+		if (strContains("Ball", meshName))
+		{
+			placement.filterGroup = FilterGroup::eBALL;
+			placement.filterMask = FilterGroup::eFLIPPER | FilterGroup::eFLOOR | FilterGroup::eTABLE | FilterGroup::eBUMPER;
+		}
+		else if (strContains("Table", meshName) || strContains("Ramp", meshName) || strContains(meshName, "Hinge"))
+		{
+			placement.filterGroup = FilterGroup::eTABLE;
+			placement.filterMask = FilterGroup::eBALL;
+		}
+		else if (strContains("Floor", meshName))
+		{
+			placement.filterGroup = FilterGroup::eFLOOR;
+			placement.filterMask = FilterGroup::eBALL;
+		}
+		else if (strContains(meshName, "Bumper"))
+		{
+			placement.filterGroup = FilterGroup::eBUMPER;
+			placement.filterMask = FilterGroup::eBALL;
+		}
+		else if (strContains(meshName, "Flipper"))
+		{
+			placement.filterGroup = FilterGroup::eFLIPPER;
+			placement.filterMask = FilterGroup::eBALL;
+		}
+
+		// The floor is flat, so it can collide through a heightfield. The table as a whole can't, as its walls would be lost.
+		placement.flags = 0;
+		if (strContains("Floor", meshName))
+		{
+			placement.flags |= PlacementTable::Placement::HeightField;
+		}
+	}
+
+	void setColor(Level::ObjectSetup& setup, float r, float g, float b)
+	{
+		setup.color[0] = r;
+		setup.color[1] = g;
+		setup.color[2] = b;
+	}
+
+	// Contacts (including CCD) between everything, for benchmarkCollisionProxies' scenes
+	physx::PxFilterFlags ccdFilterShader(physx::PxFilterObjectAttributes attribs0, physx::PxFilterData filterData0,
+		physx::PxFilterObjectAttributes attribs1, physx::PxFilterData filterData1,
+		physx::PxPairFlags& pairFlags, const void* constantBlock, physx::PxU32 constantBlockSz)
+	{
+		pairFlags = physx::PxPairFlag::eCONTACT_DEFAULT | physx::PxPairFlag::eDETECT_CCD_CONTACT;
+		return physx::PxFilterFlag::eDEFAULT;
+	}
+}
+
+std::atomic<int> Level::sCollisionMode(Level::TriangleMeshCollision);
+std::atomic<float> Level::sCollisionProxyError(0.0f);
+std::atomic<float> Level::sHeightFieldCellSize(0.0f);
+
+// Create the objects (only called from constructors, so nothing is allocated yet)
 void Level::init()
 {
-	if (!mFlipperL)
-		mFlipperL = new GameObject();
-	if (!mFlipperR)
-		mFlipperR = new GameObject();
-	if (!mHingeL)
-		mHingeL = new GameObject();
-	if (!mHingeR)
-		mHingeR = new GameObject();
-
-	if (!mRamp)
-		mRamp = new GameObject();
-	if (!mTable)
-		mTable = new GameObject();
-	if (!mBall)
-		mBall = new GameObject();
-	if (!mFloor)
-		mFloor = new GameObject();
-
-	if (!mBumper1)
-		mBumper1 = new GameObject();
-	if (!mBumper2)
-		mBumper2 = new GameObject();
-	if (!mBumper3)
-		mBumper3 = new GameObject();
-	if (!mBumperL)
-		mBumperL = new GameObject();
-	if (!mBumperR)
-		mBumperR = new GameObject();
-	if (!mBumperBL)
-		mBumperBL = new GameObject();
-	if (!mBumperBR)
-		mBumperBR = new GameObject();
+	mFlipperL = new GameObject();
+	mFlipperR = new GameObject();
+	mHingeL = new GameObject();
+	mHingeR = new GameObject();
+
+	mRamp = new GameObject();
+	mTable = new GameObject();
+	mBall = new GameObject();
+	mFloor = new GameObject();
+
+	mBumper1 = new GameObject();
+	mBumper2 = new GameObject();
+	mBumper3 = new GameObject();
+	mBumperL = new GameObject();
+	mBumperR = new GameObject();
+	mBumperBL = new GameObject();
+	mBumperBR = new GameObject();
 
 	mScenePtr = nullptr;
 }
@@ -217,6 +293,11 @@ physx::PxActor* const Level::ActorAt(size_t i)
 	}
 }
 
+const StaticBatch& Level::StaticGeometry()
+{
+	return mStaticBatch;
+}
+
 Particle* const Level::ParticleAt(size_t index)
 {
 	size_t i = 0;
@@ -327,6 +408,11 @@ void Level::SetScene(physx::PxScene* scenePtr)
 	mScenePtr = scenePtr;
 }
 
+void Level::AddJoint(physx::PxJoint* joint)
+{
+	mJoints.push_back(joint);
+}
+
 Level::Level()
 {
 	init();
@@ -338,31 +424,468 @@ Level::Level(std::string meshFilePath, std::string originFilePath, physx::PxCook
 	Load(meshFilePath, originFilePath, cooking);
 }
 
-void Level::Load(std::string meshFilePath, std::string originFilePath, physx::PxCooking* cooking)
+bool Level::bakePlacements(const std::string& originFilePath)
+{
+	// Only the origin meshes' centres are used, so they don't need cooking
+	std::vector<Mesh> origins = Mesh::importFile(originFilePath, Mesh::GetImportBackend(), nullptr, false);
+	if (origins.empty())
+	{
+		std::cerr << "No origins found in " << originFilePath << ", can't bake placements" << std::endl;
+		return false;
+	}
+
+	std::vector<PlacementTable::Material> materials;
+	std::vector<PlacementTable::Placement> placements;
+	for (size_t i = 0; i < origins.size(); i++)
+	{
+		std::string name = origins[i].Name();
+		physx::PxVec3 center = origins[i].GetCenterPoint();
+
+		PlacementTable::Placement placement = {};
+		placement.nameHash = hashBytes(name.data(), name.size());
+		placement.position[0] = center.x;
+		placement.position[1] = center.y;
+		placement.position[2] = center.z;
+		// OBJ exports are already transformed, so there's no rotation or scale to carry over
+		placement.rotation[3] = 1.0f;
+		placement.scale[0] = placement.scale[1] = placement.scale[2] = 1.0f;
+
+		PlacementTable::Material material;
+		placementRules(name, material, placement);
+
+		// Objects share materials where they can
+		placement.material = (uint32_t)materials.size();
+		for (size_t j = 0; j < materials.size(); j++)
+		{
+			if (memcmp(&materials[j], &material, sizeof(PlacementTable::Material)) == 0)
+			{
+				placement.material = (uint32_t)j;
+				break;
+			}
+		}
+		if (placement.material == materials.size())
+		{
+			materials.push_back(material);
+		}
+
+		placements.push_back(placement);
+	}
+
+	return PlacementTable::write(originFilePath, materials, placements);
+}
+
+void Level::SetCollisionMode(Level::CollisionMode mode)
 {
-	// Meshes for each object
-	std::vector<Mesh> meshes = Mesh::fromFile(meshFilePath, cooking);
+	sCollisionMode = mode;
+}
 
-	// Origin points for each object
-	std::vector<Mesh> originPoints = Mesh::fromFile(originFilePath, nullptr, false);
-	std::map<std::string, Mesh> origins;
-	for (size_t i = 0; i < originPoints.size(); i++)
+Level::CollisionMode Level::GetCollisionMode()
+{
+	return (CollisionMode)sCollisionMode.load();
+}
+
+void Level::SetCollisionProxyError(float maxError)
+{
+	sCollisionProxyError = maxError;
+}
+
+float Level::GetCollisionProxyError()
+{
+	return sCollisionProxyError.load();
+}
+
+void Level::SetHeightFieldCellSize(float cellSize)
+{
+	sHeightFieldCellSize = cellSize;
+}
+
+float Level::GetHeightFieldCellSize()
+{
+	return sHeightFieldCellSize.load();
+}
+
+void Level::buildObjects(std::vector<Level::ObjectSetup>& setups, unsigned int threadCount)
+{
+	// PhysX object creation is thread-safe, and each task only touches its own GameObject
+	TaskPool::parallelFor(setups.size(), threadCount, [&](size_t i)
 	{
-		origins[originPoints[i].Name()] = originPoints[i];
+		const ObjectSetup& setup = setups[i];
+		GameObject* object = setup.object;
+
+		// The scale is baked into the actor's geometry
+		if (setup.scale != physx::PxVec3(1.0f))
+		{
+			object->Scale().X(setup.scale.x);
+			object->Scale().Y(setup.scale.y);
+			object->Scale().Z(setup.scale.z);
+		}
+		object->CollisionProxy(setup.collisionProxy);
+		// Filtering goes first, so the shapes are made with it
+		if (setup.filterGroup != 0)
+		{
+			object->SetupFiltering(setup.filterGroup, setup.filterMask);
+		}
+		object->Geometry(setup.mesh, setup.type, setup.sf, setup.df, setup.cor);
+		object->Color(setup.color[0], setup.color[1], setup.color[2]);
+
+		if (setup.type == GameObject::Dynamic)
+		{
+			((physx::PxRigidDynamic*)object->GetPxActor())->setRigidBodyFlag(physx::PxRigidBodyFlag::eENABLE_CCD, true);
+		}
+		object->Name(setup.name);
+		object->Transform(physx::PxTransform(setup.position, setup.rotation));
+	});
+}
+
+void Level::benchmarkLoad(physx::PxCooking* cooking, size_t pieceCount)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	// Synthetic table: a third of the pieces are convex (jittered spheres, like bumpers & flippers),
+	// the rest are triangle mesh patches (like the table, ramps & walls)
+	std::vector<Mesh> pieces;
+	pieces.reserve(pieceCount);
+	for (size_t i = 0; i < pieceCount; i++)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		if (i % 3 == 0)
+		{
+			const int stacks = 8, slices = 12;
+			for (int stack = 0; stack <= stacks; stack++)
+			{
+				float theta = physx::PxPi * stack / stacks;
+				for (int slice = 0; slice <= slices; slice++)
+				{
+					float phi = 2.0f * physx::PxPi * slice / slices;
+					float radius = 0.5f + 0.1f * dist(rng);
+					physx::PxVec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+					physx::PxVec3 position = normal * radius;
+					vertices.emplace_back(position.x, position.y, position.z, normal.x, normal.y, normal.z);
+				}
+			}
+			for (int stack = 0; stack < stacks; stack++)
+			{
+				for (int slice = 0; slice < slices; slice++)
+				{
+					unsigned int a = stack * (slices + 1) + slice, b = a + slices + 1;
+					indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+				}
+			}
+			pieces.emplace_back(std::move(vertices), nullptr, std::move(indices), Mesh::MeshType::Convex, false);
+		}
+		else
+		{
+			const int gridSize = 24;
+			for (int z = 0; z <= gridSize; z++)
+			{
+				for (int x = 0; x <= gridSize; x++)
+				{
+					vertices.emplace_back(x * 0.1f, 0.05f * dist(rng), z * 0.1f, 0.0f, 1.0f, 0.0f);
+				}
+			}
+			for (int z = 0; z < gridSize; z++)
+			{
+				for (int x = 0; x < gridSize; x++)
+				{
+					unsigned int a = z * (gridSize + 1) + x, b = a + gridSize + 1;
+					indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+				}
+			}
+			pieces.emplace_back(std::move(vertices), nullptr, std::move(indices), Mesh::MeshType::TriangleList, false);
+		}
 	}
 
+	// Actors are added to a scene in one batch, as the game does
+	physx::PxDefaultCpuDispatcher* dispatcher = physx::PxDefaultCpuDispatcherCreate(1);
+	physx::PxSceneDesc sceneDesc = physx::PxSceneDesc(physx::PxTolerancesScale());
+	sceneDesc.filterShader = physx::PxDefaultSimulationFilterShader;
+	sceneDesc.cpuDispatcher = dispatcher;
+	physx::PxScene* scene = PxGetPhysics().createScene(sceneDesc);
+
+	// Every run cooks from scratch
+	CookingCache::Global().SetEnabled(false);
+
+	typedef std::chrono::high_resolution_clock Clock;
+	std::vector<std::string> results;
+	double baseMs = 0.0;
+	for (unsigned int threadCount = 1; threadCount <= 16; threadCount *= 2)
+	{
+		// Fresh copies, as cooking sets each mesh's PhysX geometry
+		std::vector<Mesh> meshes(pieces);
+		std::vector<GameObject> objects(pieceCount);
+
+		auto start = Clock::now();
+		TaskPool::parallelFor(meshes.size(), threadCount, [&](size_t i) { meshes[i].UpdatePx(cooking); });
+		auto cooked = Clock::now();
+
+		std::vector<ObjectSetup> setups(pieceCount);
+		for (size_t i = 0; i < pieceCount; i++)
+		{
+			ObjectSetup& setup = setups[i];
+			setup.object = &objects[i];
+			setup.mesh = Mesh::makeAsset(std::move(meshes[i]));
+			setup.type = GameObject::Static;
+			setup.name = "Piece";
+			setup.sf = setup.df = 0.0f;
+			setup.cor = 0.5f;
+			setup.filterGroup = FilterGroup::eTABLE;
+			setup.filterMask = FilterGroup::eBALL;
+			setColor(setup, 0.5f, 0.5f, 0.5f);
+			setup.position = physx::PxVec3((float)(i % 25), 0.0f, (float)(i / 25));
+			setup.rotation = physx::PxQuat(physx::PxIdentity);
+			setup.scale = physx::PxVec3(1.0f);
+		}
+		buildObjects(setups, threadCount);
+
+		std::vector<physx::PxActor*> actors(pieceCount);
+		for (size_t i = 0; i < pieceCount; i++)
+		{
+			actors[i] = objects[i].GetPxActor();
+		}
+		scene->addActors(actors.data(), (physx::PxU32)actors.size());
+		auto end = Clock::now();
+
+		double cookMs = std::chrono::duration<double, std::milli>(cooked - start).count();
+		double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+		if (threadCount == 1)
+		{
+			baseMs = totalMs;
+		}
+
+		std::ostringstream result;
+		result << "  " << threadCount << " threads: " << totalMs << " ms (cooking " << cookMs << " ms, actors " << totalMs - cookMs << " ms), " << baseMs / totalMs << "x";
+		results.push_back(result.str());
+
+		// Releasing the objects' actors also removes them from the scene
+	}
+
+	CookingCache::Global().SetEnabled(true);
+	scene->release();
+	dispatcher->release();
+
+	// Printed last, as cooking logs every mesh
+	std::cout << "Level load benchmark, " << pieceCount << " pieces (" << std::thread::hardware_concurrency() << " hardware threads):" << std::endl;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		std::cout << results[i] << std::endl;
+	}
+}
+
+void Level::benchmarkCollisionProxies(physx::PxCooking* cooking, const std::string& meshFilePath, const std::string& originFilePath, float maxError)
+{
+	std::vector<Mesh> meshes = Mesh::fromFile(meshFilePath, cooking, false);
+	std::shared_ptr<const PlacementTable> placements = PlacementTable::open(originFilePath);
+
+	// Each triangle-list mesh in full detail & as its proxy, both cooked
+	struct Piece
+	{
+		std::string name;
+		MeshAsset mesh, proxy;
+	};
+	std::vector<Piece> pieces;
+	float ballRadius = 0.25f;
+	std::string suffix = Mesh::CollisionProxySuffix;
 	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		std::string name = meshes[i].Name();
+		if (meshes[i].GetMeshType() == Mesh::MeshType::Sphere)
+		{
+			ballRadius = meshes[i].GetBounds().sphereRadius;
+		}
+		if (meshes[i].GetMeshType() != Mesh::MeshType::TriangleList || strContains(name, suffix))
+		{
+			continue;
+		}
+
+		// The authored proxy if there is one
+		size_t authored = meshes.size();
+		for (size_t j = 0; j < meshes.size(); j++)
+		{
+			if (meshes[j].Name() == name + suffix)
+			{
+				authored = j;
+			}
+		}
+		Mesh proxy = authored < meshes.size() ? meshes[authored] : meshes[i].SimplifiedProxy(maxError);
+		proxy.UpdatePx(cooking);
+		meshes[i].UpdatePx(cooking);
+
+		Piece piece = { name, Mesh::makeAsset(std::move(meshes[i])), Mesh::makeAsset(std::move(proxy)) };
+		pieces.push_back(piece);
+	}
+
+	const int ballGrid = 8;
+	const int stepCount = 600;
+	const float stepSize = 1.0f / 60.0f;
+
+	// Average step time with the pieces flagged in useProxy colliding through their proxies.
+	// The balls start the same way every run, so runs only differ by collision geometry.
+	auto run = [&](const std::vector<bool>& useProxy, std::vector<size_t>& collisionTriangles)
+	{
+		physx::PxDefaultCpuDispatcher* dispatcher = physx::PxDefaultCpuDispatcherCreate(1);
+		physx::PxSceneDesc sceneDesc = physx::PxSceneDesc(physx::PxTolerancesScale());
+		sceneDesc.gravity = physx::PxVec3(0.0f, -9.81f, 9.81f);
+		sceneDesc.filterShader = ccdFilterShader;
+		sceneDesc.cpuDispatcher = dispatcher;
+		sceneDesc.flags = physx::PxSceneFlag::eENABLE_CCD;
+		physx::PxScene* scene = PxGetPhysics().createScene(sceneDesc);
+
+		std::vector<GameObject> objects(pieces.size());
+		std::vector<ObjectSetup> setups(pieces.size());
+		for (size_t i = 0; i < pieces.size(); i++)
+		{
+			ObjectSetup& setup = setups[i];
+			setup.object = &objects[i];
+			setup.mesh = pieces[i].mesh;
+			setup.collisionProxy = useProxy[i] ? pieces[i].proxy : nullptr;
+			setup.type = GameObject::Static;
+			setup.name = pieces[i].name;
+			setup.sf = setup.df = setup.cor = 0.0f;
+			setup.filterGroup = setup.filterMask = 0;
+			setColor(setup, 0.5f, 0.5f, 0.5f);
+			setup.position = physx::PxVec3(0.0f);
+			setup.rotation = physx::PxQuat(physx::PxIdentity);
+			setup.scale = physx::PxVec3(1.0f);
+
+			const PlacementTable::Placement* placement = placements ? placements->Find(pieces[i].name) : nullptr;
+			if (placement)
+			{
+				const PlacementTable::Material& material = placements->Materials()[placement->material];
+				setup.sf = material.staticFriction;
+				setup.df = material.dynamicFriction;
+				setup.cor = material.restitution;
+				setup.position = physx::PxVec3(placement->position[0], placement->position[1], placement->position[2]);
+				setup.rotation = physx::PxQuat(placement->rotation[0], placement->rotation[1], placement->rotation[2], placement->rotation[3]);
+				setup.scale = physx::PxVec3(placement->scale[0], placement->scale[1], placement->scale[2]);
+			}
+		}
+		buildObjects(setups, 1);
+
+		physx::PxVec3 boundsMin(PX_MAX_F32), boundsMax(-PX_MAX_F32);
+		collisionTriangles.resize(pieces.size());
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			scene->addActor(*objects[i].GetPxActor());
+			physx::PxBounds3 bounds = objects[i].GetPxActor()->getWorldBounds();
+			boundsMin = boundsMin.minimum(bounds.minimum);
+			boundsMax = boundsMax.maximum(bounds.maximum);
+			collisionTriangles[i] = objects[i].CollisionTriangleCount();
+		}
+
+		physx::PxMaterial* ballMaterial = PxGetPhysics().createMaterial(0.0f, 0.0f, 0.9f);
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+		std::vector<physx::PxRigidDynamic*> balls;
+		for (int z = 0; z < ballGrid; z++)
+		{
+			for (int x = 0; x < ballGrid; x++)
+			{
+				physx::PxVec3 position(
+					boundsMin.x + (boundsMax.x - boundsMin.x) * (x + 0.5f) / ballGrid,
+					boundsMax.y + ballRadius * 2.0f,
+					boundsMin.z + (boundsMax.z - boundsMin.z) * (z + 0.5f) / ballGrid);
+				physx::PxRigidDynamic* ball = PxGetPhysics().createRigidDynamic(physx::PxTransform(position));
+				physx::PxShape* shape = PxGetPhysics().createShape(physx::PxSphereGeometry(ballRadius), *ballMaterial, true);
+				ball->attachShape(*shape);
+				shape->release();
+				physx::PxRigidBodyExt::updateMassAndInertia(*ball, 1.0f);
+				ball->setRigidBodyFlag(physx::PxRigidBodyFlag::eENABLE_CCD, true);
+				ball->setLinearVelocity(physx::PxVec3(jitter(rng), 0.0f, jitter(rng)) * 3.0f);
+				scene->addActor(*ball);
+				balls.push_back(ball);
+			}
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int step = 0; step < stepCount; step++)
+		{
+			scene->simulate(stepSize);
+			scene->fetchResults(true);
+		}
+		double stepMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / stepCount;
+
+		for (size_t i = 0; i < balls.size(); i++)
+		{
+			balls[i]->release();
+		}
+		ballMaterial->release();
+		// Releasing the objects' actors also removes them from the scene
+		objects.clear();
+		scene->release();
+		dispatcher->release();
+		return stepMs;
+	};
+
+	std::vector<size_t> fullTriangles, proxyTriangles, unused;
+	double baseMs = run(std::vector<bool>(pieces.size(), false), fullTriangles);
+	double allProxiesMs = run(std::vector<bool>(pieces.size(), true), proxyTriangles);
+
+	std::vector<std::string> results;
+	for (size_t i = 0; i < pieces.size(); i++)
+	{
+		std::vector<bool> useProxy(pieces.size(), false);
+		useProxy[i] = true;
+		double stepMs = run(useProxy, unused);
+
+		std::ostringstream result;
+		result << "  " << pieces[i].name << ": " << pieces[i].mesh->GetIndexCount() / 3 << " render triangles, collision triangles "
+			<< fullTriangles[i] << " -> " << proxyTriangles[i] << ", step " << baseMs << " -> " << stepMs << " ms (" << (stepMs - baseMs) / baseMs * 100.0 << "%)";
+		results.push_back(result.str());
+	}
+
+	// Printed last, as cooking logs every mesh
+	std::cout << "Collision proxies for " << meshFilePath << " (simplified to within " << maxError << ", " << ballGrid * ballGrid << " balls, " << stepCount << " steps):" << std::endl;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		std::cout << results[i] << std::endl;
+	}
+	std::cout << "  All proxies: step " << baseMs << " -> " << allProxiesMs << " ms (" << (allProxiesMs - baseMs) / baseMs * 100.0 << "%)" << std::endl;
+}
+
+void Level::Load(std::string meshFilePath, std::string originFilePath, physx::PxCooking* cooking)
+{
+	// Where each object goes & how it collides, baked from the origins model the first time
+	std::shared_ptr<const PlacementTable> placements = PlacementTable::open(originFilePath);
+	if (!placements && bakePlacements(originFilePath))
+	{
+		placements = PlacementTable::open(originFilePath);
+	}
+	if (!placements)
+	{
+		std::cerr << "Couldn't load placements for " << originFilePath << ", objects will be placed at the origin" << std::endl;
+	}
+
+	// Meshes for each object.
+	// Level meshes are drawn from 12-byte vertices (snorm16 positions, octahedral normals), with simplified versions for when they're far away.
+	// Flat surfaces tagged in the placement table collide through heightfields sampled from their mesh, if enabled.
+	AssetRegistry::ModelOptions meshOptions = { Mesh::VertexFormat::Snorm16Oct, Mesh::MaxLodCount, true, 0, GetCollisionMode() == ConvexHullCollision, GetCollisionProxyError(), GetHeightFieldCellSize() };
+	for (size_t i = 0; placements && meshOptions.heightFieldCellSize > 0.0f && i < placements->Placements().size(); i++)
+	{
+		if (placements->Placements()[i].flags & PlacementTable::Placement::HeightField)
+		{
+			meshOptions.heightFieldMeshes.push_back(placements->Placements()[i].nameHash);
+		}
+	}
+	ModelAsset meshes = AssetRegistry::Global().GetModel(meshFilePath, cooking, meshOptions);
+
+	// What each object gets built from, gathered first so the objects can be built in parallel
+	std::vector<ObjectSetup> setups;
+	setups.reserve(meshes->meshes.size());
+
+	for (size_t i = 0; i < meshes->meshes.size(); i++)
 	{
 		GameObject::Type objType = GameObject::Static;
 		GameObject* objToAssign = nullptr;
-		std::string meshName = meshes[i].Name();
+		std::string meshName = meshes->meshes[i]->Name();
 		if (strContains("BallFlipperLFlipperR", meshName))
 		{
 			objType = GameObject::Dynamic;
 			if (strContains(meshName, "Ball"))
 			{
+				// Mesh::fromFile already builds the ball as a sphere
 				objToAssign = mBall;
-				meshes[i].SetVertices(meshes[i].GetDataVector(), cooking, meshes[i].GetIndexVector(), Mesh::MeshType::Sphere);
 			}
 			else if (strContains(meshName, "FlipperL"))
 			{
@@ -428,88 +951,108 @@ void Level::Load(std::string meshFilePath, std::string originFilePath, physx::Px
 
 		if (strContains("Ball FlipperL FlipperR HingeL HingeR Table Floor Ramp Bumper1 Bumper2 Bumper3 BumperL BumperR BumperBL BumperBR", meshName))
 		{
-			// physic material properties
-			float sf = 0.0f, df = 0.0f, cor = 0.0f;
-			
-			// Set different properties for different types of objects
-			if(strContains("Ball", meshName))
-			{
-				cor = 0.9f;
-			}
-			else if (strContains("Table", meshName))
-			{
-				cor = 0.3f;
-				df = 0.4f;
-				sf = 0.2f;
-			}
-			else if (strContains(meshName, "Bumper"))
-			{
-				cor = 1.0f;
-			}
-
-			objToAssign->Geometry(meshes[i], objType, sf, df, cor);
+			ObjectSetup setup;
+			setup.object = objToAssign;
+			setup.mesh = meshes->meshes[i];
+			setup.collisionProxy = meshes->collisionProxies[i];
+			setup.type = objType;
+			setup.name = meshName;
 
-			// Set collision filtering flags
-			if (strContains("Ball", meshName))
-			{
-				objToAssign->SetupFiltering(FilterGroup::eBALL, FilterGroup::eFLIPPER | FilterGroup::eFLOOR | FilterGroup::eTABLE | FilterGroup::eBUMPER);
-			}
-			else if (strContains("Table", meshName) || strContains("Ramp", meshName) || strContains(meshName, "Hinge"))
-			{
-				objToAssign->SetupFiltering(FilterGroup::eTABLE, FilterGroup::eBALL);
-			}
-			else if (strContains("Floor", meshName))
-			{
-				objToAssign->SetupFiltering(FilterGroup::eFLOOR, FilterGroup::eBALL);
-			}
-			else if (strContains(meshName, "Bumper"))
+			// Physics material, collision filtering & transform
+			const PlacementTable::Placement* placement = placements ? placements->Find(meshName) : nullptr;
+			if (placement)
 			{
-				objToAssign->SetupFiltering(FilterGroup::eBUMPER, FilterGroup::eBALL);
+				const PlacementTable::Material& material = placements->Materials()[placement->material];
+				setup.sf = material.staticFriction;
+				setup.df = material.dynamicFriction;
+				setup.cor = material.restitution;
+				setup.filterGroup = placement->filterGroup;
+				setup.filterMask = placement->filterMask;
+				setup.position = physx::PxVec3(placement->position[0], placement->position[1], placement->position[2]);
+				setup.rotation = physx::PxQuat(placement->rotation[0], placement->rotation[1], placement->rotation[2], placement->rotation[3]);
+				setup.scale = physx::PxVec3(placement->scale[0], placement->scale[1], placement->scale[2]);
+
 			}
-			else if (strContains(meshName, "Flipper"))
+			else
 			{
-				objToAssign->SetupFiltering(FilterGroup::eFLIPPER, FilterGroup::eBALL);
+				setup.sf = setup.df = setup.cor = 0.0f;
+				setup.filterGroup = setup.filterMask = 0;
+				setup.position = physx::PxVec3(0.0f);
+				setup.rotation = physx::PxQuat(physx::PxIdentity);
+				setup.scale = physx::PxVec3(1.0f);
 			}
 
 			// Set colours
 			if (strContains(meshName, "Ball"))
 			{
-				objToAssign->Geometry().Color(1.f, 1.f, 1.f);
+				setColor(setup, 1.f, 1.f, 1.f);
 			}
 			else if (strContains(meshName, "Table") || strContains(meshName, "Ramp") || strContains(meshName, "Floor"))
 			{
-				objToAssign->Geometry().Color(193.f / 255.f, 154.f / 255.f, 107.f / 255.f);
+				setColor(setup, 193.f / 255.f, 154.f / 255.f, 107.f / 255.f);
 			}
 			else if (strContains(meshName, "BumperB") || strContains(meshName, "Hinge"))
 			{
-				objToAssign->Geometry().Color(193.f / 255.f * 0.75f, 154.f / 255.f * 0.75f, 107.f / 255.f * 0.75f);
+				setColor(setup, 193.f / 255.f * 0.75f, 154.f / 255.f * 0.75f, 107.f / 255.f * 0.75f);
 			}
 			else if (strContains(meshName, "BumperL") || strContains(meshName, "BumperR"))
 			{
-				objToAssign->Geometry().Color(0.75f, 0.f, 0.f);
+				setColor(setup, 0.75f, 0.f, 0.f);
 			}
 			else if (strContains(meshName, "Bumper"))
 			{
-				objToAssign->Geometry().Color(0.f, 0.33f, 0.66f);
+				setColor(setup, 0.f, 0.33f, 0.66f);
 			}
 			else
 			{
-				objToAssign->Geometry().Color(0.5f, 0.5f, 0.5f);
+				setColor(setup, 0.5f, 0.5f, 0.5f);
 			}
 
-			if (objType == GameObject::Dynamic)
-			{
-				((physx::PxRigidDynamic*)objToAssign->GetPxActor())->setRigidBodyFlag(physx::PxRigidBodyFlag::eENABLE_CCD, true);
-			}
-			objToAssign->Name(meshName);
-			objToAssign->Transform(physx::PxTransform(origins[meshName].GetCenterPoint(), physx::PxQuat(physx::PxIdentity)));
+			setups.push_back(setup);
+		}
+	}
+
+	// The objects are independent, so their actors are created in parallel
+	buildObjects(setups, 0);
 
+	for (size_t i = 0; i < setups.size(); i++)
+	{
+		std::cout << "Object " << setups[i].name << ": " << setups[i].mesh->GetIndexCount() / 3 << " render triangles, "
+			<< setups[i].object->CollisionTriangleCount() << " collision triangles" << (setups[i].collisionProxy ? " (proxy)" : "") << std::endl;
+	}
+
+	// Static objects never move, so their render geometry can be merged now that they're in place
+	std::vector<GameObject*> staticObjects;
+	for (size_t i = 0; i < NbActors(); i++)
+	{
+		if (At(i)->GetPxActor() != nullptr && At(i)->ActorType() == GameObject::Static)
+		{
+			staticObjects.push_back(At(i));
 		}
 	}
+	mStaticBatch.Build(staticObjects);
 }
 
 Level::~Level()
 {
+	// Joints go before the actors they connect
+	for (size_t i = 0; i < mJoints.size(); i++)
+	{
+		mJoints[i]->release();
+	}
+
+	for (size_t i = 0; i < mParticles.size(); i++)
+	{
+		delete mParticles[i];
+	}
+
+	delete mBumperBR;
+	delete mBumperBL;
+	delete mBumperR;
+	delete mBumperL;
+	delete mBumper3;
+	delete mBumper2;
+	delete mBumper1;
 	delete mFloor;
 	delete mBall;
 	delete mTable;
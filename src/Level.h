@@ -2,6 +2,8 @@
 
 #include "GameObject.h"
 #include "Particle.h"
+#include "StaticBatch.h"
+#include <atomic>
 
 namespace Pinball {
 	class Level {
@@ -38,9 +40,64 @@ namespace Pinball {
 		std::vector<Particle*> mParticles;
 
 		physx::PxScene* mScenePtr;
+
+		// Joints between this level's objects (eg. the flipper hinges), released with it
+		std::vector<physx::PxJoint*> mJoints;
+
+		// Render geometry of all static objects, merged (built at the end of Load)
+		StaticBatch mStaticBatch;
+
+		// Collision used by Load (see SetCollisionMode, SetCollisionProxyError & SetHeightFieldCellSize)
+		static std::atomic<int> sCollisionMode;
+		static std::atomic<float> sCollisionProxyError;
+		static std::atomic<float> sHeightFieldCellSize;
 		
 		void init();
 	public:
+		// How Load sets up one object
+		struct ObjectSetup
+		{
+			GameObject* object;
+			MeshAsset mesh;
+			// What the object collides through instead of mesh, or nullptr (see GameObject::CollisionProxy)
+			MeshAsset collisionProxy;
+			GameObject::Type type;
+			std::string name;
+			// Static & dynamic friction, restitution
+			float sf, df, cor;
+			// Collision filtering (see GameObject::SetupFiltering), skipped if filterGroup is 0
+			unsigned int filterGroup, filterMask;
+			float color[3];
+			physx::PxVec3 position;
+			physx::PxQuat rotation;
+			physx::PxVec3 scale;
+		};
+
+		// Creates each object's actor & shapes and applies its setup, on up to threadCount threads (one per hardware thread if 0).
+		// The actors aren't added to a scene, so they can be added in one batch afterwards.
+		static void buildObjects(std::vector<ObjectSetup>& setups, unsigned int threadCount);
+
+		// How the level's triangle-list meshes (table, ramp, floor, bumpers & hinges) collide with the ball
+		enum CollisionMode { TriangleMeshCollision = 0, ConvexHullCollision };
+		// Collision of the levels loaded from now on (TriangleMeshCollision by default).
+		// ConvexHullCollision uses the model's convex decomposition (see ConvexDecomposition), baking it on the first load.
+		static void SetCollisionMode(CollisionMode mode);
+		static CollisionMode GetCollisionMode();
+		// Error bound (in mesh units) of the collision proxies generated for the triangle-list meshes of the levels loaded from now on,
+		// 0 (the default) to only use authored proxies (see AssetRegistry::ModelOptions::collisionProxyError)
+		static void SetCollisionProxyError(float maxError);
+		static float GetCollisionProxyError();
+		// Sample spacing (in mesh units) of the heightfields the flat surfaces tagged in the placement table (see PlacementTable::Placement::HeightField)
+		// collide through in the levels loaded from now on, in place of their triangle meshes. 0 (the default) to not use heightfields.
+		static void SetHeightFieldCellSize(float cellSize);
+		static float GetHeightFieldCellSize();
+
+		// Times cooking & actor creation for a synthetic table of pieceCount pieces with 1 to 16 threads, with the cooking cache disabled
+		static void benchmarkLoad(physx::PxCooking* cooking, size_t pieceCount = 500);
+		// Drops balls onto a level's triangle-list meshes, first all in full detail, then with each one's collision proxy (authored,
+		// or simplified to within maxError) in turn, and reports each object's render & collision triangle counts and step time change
+		static void benchmarkCollisionProxies(physx::PxCooking* cooking, const std::string& meshFilePath, const std::string& originFilePath, float maxError);
+
 		GameObject* const FlipperL();
 		GameObject* const FlipperR();
 		GameObject* const HingeL();
@@ -69,6 +126,9 @@ namespace Pinball {
 		// Returns actor at specified index
 		physx::PxActor* const ActorAt(size_t index);
 
+		// Merged render geometry of the level's static objects (table, floor, ramp, hinges & bumpers)
+		const StaticBatch& StaticGeometry();
+
 		// Returns particle at specified index (keep in mind killed particles will be skipped)
 		Particle* const ParticleAt(size_t index);
 
@@ -83,9 +143,15 @@ namespace Pinball {
 
 		void SetScene(physx::PxScene* scenePtr);
 
+		// Hands a joint between this level's objects over to the level, to be released with it
+		void AddJoint(physx::PxJoint* joint);
+
 		Level();
 		Level(std::string meshFilePath, std::string originFilePath, physx::PxCooking* cooking);
 		void Load(std::string meshFilePath, std::string originFilePath, physx::PxCooking* cooking);
+		// Imports the origins model and bakes each object's placement, physics material & collision filtering into its PlacementTable.
+		// Load bakes the table itself if it's missing or out of date, so this is only needed ahead of packing.
+		static bool bakePlacements(const std::string& originFilePath);
 
 		~Level();
 	};
@@ -0,0 +1,140 @@
+#include "LevelLoader.h"
+#include "AssetRegistry.h"
+#include "PhysicsRegistry.h"
+#include <iostream>
+#include <chrono>
+
+using namespace Pinball;
+
+namespace
+{
+	void releaseScene(physx::PxScene* scene)
+	{
+		// Each scene gets its own dispatcher (see the SceneFactory), which outlives it
+		physx::PxDefaultCpuDispatcher* dispatcher = (physx::PxDefaultCpuDispatcher*)scene->getCpuDispatcher();
+		scene->release();
+		if (dispatcher != nullptr)
+		{
+			dispatcher->release();
+		}
+	}
+}
+
+LevelLoader::LevelLoader(Renderer& renderer, physx::PxCooking* cooking, LevelLoader::SceneFactory createScene, LevelLoader::LevelSetup setup)
+	: mRenderer(renderer), mThread(1)
+{
+	mCooking = cooking;
+	mCreateScene = createScene;
+	mSetup = setup;
+
+	mLoading = mReady = false;
+	mLevel = nullptr;
+	mScene = nullptr;
+	mLoadMs = 0.0;
+
+	mContext = mRenderer.CreateSharedContext();
+	GLFWwindow* context = mContext;
+	mThread.Run("Make loader context current", [context]() { glfwMakeContextCurrent(context); });
+}
+
+LevelLoader::~LevelLoader()
+{
+	// A context can't be destroyed while it's current on another thread
+	mThread.Run("Release loader context", []() { glfwMakeContextCurrent(nullptr); });
+	mThread.WaitIdle();
+
+	// Its preloaded buffers belong to the shared context, so they're freed with the renderer's
+	if (mReady)
+	{
+		delete mLevel;
+		releaseScene(mScene);
+	}
+
+	glfwDestroyWindow(mContext);
+}
+
+bool LevelLoader::Load(const std::string& meshFilePath, const std::string& originFilePath)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mLoading)
+		{
+			return false;
+		}
+		mLoading = true;
+	}
+
+	// Read here, as it can change between frames
+	int forcedFormat = mRenderer.ForcedVertexFormat();
+
+	mThread.Run("Load " + meshFilePath, [this, meshFilePath, originFilePath, forcedFormat]()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		Level* level = new Level(meshFilePath, originFilePath, mCooking);
+		physx::PxScene* scene = mCreateScene();
+		level->SetScene(scene);
+		scene->addActors(level->AllActors(), (physx::PxU32)level->NbActors());
+		mSetup(*level, *scene);
+
+		Renderer::PreloadedLevel preloaded = mRenderer.PreloadLevel(*level, forcedFormat);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLevel = level;
+		mScene = scene;
+		mPreloaded = preloaded;
+		mLoadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		mReady = true;
+	});
+	return true;
+}
+
+bool LevelLoader::Loading()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLoading;
+}
+
+bool LevelLoader::Poll(Level*& level, physx::PxScene*& scene)
+{
+	if (mReleased.valid() && mReleased.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		mReleased.get();
+		// The released level's models can be evicted now, which frees their meshes & then their GPU buffers
+		AssetRegistry::Global().Trim();
+		mRenderer.ReleaseUnusedMeshes();
+
+		// Should come back to the same counts each time the same table is swapped in, however many swaps there have been
+		PhysicsRegistry::LiveCounts counts = PhysicsRegistry::liveCounts();
+		std::cout << "Released level, PhysX objects left: " << counts.shapes << " shapes, " << counts.materials << " materials, " << counts.convexMeshes << " convex meshes, "
+			<< counts.triangleMeshes << " triangle meshes, " << counts.heightFields << " heightfields" << std::endl;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!mReady)
+	{
+		return false;
+	}
+
+	mRenderer.AdoptLevel(mPreloaded);
+	level = mLevel;
+	scene = mScene;
+	std::cout << "Loaded level in the background in " << mLoadMs << " ms (" << mPreloaded.uploadedBytes << " bytes uploaded)" << std::endl;
+
+	mLevel = nullptr;
+	mScene = nullptr;
+	mReady = mLoading = false;
+	return true;
+}
+
+void LevelLoader::Release(Level* level, physx::PxScene* scene)
+{
+	// Its batch's buffers are keyed by address, so they go now, before another batch can take its place
+	mRenderer.ReleaseBatch(level->StaticGeometry());
+
+	mReleased = mThread.Run("Release level", [level, scene]()
+	{
+		delete level;
+		releaseScene(scene);
+	});
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Level.h"
+#include "Renderer.h"
+#include "TaskPool.h"
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+
+namespace Pinball
+{
+	// Loads a Level into its own staging PxScene on a background thread while the current one keeps running, so tables can be swapped without a restart.
+	// The loader thread imports, cooks & creates the level's actors, then uploads its meshes through a context shared with the renderer's.
+	// Once it's ready, Poll hands it over between frames; all that's left for the main thread is creating vertex arrays.
+	// Swapped out levels are released on the loader thread too.
+	class LevelLoader
+	{
+	public:
+		// Creates an empty scene set up like the game's (gravity, filter shader, simulation callback)
+		typedef std::function<physx::PxScene*()> SceneFactory;
+		// Finishes setting up a loaded level in its scene (eg. flipper joints), on the loader thread
+		typedef std::function<void(Level&, physx::PxScene&)> LevelSetup;
+	private:
+		Renderer& mRenderer;
+		physx::PxCooking* mCooking;
+		SceneFactory mCreateScene;
+		LevelSetup mSetup;
+
+		// Hidden window sharing the renderer's context, current on the loader thread
+		GLFWwindow* mContext;
+
+		// Loaded level waiting for Poll
+		std::mutex mMutex;
+		bool mLoading, mReady;
+		Level* mLevel;
+		physx::PxScene* mScene;
+		Renderer::PreloadedLevel mPreloaded;
+		double mLoadMs;
+
+		// Pending release of a swapped out level, after which its meshes' GPU buffers can be freed
+		std::future<void> mReleased;
+
+		// One worker: the shared context stays current on it, and releases are queued behind loads
+		TaskPool mThread;
+	public:
+		// Main thread only, as it creates the shared context
+		LevelLoader(Renderer& renderer, physx::PxCooking* cooking, SceneFactory createScene, LevelSetup setup);
+		// Waits for the load or release in progress, and releases a loaded level that was never picked up
+		~LevelLoader();
+		LevelLoader(const LevelLoader&) = delete;
+		LevelLoader& operator=(const LevelLoader&) = delete;
+
+		// Starts loading a level in the background. False if a load is already in progress.
+		bool Load(const std::string& meshFilePath, const std::string& originFilePath);
+		// True from Load until the level is picked up by Poll
+		bool Loading();
+
+		// Main thread, between frames: if the level has finished loading, makes its buffers drawable and hands it & its scene over.
+		// Also evicts the assets a finished Release left unreferenced if they're over the AssetRegistry budget, and frees their GPU buffers.
+		// Then logs the PhysX objects left alive, to check swaps don't leak.
+		bool Poll(Level*& level, physx::PxScene*& scene);
+
+		// Releases a swapped out level & its scene on the loader thread. The level mustn't be used after this.
+		void Release(Level* level, physx::PxScene* scene);
+	};
+}
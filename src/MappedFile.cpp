@@ -0,0 +1,111 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace Pinball;
+
+MappedFile::MappedFile()
+{
+	mData = nullptr;
+	mSize = 0;
+	mFile = nullptr;
+	mMapping = nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (mData != nullptr)
+	{
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping != nullptr)
+	{
+		CloseHandle(mMapping);
+	}
+	if (mFile != nullptr)
+	{
+		CloseHandle(mFile);
+	}
+#else
+	if (mData != nullptr)
+	{
+		munmap((void*)mData, mSize);
+	}
+#endif
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+	std::unique_ptr<MappedFile> ret(new MappedFile());
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+	ret->mFile = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		return nullptr;
+	}
+	ret->mSize = (size_t)size.QuadPart;
+
+	ret->mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (ret->mMapping == nullptr)
+	{
+		return nullptr;
+	}
+	ret->mData = (const unsigned char*)MapViewOfFile(ret->mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (ret->mData == nullptr)
+	{
+		return nullptr;
+	}
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return nullptr;
+	}
+
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size > 0)
+	{
+		ret->mSize = (size_t)info.st_size;
+		data = mmap(nullptr, ret->mSize, PROT_READ, MAP_PRIVATE, file, 0);
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(file);
+
+	if (data == MAP_FAILED)
+	{
+		return nullptr;
+	}
+	ret->mData = (const unsigned char*)data;
+#endif
+
+	return ret;
+}
+
+const unsigned char* MappedFile::Data() const
+{
+	return mData;
+}
+
+size_t MappedFile::Size() const
+{
+	return mSize;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace Pinball
+{
+	// Read-only memory mapping of a whole file (mmap, or MapViewOfFile on Windows). Unmapped when destroyed.
+	class MappedFile
+	{
+	private:
+		const unsigned char* mData;
+		size_t mSize;
+		// Platform file & mapping handles (Windows only)
+		void* mFile;
+		void* mMapping;
+
+		MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+	public:
+		~MappedFile();
+
+		// Maps the file at path. Returns nullptr if it doesn't exist, is empty or can't be mapped.
+		static std::unique_ptr<MappedFile> open(const std::string& path);
+
+		const unsigned char* Data() const;
+		size_t Size() const;
+	};
+}
@@ -1,49 +1,130 @@
 #include "Mesh.h"
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cctype>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "Util.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
+#include "CookingCache.h"
+#include "CookingProfiles.h"
+#include "ObjImporter.h"
+#include "ResourcePack.h"
+#include <chrono>
 
 using namespace Pinball;
 
+std::atomic<size_t> Mesh::sCopiedBytes(0);
+std::atomic<int> Mesh::sImportBackend(Mesh::AssimpImport);
+const char* const Mesh::CollisionProxySuffix = "Collision";
+
 Mesh::Mesh()
 {
 	mPxGeometry = nullptr;
-	mColor = new float[3]{ 0.0f, 0.0f, 0.0f };
+	mPxLocalPose = physx::PxTransform(physx::PxIdentity);
+	mCacheStats = mSourceCacheStats = { 0.0f, 0.0f };
 	mPrimitiveHx = physx::PxVec3(0.0f);
+	mType = MeshType::Convex;
+	mVertexFormat = VertexFormat::Float;
+	mBounds = Bounds::compute(nullptr, 0);
 	mName = "";
 }
 
-Mesh::Mesh(std::vector<Vertex> vertices, physx::PxCooking* cooking, std::vector<unsigned int> indices, Mesh::MeshType meshType, bool updatePx)
+Mesh::Mesh(std::vector<Vertex>&& vertices, physx::PxCooking* cooking, std::vector<unsigned int>&& indices, Mesh::MeshType meshType, bool updatePx)
 {
-	mColor = new float[3]{ 0.0f, 0.0f, 0.0f };
+	mPxGeometry = nullptr;
+	mPxLocalPose = physx::PxTransform(physx::PxIdentity);
+	mCacheStats = mSourceCacheStats = { 0.0f, 0.0f };
 	mPrimitiveHx = physx::PxVec3(0.0f);
+	mVertexFormat = VertexFormat::Float;
 	mName = "";
-	SetVertices(vertices, cooking, indices, meshType, updatePx);
+	SetVertices(std::move(vertices), cooking, std::move(indices), meshType, updatePx);
+}
+
+Mesh::Mesh(const Mesh& other) : mVertices(other.mVertices), mIndices(other.mIndices), mLodIndices(other.mLodIndices), mLods(other.mLods), mPxGeometry(other.mPxGeometry), mConvexHulls(other.mConvexHulls), mPxLocalPose(other.mPxLocalPose),
+	mVertexView(other.mVertexView), mIndexView(other.mIndexView), mStorage(other.mStorage),
+	mPrimitiveHx(other.mPrimitiveHx), mType(other.mType), mVertexFormat(other.mVertexFormat), mName(other.mName), mCacheStats(other.mCacheStats), mSourceCacheStats(other.mSourceCacheStats), mBounds(other.mBounds)
+{
+	// Static data is shared, own buffers are viewed through the copies
+	if (!other.isStatic())
+	{
+		mVertexView = mVertices;
+		mIndexView = mIndices;
+	}
+	sCopiedBytes += byteSize();
+}
+
+Mesh& Mesh::operator=(const Mesh& other)
+{
+	if (this != &other)
+	{
+		mVertices = other.mVertices;
+		mIndices = other.mIndices;
+		mLodIndices = other.mLodIndices;
+		mLods = other.mLods;
+		mPxGeometry = other.mPxGeometry;
+		mConvexHulls = other.mConvexHulls;
+		mPxLocalPose = other.mPxLocalPose;
+		mPrimitiveHx = other.mPrimitiveHx;
+		mType = other.mType;
+		mVertexFormat = other.mVertexFormat;
+		mName = other.mName;
+		mCacheStats = other.mCacheStats;
+		mSourceCacheStats = other.mSourceCacheStats;
+		mBounds = other.mBounds;
+
+		mVertexView = other.mVertexView;
+		mIndexView = other.mIndexView;
+		mStorage = other.mStorage;
+		if (!other.isStatic())
+		{
+			mVertexView = mVertices;
+			mIndexView = mIndices;
+		}
+
+		sCopiedBytes += byteSize();
+	}
+	return *this;
 }
 
-void Mesh::Color(float r, float g, float b)
+// Size of the heap-allocated data owned by this mesh
+size_t Mesh::byteSize() const
 {
-	mColor[0] = r;
-	mColor[1] = g;
-	mColor[2] = b;
+	return mVertices.size() * sizeof(Vertex) + (mIndices.size() + mLodIndices.size()) * sizeof(unsigned int) + mLods.size() * sizeof(Lod) + mName.size();
 }
 
-float* Mesh::Color()
+bool Mesh::isStatic() const
 {
-	return mColor;
+	return mVertexView.data() != mVertices.data();
 }
 
-std::string Pinball::Mesh::Name()
+size_t Mesh::CopiedBytes()
+{
+	return sCopiedBytes;
+}
+
+void Mesh::ResetCopiedBytes()
+{
+	sCopiedBytes = 0;
+}
+
+MeshAsset Mesh::makeAsset(Mesh&& mesh)
+{
+	return std::make_shared<const Mesh>(std::move(mesh));
+}
+
+std::string Pinball::Mesh::Name() const
 {
 	return mName;
 }
 
 void Pinball::Mesh::Name(std::string name)
 {
-	mName = name;
+	mName = std::move(name);
 }
 
 // Sphere generation code, reused from RendererCapsuleShape.cpp in PhysX samples
@@ -52,18 +133,22 @@ Mesh Mesh::createSphere(physx::PxCooking* cooking, float radius, size_t stacks,
 	Mesh ret;
 	ret.mPrimitiveHx = physx::PxVec3(radius);
 
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
 	const float thetaStep = physx::PxPi / stacks;
 	const float phiStep = physx::PxTwoPi / (slices * 2);
 
-	float theta = 0.0f;
-
 	// generate vertices
 	for (size_t y = 0; y <= stacks; ++y)
 	{
 		float phi = 0.0f;
 
+		float theta = y * thetaStep;
 		float cosTheta = physx::PxCos(theta);
 		float sinTheta = physx::PxSin(theta);
+		// The pole rows are written exactly, so dedup welds each into one vertex (sin(pi) isn't quite 0, and 0 * -x gives -0)
+		const bool pole = y == 0 || y == stacks;
 
 		for (size_t x = 0; x <= slices * 2; ++x)
 		{
@@ -71,14 +156,16 @@ Mesh Mesh::createSphere(physx::PxCooking* cooking, float radius, size_t stacks,
 			float sinPhi = physx::PxSin(phi);
 
 			physx::PxVec3 p(cosPhi * sinTheta * radius, cosTheta * radius, sinPhi * sinTheta * radius);
+			if (pole)
+			{
+				p = physx::PxVec3(0.0f, y == 0 ? radius : -radius, 0.0f);
+			}
 
 			// write vertex
-			ret.mVertices.push_back(Vertex(p.x, p.y, p.z));
+			vertices.push_back(Vertex(p.x, p.y, p.z));
 
 			phi += phiStep;
 		}
-
-		theta += thetaStep;
 	}
 
 	const int numRingQuads = 2 * slices;
@@ -90,17 +177,17 @@ Mesh Mesh::createSphere(physx::PxCooking* cooking, float radius, size_t stacks,
 		for (size_t i = 0; i < numRingQuads; ++i)
 		{
 			// add a quad
-			ret.mIndices.push_back((y + 0) * numRingVerts + i);
-			ret.mIndices.push_back((y + 1) * numRingVerts + i);
-			ret.mIndices.push_back((y + 1) * numRingVerts + i + 1);
+			indices.push_back((y + 0) * numRingVerts + i);
+			indices.push_back((y + 1) * numRingVerts + i);
+			indices.push_back((y + 1) * numRingVerts + i + 1);
 
-			ret.mIndices.push_back((y + 1) * numRingVerts + i + 1);
-			ret.mIndices.push_back((y + 0) * numRingVerts + i + 1);
-			ret.mIndices.push_back((y + 0) * numRingVerts + i);
+			indices.push_back((y + 1) * numRingVerts + i + 1);
+			indices.push_back((y + 0) * numRingVerts + i + 1);
+			indices.push_back((y + 0) * numRingVerts + i);
 		}
 	}
 
-	ret.mAllVerts = ret.reverseIndexing(ret.mVertices, ret.mIndices);
+	ret.buildIndexed(vertices, indices);
 	ret.mType = MeshType::Sphere;
 
 	ret.UpdatePx(cooking);
@@ -184,27 +271,129 @@ Mesh Mesh::createPlane(physx::PxCooking* cooking)
 }
 
 std::vector<Mesh> Mesh::fromFile(std::string filePath, physx::PxCooking* cooking, bool updatePx)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Warm start: use the cached buffers in place
+	std::shared_ptr<const MeshCache> cache = MeshCache::open(filePath);
+	if (cache)
+	{
+		std::vector<Mesh> ret = fromCache(cache, cooking, updatePx);
+		std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+		std::cout << "Mapped " << ret.size() << " meshes from " << MeshCache::pathFor(filePath) << " (" << cache->Size() << " bytes) in " << time.count() << " ms" << std::endl;
+		return ret;
+	}
+
+	std::vector<Mesh> ret = importFile(filePath, GetImportBackend(), cooking, updatePx);
+	if (ret.empty())
+	{
+		return ret;
+	}
+
+	std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+	std::cout << "Imported " << ret.size() << " meshes from " << filePath << " in " << time.count() << " ms" << std::endl;
+
+	// Cold start: cache the result for the next launch (packed models are cached when the pack is built)
+	if (!ResourcePack::find(filePath).empty())
+	{
+		return ret;
+	}
+	std::vector<MeshCache::Entry> entries(ret.size());
+	for (size_t i = 0; i < ret.size(); i++)
+	{
+		entries[i].name = ret[i].mName;
+		entries[i].type = ret[i].mType;
+		entries[i].vertices = ret[i].mVertexView;
+		entries[i].indices = ret[i].mIndexView;
+		entries[i].bounds = ret[i].mBounds;
+		entries[i].cacheStats = ret[i].mCacheStats;
+		entries[i].sourceCacheStats = ret[i].mSourceCacheStats;
+	}
+	MeshCache::write(filePath, entries);
+
+	return ret;
+}
+
+void Mesh::SetImportBackend(Mesh::ImportBackend backend)
+{
+	sImportBackend = backend;
+}
+
+Mesh::ImportBackend Mesh::GetImportBackend()
+{
+	return (ImportBackend)sImportBackend.load();
+}
+
+void Mesh::addImported(std::vector<Mesh>& meshes, std::vector<Vertex>&& vertices, std::vector<unsigned int>&& indices, std::string name, physx::PxCooking* cooking, bool updatePx)
+{
+	size_t importedCount = vertices.size();
+	name = name.substr(0, name.find_last_of("_"));
+
+	// The buffers are moved into the mesh, which welds & optimises them in place
+	meshes.emplace_back(std::move(vertices), cooking, std::move(indices), name == "Ball" ? MeshType::Sphere : strContains(name, "Flipper") ? MeshType::Convex : MeshType::TriangleList, updatePx);
+	meshes.back().Name(name);
+
+	const MeshOptimizer::CacheStats& before = meshes.back().GetCacheStats(false);
+	const MeshOptimizer::CacheStats& after = meshes.back().GetCacheStats();
+	std::cout << "Mesh " << name << ": " << importedCount << " -> " << meshes.back().GetCount() << " vertices, "
+		<< "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+std::vector<Mesh> Mesh::importFile(std::string filePath, Mesh::ImportBackend backend, physx::PxCooking* cooking, bool updatePx)
 {
 	std::vector<Mesh> ret;
 
+	// Files in a mounted pack are imported from the mapped pack
+	Span<const unsigned char> packed = ResourcePack::find(filePath);
+
+	std::string extension = filePath.substr(filePath.find_last_of(".") + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	if (backend == ObjImport && extension == "obj")
+	{
+		std::vector<ObjImporter::ImportedMesh> meshes;
+		if (!packed.empty())
+		{
+			ObjImporter::import(packed, meshes);
+		}
+		else if (!ObjImporter::import(filePath, meshes))
+		{
+			std::cout << "ERROR::OBJIMPORTER::Failed to read " << filePath << std::endl;
+			return ret;
+		}
+
+		ret.reserve(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			addImported(ret, std::move(meshes[i].vertices), std::move(meshes[i].indices), meshes[i].name, cooking, updatePx);
+		}
+		return ret;
+	}
+
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(filePath, aiProcess_Triangulate);
+	const aiScene* scene = !packed.empty() ? importer.ReadFileFromMemory(packed.data(), packed.size(), aiProcess_Triangulate, extension.c_str())
+		: importer.ReadFile(filePath, aiProcess_Triangulate);
 
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
 		std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+		return ret;
 	}
 
+	// Sized up front so meshes are moved into place rather than reallocated & moved again as the vector grows
+	ret.reserve(scene->mNumMeshes);
+
 	for (size_t i = 0; i < scene->mNumMeshes; i++)
 	{
 		aiMesh* mesh = scene->mMeshes[i];
 
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
+		vertices.reserve(mesh->mNumVertices);
+		indices.reserve(mesh->mNumFaces * 3);
 
 		for (size_t j = 0; j < mesh->mNumVertices; j++)
 		{
-			vertices.push_back(Vertex(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z, mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z));
+			vertices.emplace_back(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z, mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z);
 		}
 
 		for (size_t j = 0; j < mesh->mNumFaces; j++)
@@ -214,84 +403,397 @@ std::vector<Mesh> Mesh::fromFile(std::string filePath, physx::PxCooking* cooking
 			indices.push_back(mesh->mFaces[j].mIndices[2]);
 		}
 
-		std::string meshName = std::string(scene->mRootNode->mChildren[i]->mName.C_Str());
-		meshName = meshName.substr(0, meshName.find_last_of("_"));
-		ret.push_back(Mesh(vertices, cooking, indices, meshName == "Ball" ? MeshType::Sphere : strContains(meshName, "Flipper") ? MeshType::Convex : MeshType::TriangleList, updatePx));
-		ret[ret.size()-1].Name(meshName);
+		addImported(ret, std::move(vertices), std::move(indices), scene->mRootNode->mChildren[i]->mName.C_Str(), cooking, updatePx);
 	}
 
 	return ret;
 }
 
-size_t Mesh::GetCount()
+std::vector<Mesh> Mesh::fromCache(std::shared_ptr<const MeshCache> cache, physx::PxCooking* cooking, bool updatePx)
 {
-	return (IsIndexed()) ? mAllVerts.size() : mVertices.size();
+	const std::vector<MeshCache::Entry>& entries = cache->Entries();
+
+	std::vector<Mesh> ret(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const MeshCache::Entry& entry = entries[i];
+		Mesh& mesh = ret[i];
+
+		mesh.mVertexView = entry.vertices;
+		mesh.mIndexView = entry.indices;
+		mesh.mStorage = cache;
+		mesh.mName = entry.name;
+		mesh.mBounds = entry.bounds;
+		mesh.mCacheStats = entry.cacheStats;
+		mesh.mSourceCacheStats = entry.sourceCacheStats;
+
+		Lod lod = { 0, entry.indices.size(), 0.0f };
+		mesh.mLods.assign(1, lod);
+
+		mesh.finishBuild(cooking, (MeshType)entry.type, updatePx);
+	}
+
+	return ret;
 }
 
-int Mesh::GetMeshType()
+size_t Mesh::GetCount() const
+{
+	return mVertexView.size();
+}
+
+int Mesh::GetMeshType() const
 {
 	return mType;
 }
 
-physx::PxGeometry* Mesh::GetPxGeometry()
+int Mesh::GetVertexFormat() const
+{
+	return mVertexFormat;
+}
+
+void Mesh::SetVertexFormat(Mesh::VertexFormat format)
 {
-	return mPxGeometry;
+	mVertexFormat = format;
 }
 
-// Returns position data
-float* Mesh::GetData()
+const physx::PxGeometry* Mesh::GetPxGeometry() const
 {
-	size_t count = GetCount();
-	float* ret = new float[count * 3];
+	return mPxGeometry.get();
+}
 
-	for (size_t i = 0; i < count; i++)
+const physx::PxTransform& Mesh::GetPxLocalPose() const
+{
+	return mPxLocalPose;
+}
+
+void Mesh::SetConvexHulls(std::vector<physx::PxConvexMesh*> hulls)
+{
+	if (hulls.empty())
 	{
-		float* vert = (IsIndexed() ? mAllVerts[i].GetData() : mVertices[i].GetData());
-		memcpy(ret + i*3, vert, 3 * sizeof(float));
-		delete[] vert;
+		mConvexHulls.reset();
+		return;
 	}
 
-	return ret;
+	mConvexHulls = std::shared_ptr<const std::vector<physx::PxConvexMesh*>>(new std::vector<physx::PxConvexMesh*>(std::move(hulls)),
+		[](const std::vector<physx::PxConvexMesh*>* released)
+		{
+			for (size_t i = 0; i < released->size(); i++)
+			{
+				(*released)[i]->release();
+			}
+			delete released;
+		});
 }
 
-float* Mesh::GetRenderData()
+const std::vector<physx::PxConvexMesh*>& Mesh::GetConvexHulls() const
 {
-	size_t count = GetCount();
-	float* ret = new float[count * 6];
-	for (size_t i = 0; i < count; i++)
+	static const std::vector<physx::PxConvexMesh*> noHulls;
+	return mConvexHulls ? *mConvexHulls : noHulls;
+}
+
+std::shared_ptr<const physx::PxGeometry> Mesh::ownPx(physx::PxGeometry* geometry)
+{
+	return std::shared_ptr<const physx::PxGeometry>(geometry, [](physx::PxGeometry* released)
 	{
-		float* vert = (IsIndexed() ? mAllVerts[i].GetData() : mVertices[i].GetData());
-		memcpy(ret + i * 6, vert, 6 * sizeof(float));
-		delete[] vert;
+		// Deleted as what it was created as, PxGeometry has no virtual destructor
+		switch (released->getType())
+		{
+		case physx::PxGeometryType::eCONVEXMESH:
+		{
+			physx::PxConvexMeshGeometry* convex = static_cast<physx::PxConvexMeshGeometry*>(released);
+			if (convex->convexMesh != nullptr)
+			{
+				convex->convexMesh->release();
+			}
+			delete convex;
+			return;
+		}
+		case physx::PxGeometryType::eTRIANGLEMESH:
+		{
+			physx::PxTriangleMeshGeometry* triangles = static_cast<physx::PxTriangleMeshGeometry*>(released);
+			if (triangles->triangleMesh != nullptr)
+			{
+				triangles->triangleMesh->release();
+			}
+			delete triangles;
+			return;
+		}
+		case physx::PxGeometryType::eHEIGHTFIELD:
+		{
+			physx::PxHeightFieldGeometry* heightField = static_cast<physx::PxHeightFieldGeometry*>(released);
+			if (heightField->heightField != nullptr)
+			{
+				heightField->heightField->release();
+			}
+			delete heightField;
+			return;
+		}
+		case physx::PxGeometryType::eBOX:
+			delete static_cast<physx::PxBoxGeometry*>(released);
+			return;
+		case physx::PxGeometryType::ePLANE:
+			delete static_cast<physx::PxPlaneGeometry*>(released);
+			return;
+		case physx::PxGeometryType::eSPHERE:
+			delete static_cast<physx::PxSphereGeometry*>(released);
+			return;
+		default:
+			delete released;
+			return;
+		}
+	});
+}
+
+Mesh Mesh::SimplifiedProxy(float maxError) const
+{
+	// Binary search for the smallest target within maxError, as the error grows as the target shrinks
+	std::vector<unsigned int> indices(mIndexView.begin(), mIndexView.end());
+	size_t low = 1, high = mIndexView.size() / 3;
+	while (low < high)
+	{
+		size_t targetTriangles = (low + high) / 2;
+		std::vector<unsigned int> simplified;
+		float error = MeshOptimizer::simplify(mVertexView, mIndexView, simplified, targetTriangles * 3);
+		if (error <= maxError && !simplified.empty())
+		{
+			indices.swap(simplified);
+			high = targetTriangles;
+		}
+		else
+		{
+			low = targetTriangles + 1;
+		}
 	}
 
-	return ret;
+	// Only the vertices the simplified triangles still use
+	std::vector<unsigned int> remap(mVertexView.size(), UINT32_MAX);
+	std::vector<Vertex> vertices;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (remap[indices[i]] == UINT32_MAX)
+		{
+			remap[indices[i]] = (unsigned int)vertices.size();
+			vertices.push_back(mVertexView[indices[i]]);
+		}
+		indices[i] = remap[indices[i]];
+	}
+
+	Mesh proxy(std::move(vertices), nullptr, std::move(indices), MeshType::TriangleList, false);
+	proxy.Name(mName + CollisionProxySuffix);
+	return proxy;
+}
+
+bool Mesh::HeightFieldProxy(physx::PxCooking* cooking, float cellSize, Mesh& proxy, Mesh::HeightFieldStats& stats) const
+{
+	stats = HeightFieldStats();
+	const physx::PxVec3 low = mBounds.min, high = mBounds.max;
+	if (mType != MeshType::TriangleList || cellSize <= 0.0f || high.x <= low.x || high.z <= low.z)
+	{
+		return false;
+	}
+
+	// Rows run along X & columns along Z, spanning the bounds exactly
+	const physx::PxU32 maxSamples = 4096;
+	float rowCount = std::ceil((high.x - low.x) / cellSize) + 1.0f, columnCount = std::ceil((high.z - low.z) / cellSize) + 1.0f;
+	if (rowCount > maxSamples || columnCount > maxSamples)
+	{
+		std::cerr << "Heightfield of " << mName << " would be " << rowCount << "x" << columnCount << " samples, use bigger cells" << std::endl;
+		return false;
+	}
+	physx::PxU32 rows = (physx::PxU32)rowCount, columns = (physx::PxU32)columnCount;
+	float rowScale = (high.x - low.x) / (rows - 1), columnScale = (high.z - low.z) / (columns - 1);
+
+	// Height of the top surface on a grid, or -PX_MAX_F32 where no triangle covers it.
+	// Vertical triangles (walls) have no top surface, so they're skipped.
+	auto rasterize = [&](float originX, float originZ, physx::PxU32 gridRows, physx::PxU32 gridColumns, std::vector<float>& heights)
+	{
+		const float epsilon = 1e-4f;
+		heights.assign((size_t)gridRows * gridColumns, -PX_MAX_F32);
+		for (size_t i = 0; i + 2 < mIndexView.size(); i += 3)
+		{
+			const Vertex& a = mVertexView[mIndexView[i]];
+			const Vertex& b = mVertexView[mIndexView[i + 1]];
+			const Vertex& c = mVertexView[mIndexView[i + 2]];
+			float area = (b.pX() - a.pX()) * (c.pZ() - a.pZ()) - (c.pX() - a.pX()) * (b.pZ() - a.pZ());
+			if (std::abs(area) < 1e-12f)
+			{
+				continue;
+			}
+
+			float minX = std::min(a.pX(), std::min(b.pX(), c.pX())), maxX = std::max(a.pX(), std::max(b.pX(), c.pX()));
+			float minZ = std::min(a.pZ(), std::min(b.pZ(), c.pZ())), maxZ = std::max(a.pZ(), std::max(b.pZ(), c.pZ()));
+			int firstRow = std::max(0, (int)std::ceil((minX - originX) / rowScale - epsilon));
+			int lastRow = std::min((int)gridRows - 1, (int)std::floor((maxX - originX) / rowScale + epsilon));
+			int firstColumn = std::max(0, (int)std::ceil((minZ - originZ) / columnScale - epsilon));
+			int lastColumn = std::min((int)gridColumns - 1, (int)std::floor((maxZ - originZ) / columnScale + epsilon));
+
+			for (int row = firstRow; row <= lastRow; row++)
+			{
+				float x = originX + row * rowScale;
+				for (int column = firstColumn; column <= lastColumn; column++)
+				{
+					float z = originZ + column * columnScale;
+					// Barycentric weights of b & c
+					float u = ((x - a.pX()) * (c.pZ() - a.pZ()) - (c.pX() - a.pX()) * (z - a.pZ())) / area;
+					float v = ((b.pX() - a.pX()) * (z - a.pZ()) - (x - a.pX()) * (b.pZ() - a.pZ())) / area;
+					if (u < -epsilon || v < -epsilon || u + v > 1.0f + epsilon)
+					{
+						continue;
+					}
+
+					float y = a.pY() + (b.pY() - a.pY()) * u + (c.pY() - a.pY()) * v;
+					float& height = heights[(size_t)row * gridColumns + column];
+					height = std::max(height, y);
+				}
+			}
+		}
+	};
+
+	std::vector<float> heights, centres;
+	rasterize(low.x, low.z, rows, columns, heights);
+	rasterize(low.x + rowScale * 0.5f, low.z + columnScale * 0.5f, rows - 1, columns - 1, centres);
+
+	float minY = PX_MAX_F32, maxY = -PX_MAX_F32;
+	for (size_t i = 0; i < heights.size(); i++)
+	{
+		if (heights[i] > -PX_MAX_F32)
+		{
+			minY = std::min(minY, heights[i]);
+			maxY = std::max(maxY, heights[i]);
+		}
+	}
+	if (minY > maxY)
+	{
+		return false;
+	}
+
+	// 16-bit heights over the surface's range
+	// A nearly flat surface (eg. a floor with float noise in its heights) would get a scale too small for PhysX to accept
+	float heightScale = std::max((maxY - minY) / 32767.0f, PX_MIN_HEIGHTFIELD_Y_SCALE);
+	std::vector<physx::PxHeightFieldSample> samples(heights.size());
+	for (size_t i = 0; i < heights.size(); i++)
+	{
+		samples[i].height = heights[i] > -PX_MAX_F32 ? (physx::PxI16)std::lround((heights[i] - minY) / heightScale) : 0;
+		samples[i].materialIndex0 = samples[i].materialIndex1 = 0;
+	}
+
+	// A sample's materials are those of the cell it's the first corner of
+	stats.rows = rows;
+	stats.columns = columns;
+	double errorSum = 0.0;
+	size_t errorCount = 0;
+	for (physx::PxU32 row = 0; row + 1 < rows; row++)
+	{
+		for (physx::PxU32 column = 0; column + 1 < columns; column++)
+		{
+			size_t corners[4] = { (size_t)row * columns + column, (size_t)row * columns + column + 1, (size_t)(row + 1) * columns + column, (size_t)(row + 1) * columns + column + 1 };
+			float centre = centres[(size_t)row * (columns - 1) + column];
+			bool covered = centre > -PX_MAX_F32;
+			float sampled = 0.0f;
+			for (int i = 0; i < 4; i++)
+			{
+				covered = covered && heights[corners[i]] > -PX_MAX_F32;
+				sampled += minY + samples[corners[i]].height * heightScale;
+			}
+
+			if (!covered)
+			{
+				samples[corners[0]].materialIndex0 = samples[corners[0]].materialIndex1 = physx::PxHeightFieldMaterial::eHOLE;
+				stats.holeCount++;
+				continue;
+			}
+
+			// Bilinear, rather than along the cell's diagonal
+			float error = std::abs(centre - sampled * 0.25f);
+			stats.maxError = std::max(stats.maxError, error);
+			errorSum += error;
+			errorCount++;
+		}
+	}
+	stats.meanError = errorCount > 0 ? (float)(errorSum / errorCount) : 0.0f;
+
+	physx::PxHeightFieldDesc desc;
+	desc.format = physx::PxHeightFieldFormat::eS16_TM;
+	desc.nbRows = rows;
+	desc.nbColumns = columns;
+	desc.samples.data = samples.data();
+	desc.samples.stride = sizeof(physx::PxHeightFieldSample);
+
+	physx::PxDefaultMemoryOutputStream out;
+	if (!cooking->cookHeightField(desc, out))
+	{
+		std::cerr << "Failed to cook the heightfield of " << mName << std::endl;
+		return false;
+	}
+	physx::PxDefaultMemoryInputData in(out.getData(), out.getSize());
+	physx::PxHeightField* heightField = PxGetPhysics().createHeightField(in);
+	if (heightField == nullptr)
+	{
+		std::cerr << "Failed to create the heightfield of " << mName << std::endl;
+		return false;
+	}
+	stats.bytes = out.getSize();
+
+	proxy = Mesh();
+	proxy.mType = MeshType::HeightField;
+	proxy.mName = mName + CollisionProxySuffix;
+	proxy.mBounds = mBounds;
+	proxy.mPxGeometry = ownPx(new physx::PxHeightFieldGeometry(heightField, physx::PxMeshGeometryFlags(), heightScale, rowScale, columnScale));
+	proxy.mPxLocalPose = physx::PxTransform(physx::PxVec3(low.x, minY, low.z));
+	return true;
+}
+
+Span<const Vertex> Mesh::GetVertices() const
+{
+	return mVertexView;
 }
 
-std::vector<Vertex> Mesh::GetDataVector()
+// Returns position + normal data straight from the interleaved vertex buffer
+Span<const float> Mesh::GetRenderData() const
 {
-	return mVertices;
+	return Span<const float>(mVertexView.empty() ? nullptr : mVertexView[0].GetData(), mVertexView.size() * Vertex::Stride);
+}
+
+const MeshOptimizer::CacheStats& Mesh::GetCacheStats(bool optimized) const
+{
+	return optimized ? mCacheStats : mSourceCacheStats;
 }
 
 // Assigns the vertex buffer and creates a convex PhysX mesh
-void Mesh::SetVertices(std::vector<Vertex> vertices, physx::PxCooking* cooking, std::vector<unsigned int> indices, Mesh::MeshType meshType, bool updatePx)
+void Mesh::SetVertices(std::vector<Vertex>&& vertices, physx::PxCooking* cooking, std::vector<unsigned int>&& indices, Mesh::MeshType meshType, bool updatePx)
 {
-	// TODO: shouldn't I delete each vertex first? they contain raw pointers
-	mVertices = vertices;
-	mAllVerts = reverseIndexing(vertices, indices);
-	mIndices = indices;
+	buildIndexed(vertices, indices);
+	finishBuild(cooking, meshType, updatePx);
+}
+
+Mesh Mesh::fromStatic(Span<const Vertex> vertices, Span<const unsigned int> indices, physx::PxCooking* cooking, Mesh::MeshType meshType, bool updatePx)
+{
+	Mesh ret;
+	ret.mVertexView = vertices;
+	ret.mIndexView = indices;
+	ret.mCacheStats = ret.mSourceCacheStats = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+	ret.mBounds = Bounds::compute(vertices.data(), vertices.size());
+
+	Lod lod = { 0, indices.size(), 0.0f };
+	ret.mLods.assign(1, lod);
+
+	ret.finishBuild(cooking, meshType, updatePx);
+	return ret;
+}
 
+void Mesh::finishBuild(physx::PxCooking* cooking, Mesh::MeshType meshType, bool updatePx)
+{
 	// Find sphere radius from vertices
 	if (meshType == MeshType::Sphere || meshType == MeshType::Box)
 	{
 		float maxX = 0.f;
 
-		for (int i = 0; i < mVertices.size(); i++)
+		for (int i = 0; i < mVertexView.size(); i++)
 		{
 			// Since it's a sphere we only need to check one axis to find radius
-			if (abs(mVertices[i].pX()) > maxX)
+			if (abs(mVertexView[i].pX()) > maxX)
 			{
-				maxX = abs(mVertices[i].pX());
+				maxX = abs(mVertexView[i].pX());
 			}
 		}
 		mPrimitiveHx = physx::PxVec3(maxX);
@@ -308,23 +810,114 @@ void Mesh::SetVertices(std::vector<Vertex> vertices, physx::PxCooking* cooking,
 
 }
 
-void Mesh::UpdatePx(physx::PxCooking* cooking)
+// Welds duplicate vertices and optimises the triangle order for the post-transform vertex cache.
+// Takes ownership of the given buffers' contents.
+void Mesh::buildIndexed(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	MeshOptimizer::weldVertices(vertices, indices);
+	mSourceCacheStats = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+
+	MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+	MeshOptimizer::optimizeVertexFetch(vertices, indices);
+	mCacheStats = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+
+	mVertices.swap(vertices);
+	mIndices.swap(indices);
+	mVertexView = mVertices;
+	mIndexView = mIndices;
+	mBounds = Bounds::compute(mVertices.data(), mVertices.size());
+
+	// Only the full detail level until GenerateLods is called
+	Lod lod = { 0, mIndices.size(), 0.0f };
+	mLods.assign(1, lod);
+	mLodIndices.clear();
+}
+
+void Mesh::GenerateLods(size_t lodCount)
+{
+	if (mLods.empty())
+	{
+		return;
+	}
+
+	// Rebuild from the full detail level
+	mLods.resize(1);
+	mLodIndices.clear();
+
+	// Levels smaller than this aren't worth an extra draw range
+	const size_t minTriangles = 4;
+
+	lodCount = (lodCount < MaxLodCount) ? lodCount : MaxLodCount;
+	for (size_t level = 1; level < lodCount; level++)
+	{
+		const Lod& previous = mLods.back();
+		size_t targetIndexCount = (previous.indexCount / 2) / 3 * 3;
+		if (targetIndexCount < minTriangles * 3)
+		{
+			break;
+		}
+
+		// Simplifying from full detail each time keeps the errors of the levels independent
+		std::vector<unsigned int> indices;
+		float error = MeshOptimizer::simplify(mVertexView, mIndexView, indices, targetIndexCount);
+
+		// Stop once the simplifier can't get meaningfully below the previous level (eg. flat or fully locked geometry)
+		if (indices.size() < minTriangles * 3 || indices.size() * 4 > previous.indexCount * 3)
+		{
+			break;
+		}
+
+		MeshOptimizer::optimizeVertexCache(indices, mVertexView.size());
+
+		Lod lod = { mIndexView.size() + mLodIndices.size(), indices.size(), std::max(error, previous.error) };
+		mLods.push_back(lod);
+		mLodIndices.insert(mLodIndices.end(), indices.begin(), indices.end());
+	}
+
+	std::cout << "Mesh " << mName << ": LOD triangles";
+	for (size_t i = 0; i < mLods.size(); i++)
+	{
+		std::cout << (i == 0 ? " " : " / ") << mLods[i].indexCount / 3;
+	}
+	std::cout << std::endl;
+}
+
+size_t Mesh::GetLodCount() const
+{
+	return mLods.size();
+}
+
+const Mesh::Lod& Mesh::GetLod(size_t level) const
 {
-	physx::PxDefaultMemoryOutputStream buf;
-	physx::PxDefaultMemoryOutputStream triBuf;
+	return mLods[level];
+}
+
+Span<const unsigned int> Mesh::GetLodIndices() const
+{
+	return Span<const unsigned int>(mLodIndices.data(), mLodIndices.size());
+}
 
+void Mesh::UpdatePx(physx::PxCooking* cooking)
+{
 	physx::PxConvexMeshDesc meshDesc;
 	physx::PxConvexMesh* convexMesh = nullptr;
 
 	physx::PxTriangleMeshDesc triMeshDesc;
 	physx::PxTriangleMesh* triMesh = nullptr;
 
+	// The mesh's cooking profile, if a rule picks one for it
+	const CookingProfile* profile = nullptr;
+	if (mType == MeshType::Convex || mType == MeshType::TriangleList)
+	{
+		cooking = CookingProfiles::Global().CookingFor(mName, mType, cooking, &profile);
+	}
+
 	switch (mType)
 	{
 	case MeshType::Convex:
-		meshDesc.points.count = GetCount();
-		meshDesc.points.data = GetData();
-		meshDesc.points.stride = sizeof(float) * 3; // Separate position coords from normals!
+		meshDesc.points.count = mVertexView.size();
+		meshDesc.points.data = mVertexView.data();
+		meshDesc.points.stride = sizeof(Vertex); // Positions are read straight from the interleaved buffer, skipping normals
 
 		if (IsIndexed())
 		{
@@ -335,7 +928,7 @@ void Mesh::UpdatePx(physx::PxCooking* cooking)
 				mIndices[i] -= offset;
 			}*/
 			meshDesc.indices.count = GetIndexCount();
-			meshDesc.indices.data = GetIndices();
+			meshDesc.indices.data = mIndexView.data();
 			meshDesc.indices.stride = 0;
 		}
 		if (!IsIndexed())
@@ -344,16 +937,12 @@ void Mesh::UpdatePx(physx::PxCooking* cooking)
 		}
 
 		meshDesc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
-		if (cooking->cookConvexMesh(meshDesc, buf))
-		{
-			std::cout << "Cooking PhysX convex mesh successful." << std::endl;
-		}
-		else
+		if (profile != nullptr)
 		{
-			std::cerr << "Cooking PhysX convex mesh failed." << std::endl;
+			meshDesc.vertexLimit = profile->convexVertexLimit;
 		}
-
-		convexMesh = PxGetPhysics().createConvexMesh(*(new physx::PxDefaultMemoryInputData(buf.getData(), buf.getSize())));
+		// Cooked on the first launch only, then loaded from the on-disk cache
+		convexMesh = CookingCache::Global().ConvexMesh(cooking, meshDesc);
 		if (convexMesh)
 		{
 			std::cout << "Created a PxConvexMesh successfully." << std::endl;
@@ -362,13 +951,13 @@ void Mesh::UpdatePx(physx::PxCooking* cooking)
 		{
 			std::cerr << "Failed to create PxConvexMesh." << std::endl;
 		}
-		mPxGeometry = new physx::PxConvexMeshGeometry(convexMesh);
+		mPxGeometry = ownPx(new physx::PxConvexMeshGeometry(convexMesh));
 		return;
 	case MeshType::TriangleList:
 		// TODO
-		triMeshDesc.points.count = GetCount();
-		triMeshDesc.points.data = GetData();
-		triMeshDesc.points.stride = sizeof(float) * 3; // Separate position coords from normals!
+		triMeshDesc.points.count = mVertexView.size();
+		triMeshDesc.points.data = mVertexView.data();
+		triMeshDesc.points.stride = sizeof(Vertex); // Positions are read straight from the interleaved buffer, skipping normals
 
 		if (IsIndexed())
 		{
@@ -380,7 +969,7 @@ void Mesh::UpdatePx(physx::PxCooking* cooking)
 			}*/
 
 			triMeshDesc.triangles.count = GetIndexCount() / 3;
-			triMeshDesc.triangles.data = GetIndices();
+			triMeshDesc.triangles.data = mIndexView.data();
 			triMeshDesc.triangles.stride = sizeof(unsigned int) * 3;
 			std::cout << "triMeshDesc valid: " << triMeshDesc.isValid() << std::endl;
 		}
@@ -389,16 +978,7 @@ void Mesh::UpdatePx(physx::PxCooking* cooking)
 			std::cout << std::endl;
 		}
 
-		if (cooking->cookTriangleMesh(triMeshDesc, triBuf))
-		{
-			std::cout << "Cooking PhysX triangle mesh successful." << std::endl;
-		}
-		else
-		{
-			std::cerr << "Cooking PhysX triangle mesh failed." << std::endl;
-		}
-
-		triMesh = PxGetPhysics().createTriangleMesh(*(new physx::PxDefaultMemoryInputData(triBuf.getData(), triBuf.getSize())));
+		triMesh = CookingCache::Global().TriangleMesh(cooking, triMeshDesc);
 		if (triMesh)
 		{
 			std::cout << "Created a PxTriangleMesh successfully." << std::endl;
@@ -408,63 +988,47 @@ void Mesh::UpdatePx(physx::PxCooking* cooking)
 			std::cerr << "Failed to create PxTriangleMesh." << std::endl;
 		}
 
-		mPxGeometry = new physx::PxTriangleMeshGeometry(triMesh, physx::PxMeshScale());
+		mPxGeometry = ownPx(new physx::PxTriangleMeshGeometry(triMesh, physx::PxMeshScale()));
 		return;
 	case MeshType::Box:
-		mPxGeometry = new physx::PxBoxGeometry(mPrimitiveHx);
+		mPxGeometry = ownPx(new physx::PxBoxGeometry(mPrimitiveHx));
 		return;
 	case MeshType::Plane:
-		mPxGeometry = new physx::PxPlaneGeometry();
+		mPxGeometry = ownPx(new physx::PxPlaneGeometry());
 		std::cout << "Created a PxPlane successfully." << std::endl;
 		return;
 	case MeshType::Sphere:
-		mPxGeometry = new physx::PxSphereGeometry(mPrimitiveHx.x);
+		mPxGeometry = ownPx(new physx::PxSphereGeometry(mPrimitiveHx.x));
 		std::cout << "Created a PxSphereMesh successfully." << std::endl;
 		return;
+	case MeshType::HeightField:
+		// Cooked when sampled (see HeightFieldProxy)
+		return;
 	}
 }
 
-physx::PxVec3 Pinball::Mesh::GetCenterPoint()
+physx::PxVec3 Pinball::Mesh::GetCenterPoint() const
 {
-	physx::PxVec3 ret = physx::PxVec3(0.f);
-	size_t count = GetCount();
-	for (size_t i = 0; i < mVertices.size(); i++)
-	{
-		Vertex v = mVertices[i];
-		ret += physx::PxVec3(v.pX(), v.pY(), v.pZ()) / count;
-	}
-
-	return ret;
+	return mBounds.centroid;
 }
 
-size_t Mesh::GetIndexCount()
+const Bounds& Mesh::GetBounds() const
 {
-	return mIndices.size();
+	return mBounds;
 }
 
-bool Mesh::IsIndexed()
+size_t Mesh::GetIndexCount() const
 {
-	return mIndices.size() > 0;
+	return mIndexView.size();
 }
 
-unsigned int* Mesh::GetIndices()
+bool Mesh::IsIndexed() const
 {
-	return mIndices.data();
+	return mIndexView.size() > 0;
 }
 
-std::vector<unsigned int> Mesh::GetIndexVector()
+Span<const unsigned int> Mesh::GetIndices() const
 {
-	return mIndices;
+	return mIndexView;
 }
 
-std::vector<Vertex> Mesh::reverseIndexing(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
-{
-	std::vector<Vertex> ret;
-
-	for (size_t i = 0; i < indices.size(); i++)
-	{
-		ret.push_back(vertices[indices[i]]);
-	}
-
-	return ret;
-}
\ No newline at end of file
@@ -1,20 +1,59 @@
 #pragma once
 
 #include "Vertex.h"
+#include "Span.h"
+#include "MeshOptimizer.h"
+#include "Bounds.h"
+#include "Primitives.h"
 #include <PxPhysicsAPI.h>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <3rdparty/tiny_obj_loader.h>
 
 namespace Pinball
 {
+	class Mesh;
+	class MeshCache;
+
+	// Shared, immutable mesh asset. GameObjects hold their geometry through this handle,
+	// so several objects (eg. particles) can use the same mesh without copying it.
+	typedef std::shared_ptr<const Mesh> MeshAsset;
+
 	class Mesh
 	{
+	public:
+		// One level of detail: a range of the combined index buffer (GetIndices() followed by GetLodIndices())
+		struct Lod
+		{
+			size_t indexOffset;
+			size_t indexCount;
+			// Approximate distance (in mesh units) between this level's surface and the full detail one
+			float error;
+		};
+
+		// Maximum number of levels of detail, including the full detail mesh
+		static const size_t MaxLodCount = 4;
 	private:
+		// Contiguous interleaved position+normal buffer of unique (welded) vertices (see Vertex)
 		std::vector<Vertex> mVertices;
-		std::vector<Vertex> mAllVerts;
+		// Triangle list, ordered for the post-transform vertex cache
 		std::vector<unsigned int> mIndices;
-		physx::PxGeometry* mPxGeometry;
-		float* mColor;
+		// The vertices & indices in use: either mVertices & mIndices, or static data wrapped by fromStatic (in which case those are empty)
+		Span<const Vertex> mVertexView;
+		Span<const unsigned int> mIndexView;
+		// Keeps the storage of wrapped data alive (eg. a mapped MeshCache), if it isn't static
+		std::shared_ptr<const void> mStorage;
+		// Simplified triangle lists of the coarser levels of detail, one after the other. They index the same vertices as mIndices.
+		std::vector<unsigned int> mLodIndices;
+		std::vector<Lod> mLods;
+		// Shared by the copies of the mesh. The geometry & the PhysX mesh it points to are released with the last of them (see ownPx).
+		std::shared_ptr<const physx::PxGeometry> mPxGeometry;
+		// Convex decomposition replacing a triangle list's PxTriangleMesh in collisions, if it has one (see ConvexDecomposition).
+		// Shared by the copies of the mesh like mPxGeometry, the hulls are released with the last of them.
+		std::shared_ptr<const std::vector<physx::PxConvexMesh*>> mConvexHulls;
+		// Pose of the PhysX geometry relative to the mesh (only heightfields, whose origin is a corner, aren't at identity)
+		physx::PxTransform mPxLocalPose;
 		
 		// Only used for primitive meshes
 		// Half-extents of the primitive
@@ -22,41 +61,157 @@ namespace Pinball
 
 		int mType;
 
+		// Layout of the vertex buffer once uploaded to the GPU (see VertexFormat)
+		int mVertexFormat;
+
 		std::string mName;
+
+		// Total number of bytes copied by Mesh copy construction/assignment (see CopiedBytes)
+		static std::atomic<size_t> sCopiedBytes;
+		size_t byteSize() const;
+
+		// Backend used by fromFile (see SetImportBackend)
+		static std::atomic<int> sImportBackend;
+
+		// Vertex cache efficiency of the index buffer after and before optimisation
+		MeshOptimizer::CacheStats mCacheStats, mSourceCacheStats;
+
+		// Bounding volumes of mVertices, updated whenever they change
+		Bounds mBounds;
+
+		void buildIndexed(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+		// True if the views point at static data rather than this mesh's own buffers
+		bool isStatic() const;
+		// Takes ownership of a new'd geometry: it's deleted, and the PhysX mesh, convex mesh or heightfield it points to released,
+		// once nothing holds it anymore. Shapes made from it keep their own PhysX reference, so they stay valid. Must go before PhysX does.
+		static std::shared_ptr<const physx::PxGeometry> ownPx(physx::PxGeometry* geometry);
 	public:
-		enum MeshType { Plane = 0, Box, Sphere, Convex, TriangleList };
+		// HeightField meshes are collision-only: they're sampled from a triangle list (see HeightFieldProxy) and have no vertices
+		enum MeshType { Plane = 0, Box, Sphere, Convex, TriangleList, HeightField };
+
+		// How closely a heightfield follows the triangle list it was sampled from (see HeightFieldProxy)
+		struct HeightFieldStats
+		{
+			physx::PxU32 rows, columns;
+			// Cells the surface doesn't fully cover, which are holes in the heightfield
+			size_t holeCount;
+			// Vertical distance between the surface & the heightfield at the centres of the other cells, in mesh units
+			float maxError, meanError;
+			// Size of the cooked heightfield
+			size_t bytes;
+		};
+
+		// GPU vertex layouts. The compact ones store positions relative to the mesh's bounding box (per-mesh scale & bias).
+		enum VertexFormat
+		{
+			// 24 bytes: float3 position, float3 normal
+			Float = 0,
+			// 12 bytes: half4 position, 10_10_10_2 snorm normal
+			HalfFloat,
+			// 12 bytes: snorm16x4 position, octahedral snorm16x2 normal
+			Snorm16Oct,
+			VertexFormatCount
+		};
 
 		// Creates the geometry for OpenGL and for PhysX. Appropriate meshType should be provided.
-		void SetVertices(std::vector<Vertex> vertices, physx::PxCooking* cooking, std::vector<unsigned int> indices, MeshType meshType = MeshType::Convex, bool updatePx = true);
+		// The buffers are sinks: pass them with std::move (or as temporaries), they are welded & optimised in place without being copied.
+		void SetVertices(std::vector<Vertex>&& vertices, physx::PxCooking* cooking, std::vector<unsigned int>&& indices, MeshType meshType = MeshType::Convex, bool updatePx = true);
 		void UpdatePx(physx::PxCooking* cooking);
 
-		physx::PxVec3 GetCenterPoint();
-
-		size_t GetIndexCount();
-		bool IsIndexed();
-		unsigned int* GetIndices();
-		std::vector<unsigned int> GetIndexVector();
-
-		// Returns vertex position data (3 floats per vertex, for PhysX)
-		float* GetData();
-		// Returns vertex position + normals (6 floats per vertex, for rendering)
-		float* GetRenderData();
-		std::vector<Vertex> GetDataVector();
-		size_t GetCount();
-		int GetMeshType();
-		physx::PxGeometry* GetPxGeometry();
+		// Average vertex position (cached, see GetBounds)
+		physx::PxVec3 GetCenterPoint() const;
+		const Bounds& GetBounds() const;
+
+		size_t GetIndexCount() const;
+		bool IsIndexed() const;
+		Span<const unsigned int> GetIndices() const;
+
+		// Builds up to lodCount levels of detail (each with about half the triangles of the previous one) with the quadric error simplifier.
+		// Stops early once a level can't be simplified any further.
+		void GenerateLods(size_t lodCount = MaxLodCount);
+		// Number of levels of detail, at least 1 (the full detail mesh) once vertices are set
+		size_t GetLodCount() const;
+		const Lod& GetLod(size_t level) const;
+		// Index buffer of the levels of detail after the first, to be placed right after GetIndices()
+		Span<const unsigned int> GetLodIndices() const;
+
+		// Returns the unique vertices referenced by GetIndices()
+		Span<const Vertex> GetVertices() const;
+		// Returns the same vertices as raw position + normals (Vertex::Stride floats per vertex, for rendering)
+		Span<const float> GetRenderData() const;
+		// Number of unique vertices
+		size_t GetCount() const;
+
+		// Post-transform vertex cache statistics (ACMR/ATVR) of the optimised index buffer, or of the imported one if optimized == false
+		const MeshOptimizer::CacheStats& GetCacheStats(bool optimized = true) const;
+		int GetMeshType() const;
+		int GetVertexFormat() const;
+		// Selects the layout the renderer uploads this mesh in. Should be set before the mesh is shared (see makeAsset).
+		void SetVertexFormat(VertexFormat format);
+		const physx::PxGeometry* GetPxGeometry() const;
+		// Where GetPxGeometry() goes relative to the mesh, before the object's scale is applied
+		const physx::PxTransform& GetPxLocalPose() const;
+		// Collides through these hulls (as a compound of convex shapes) instead of GetPxGeometry(), and releases them with its PhysX geometry.
+		// Should be set before the mesh is shared (see makeAsset).
+		void SetConvexHulls(std::vector<physx::PxConvexMesh*> hulls);
+		// Empty unless SetConvexHulls was called
+		const std::vector<physx::PxConvexMesh*>& GetConvexHulls() const;
+
+		// Name suffix of authored collision proxies: a model's "RampCollision" mesh is what its "Ramp" mesh collides through
+		static const char* const CollisionProxySuffix;
+		// Simplified copy of this triangle list to collide through instead of it (see GameObject::CollisionProxy), with as few triangles
+		// as the simplifier can reach while staying within maxError (in mesh units) of it. Named like an authored proxy, and not cooked yet (see UpdatePx).
+		Mesh SimplifiedProxy(float maxError) const;
+		// Samples this triangle list's top surface (as seen from +Y) every cellSize mesh units into a PxHeightField, as a mesh to collide through
+		// instead of it. Much cheaper to collide with than the triangle mesh, but only suited to 2.5D surfaces (eg. floors), as walls are lost:
+		// check the error in stats. False if the mesh can't be sampled (eg. it's vertical, or too big for the cell size).
+		bool HeightFieldProxy(physx::PxCooking* cooking, float cellSize, Mesh& proxy, HeightFieldStats& stats) const;
 		Mesh();
-		Mesh(std::vector<Vertex> vertices, physx::PxCooking* cooking, std::vector<unsigned int> indices, MeshType meshType = MeshType::Convex, bool updatePx = true);
-		void Color(float r, float g, float b);
-		float* Color();
-		std::string Name();
+		Mesh(std::vector<Vertex>&& vertices, physx::PxCooking* cooking, std::vector<unsigned int>&& indices, MeshType meshType = MeshType::Convex, bool updatePx = true);
+		Mesh(const Mesh& other);
+		Mesh(Mesh&& other) = default;
+		Mesh& operator=(const Mesh& other);
+		Mesh& operator=(Mesh&& other) = default;
+		std::string Name() const;
 		void Name(std::string name);
 
+		// Number of bytes copied by Mesh copies since the last ResetCopiedBytes() call.
+		// Used to check that no geometry gets copied while drawing.
+		static size_t CopiedBytes();
+		static void ResetCopiedBytes();
+
+		// Moves a finished mesh into a shared, immutable asset.
+		static MeshAsset makeAsset(Mesh&& mesh);
+
 		static Mesh createSphere(physx::PxCooking* cooking, float raidus = 1.0f, size_t stacks = 16, size_t slices = 8);
 		static Mesh createBox(physx::PxCooking* cooking, float size = 1.0f);
 		static Mesh createPlane(physx::PxCooking* cooking);
+		// Model file importers. ObjImport is the multi-threaded ObjImporter, which only reads .obj files (others still go through Assimp).
+		enum ImportBackend { AssimpImport = 0, ObjImport };
+		// Backend used by fromFile when the mesh cache is out of date (AssimpImport by default, until ObjImport is checked to match it on the game's models)
+		static void SetImportBackend(ImportBackend backend);
+		static ImportBackend GetImportBackend();
+
+		// Imports the meshes of a model file, or maps them from its mesh cache if it's up to date (see MeshCache).
+		// Writes the cache after importing.
 		static std::vector<Mesh> fromFile(std::string filePath, physx::PxCooking* cooking, bool updatePx = true);
+		// Imports the meshes of a model file with the given backend, bypassing the mesh cache
+		static std::vector<Mesh> importFile(std::string filePath, ImportBackend backend, physx::PxCooking* cooking, bool updatePx = true);
 
-		static std::vector<Vertex> reverseIndexing(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
+		// Wraps vertex & index data that outlives the mesh (eg. a Primitives::MeshData in static storage) without copying it.
+		// The data is used as-is: it isn't welded or reordered.
+		static Mesh fromStatic(Span<const Vertex> vertices, Span<const unsigned int> indices, physx::PxCooking* cooking, MeshType meshType, bool updatePx = true);
+		template <size_t VertexCount, size_t IndexCount>
+		static Mesh fromStatic(const Primitives::MeshData<VertexCount, IndexCount>& data, physx::PxCooking* cooking, MeshType meshType, bool updatePx = true)
+		{
+			return fromStatic(Span<const Vertex>(data.vertices, VertexCount), Span<const unsigned int>(data.indices, IndexCount), cooking, meshType, updatePx);
+		}
+		// Wraps the meshes of an opened mesh cache. They keep the cache mapped.
+		static std::vector<Mesh> fromCache(std::shared_ptr<const MeshCache> cache, physx::PxCooking* cooking, bool updatePx = true);
+	private:
+		// Sets the primitive half-extents & type, then creates the PhysX geometry
+		void finishBuild(physx::PxCooking* cooking, MeshType meshType, bool updatePx);
+		// Builds an imported mesh from its buffers & object name (trimmed at the last '_'), picking its type from the name
+		static void addImported(std::vector<Mesh>& meshes, std::vector<Vertex>&& vertices, std::vector<unsigned int>&& indices, std::string name, physx::PxCooking* cooking, bool updatePx);
 	};
 }
\ No newline at end of file
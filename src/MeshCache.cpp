@@ -0,0 +1,303 @@
+#include "MeshCache.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include "Util.h"
+#include "ResourcePack.h"
+
+using namespace Pinball;
+
+namespace
+{
+	// File layout (native endianness):
+	//	FileHeader
+	//	MeshRecord * meshCount
+	//	per mesh: vertices (16 byte aligned), indices, name
+	// Offsets are from the start of the file.
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t meshCount;
+		// Source file the meshes were imported from
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+	};
+
+	struct MeshRecord
+	{
+		uint32_t nameOffset, nameLength;
+		uint32_t type;
+		uint32_t vertexOffset, vertexCount;
+		uint32_t indexOffset, indexCount;
+		// min, max, centroid, sphere centre, sphere radius
+		float bounds[13];
+		// acmr & atvr of the optimised, then of the imported index buffer
+		float cacheStats[4];
+	};
+
+	const char Magic[4] = { 'P', 'B', 'M', 'C' };
+
+	size_t alignUp(size_t offset, size_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// True if [offset, offset + count * elementSize) lies within a file of the given size
+	bool inFile(uint64_t offset, uint64_t count, uint64_t elementSize, size_t fileSize)
+	{
+		return offset <= fileSize && count * elementSize <= fileSize - offset;
+	}
+}
+
+MeshCache::MeshCache()
+{
+	mSourceTouched = false;
+	mSourceSize = 0;
+	mSourceTime = 0;
+}
+
+std::string MeshCache::pathFor(const std::string& sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCache::parse(const std::string& sourcePath, Span<const unsigned char> packedSource)
+{
+	const unsigned char* data = mData.data();
+	size_t size = mData.size();
+	if (size < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data, sizeof(FileHeader));
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.vertexSize != sizeof(Vertex))
+	{
+		std::cout << "Mesh cache " << pathFor(sourcePath) << " is from another version, ignoring it." << std::endl;
+		return false;
+	}
+
+	if (!packedSource.empty())
+	{
+		// --build-pack refreshes the caches before packing them with their sources, so the source's packed size & time are enough
+		// (this avoids paging the whole source in just to hash it)
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!ResourcePack::findSourceInfo(sourcePath, sourceSize, sourceTime) || sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+		{
+			std::cout << "Packed mesh cache " << pathFor(sourcePath) << " is out of date." << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		// Only hash the source if it looks modified, so it isn't read at all on a normal warm start
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!statFile(sourcePath, sourceSize, sourceTime))
+		{
+			return false;
+		}
+		if (sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+		{
+			if (hashFile(sourcePath) != header.sourceHash)
+			{
+				std::cout << "Mesh cache " << pathFor(sourcePath) << " is out of date." << std::endl;
+				return false;
+			}
+			mSourceTouched = true;
+			mSourceSize = sourceSize;
+			mSourceTime = sourceTime;
+		}
+	}
+
+	if (!inFile(sizeof(FileHeader), header.meshCount, sizeof(MeshRecord), size))
+	{
+		return false;
+	}
+
+	mEntries.reserve(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount; i++)
+	{
+		MeshRecord record;
+		memcpy(&record, data + sizeof(FileHeader) + i * sizeof(MeshRecord), sizeof(MeshRecord));
+
+		if (!inFile(record.nameOffset, record.nameLength, 1, size)
+			|| !inFile(record.vertexOffset, record.vertexCount, sizeof(Vertex), size) || record.vertexOffset % alignof(Vertex) != 0
+			|| !inFile(record.indexOffset, record.indexCount, sizeof(unsigned int), size) || record.indexOffset % alignof(unsigned int) != 0)
+		{
+			std::cout << "Mesh cache " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+			mEntries.clear();
+			return false;
+		}
+
+		Entry entry;
+		entry.name.assign((const char*)data + record.nameOffset, record.nameLength);
+		entry.type = (int)record.type;
+		entry.vertices = Span<const Vertex>((const Vertex*)(data + record.vertexOffset), record.vertexCount);
+		entry.indices = Span<const unsigned int>((const unsigned int*)(data + record.indexOffset), record.indexCount);
+
+		const float* b = record.bounds;
+		entry.bounds.min = physx::PxVec3(b[0], b[1], b[2]);
+		entry.bounds.max = physx::PxVec3(b[3], b[4], b[5]);
+		entry.bounds.centroid = physx::PxVec3(b[6], b[7], b[8]);
+		entry.bounds.sphereCenter = physx::PxVec3(b[9], b[10], b[11]);
+		entry.bounds.sphereRadius = b[12];
+
+		entry.cacheStats.acmr = record.cacheStats[0];
+		entry.cacheStats.atvr = record.cacheStats[1];
+		entry.sourceCacheStats.acmr = record.cacheStats[2];
+		entry.sourceCacheStats.atvr = record.cacheStats[3];
+
+		mEntries.push_back(std::move(entry));
+	}
+
+	return true;
+}
+
+std::shared_ptr<const MeshCache> MeshCache::open(const std::string& sourcePath)
+{
+	std::shared_ptr<MeshCache> cache(new MeshCache());
+
+	// Packed caches stay mapped as long as their pack is mounted, ie. until the program exits
+	Span<const unsigned char> packedSource = ResourcePack::find(sourcePath);
+	if (!packedSource.empty())
+	{
+		cache->mData = ResourcePack::find(pathFor(sourcePath));
+		if (cache->mData.empty() || !cache->parse(sourcePath, packedSource))
+		{
+			return nullptr;
+		}
+		return cache;
+	}
+
+	cache->mFile = MappedFile::open(pathFor(sourcePath));
+	if (!cache->mFile)
+	{
+		return nullptr;
+	}
+	cache->mData = Span<const unsigned char>(cache->mFile->Data(), cache->mFile->Size());
+	if (!cache->parse(sourcePath, Span<const unsigned char>()))
+	{
+		return nullptr;
+	}
+	if (!cache->mSourceTouched)
+	{
+		return cache;
+	}
+
+	// The source was touched but not changed: store its new size & time in the header. A mapped file can't be replaced on Windows,
+	// so the cache is copied out & unmapped first, then mapped again (the old one, if it couldn't be replaced).
+	std::vector<unsigned char> file(cache->mData.data(), cache->mData.data() + cache->mData.size());
+	FileHeader header;
+	memcpy(&header, file.data(), sizeof(FileHeader));
+	header.sourceSize = cache->mSourceSize;
+	header.sourceTime = cache->mSourceTime;
+	memcpy(file.data(), &header, sizeof(FileHeader));
+
+	cache.reset(new MeshCache());
+	if (!writeFileAtomic(pathFor(sourcePath), [&](std::ostream& out) { out.write((const char*)file.data(), file.size()); }))
+	{
+		std::cerr << "Failed to update mesh cache " << pathFor(sourcePath) << std::endl;
+	}
+
+	cache->mFile = MappedFile::open(pathFor(sourcePath));
+	if (!cache->mFile)
+	{
+		return nullptr;
+	}
+	cache->mData = Span<const unsigned char>(cache->mFile->Data(), cache->mFile->Size());
+	if (!cache->parse(sourcePath, Span<const unsigned char>()))
+	{
+		return nullptr;
+	}
+	return cache;
+}
+
+bool MeshCache::write(const std::string& sourcePath, const std::vector<MeshCache::Entry>& entries)
+{
+	FileHeader header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = (uint32_t)entries.size();
+	if (!statFile(sourcePath, header.sourceSize, header.sourceTime))
+	{
+		return false;
+	}
+	header.sourceHash = hashFile(sourcePath);
+
+	// Lay out the mesh table, then each mesh's data after it
+	std::vector<MeshRecord> records(entries.size());
+	size_t offset = sizeof(FileHeader) + entries.size() * sizeof(MeshRecord);
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const Entry& entry = entries[i];
+		MeshRecord& record = records[i];
+
+		record.type = (uint32_t)entry.type;
+
+		offset = alignUp(offset, 16);
+		record.vertexOffset = (uint32_t)offset;
+		record.vertexCount = (uint32_t)entry.vertices.size();
+		offset += entry.vertices.bytes();
+
+		record.indexOffset = (uint32_t)offset;
+		record.indexCount = (uint32_t)entry.indices.size();
+		offset += entry.indices.bytes();
+
+		record.nameOffset = (uint32_t)offset;
+		record.nameLength = (uint32_t)entry.name.size();
+		offset += entry.name.size();
+
+		const Bounds& bounds = entry.bounds;
+		const float b[13] = {
+			bounds.min.x, bounds.min.y, bounds.min.z,
+			bounds.max.x, bounds.max.y, bounds.max.z,
+			bounds.centroid.x, bounds.centroid.y, bounds.centroid.z,
+			bounds.sphereCenter.x, bounds.sphereCenter.y, bounds.sphereCenter.z,
+			bounds.sphereRadius
+		};
+		memcpy(record.bounds, b, sizeof(b));
+
+		record.cacheStats[0] = entry.cacheStats.acmr;
+		record.cacheStats[1] = entry.cacheStats.atvr;
+		record.cacheStats[2] = entry.sourceCacheStats.acmr;
+		record.cacheStats[3] = entry.sourceCacheStats.atvr;
+	}
+
+	std::vector<unsigned char> file(offset, 0);
+	memcpy(file.data(), &header, sizeof(FileHeader));
+	if (!records.empty())
+	{
+		memcpy(file.data() + sizeof(FileHeader), records.data(), records.size() * sizeof(MeshRecord));
+	}
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		memcpy(file.data() + records[i].vertexOffset, entries[i].vertices.data(), entries[i].vertices.bytes());
+		memcpy(file.data() + records[i].indexOffset, entries[i].indices.data(), entries[i].indices.bytes());
+		memcpy(file.data() + records[i].nameOffset, entries[i].name.data(), entries[i].name.size());
+	}
+
+	// Level loads may map the cache from other threads while it's rewritten
+	if (!writeFileAtomic(pathFor(sourcePath), [&](std::ostream& out) { out.write((const char*)file.data(), file.size()); }))
+	{
+		std::cerr << "Failed to write mesh cache " << pathFor(sourcePath) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+const std::vector<MeshCache::Entry>& MeshCache::Entries() const
+{
+	return mEntries;
+}
+
+size_t MeshCache::Size() const
+{
+	return mData.size();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Vertex.h"
+#include "Span.h"
+#include "Bounds.h"
+#include "MeshOptimizer.h"
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace Pinball
+{
+	// Binary cache of the meshes imported from a model file, written next to it as <model>.meshcache after the first import.
+	// Later launches memory-map the cache and use its buffers in place (see Mesh::fromCache), skipping Assimp entirely.
+	// The cache is versioned, and is discarded when the model file's size & modification time change and its contents hash differs.
+	class MeshCache
+	{
+	public:
+		// Bump whenever the file layout (or the Vertex layout) changes
+		static const uint32_t Version = 1;
+
+		// One mesh's data. Spans point into the mapped file for opened caches.
+		struct Entry
+		{
+			std::string name;
+			int type;
+			Span<const Vertex> vertices;
+			Span<const unsigned int> indices;
+			Bounds bounds;
+			// Vertex cache statistics of the optimised and imported index buffers
+			MeshOptimizer::CacheStats cacheStats, sourceCacheStats;
+		};
+	private:
+		// Mapped cache file, or null if the cache is read from a mounted ResourcePack
+		std::unique_ptr<MappedFile> mFile;
+		Span<const unsigned char> mData;
+		std::vector<Entry> mEntries;
+		// Set by parse when the source's size or time no longer match the header but its contents hash still does (eg. it was checked out again).
+		// open then rewrites the header with them, so the source isn't hashed again on every launch.
+		bool mSourceTouched;
+		uint64_t mSourceSize;
+		int64_t mSourceTime;
+
+		MeshCache();
+
+		// Checks the header against the source file (or its packed contents, if packedSource isn't empty) and reads the mesh table.
+		// False if the cache is stale or malformed.
+		bool parse(const std::string& sourcePath, Span<const unsigned char> packedSource);
+	public:
+		// Path of the cache file for a model file
+		static std::string pathFor(const std::string& sourcePath);
+
+		// Maps the cache of sourcePath. Returns nullptr if there's no cache, or it's out of date or unreadable.
+		// If a mounted ResourcePack has sourcePath, its packed cache is used in place instead (see --build-pack).
+		// The returned object keeps the file mapped, so meshes wrapping its buffers should hold on to it.
+		static std::shared_ptr<const MeshCache> open(const std::string& sourcePath);
+
+		// Writes the cache of sourcePath, replacing any previous one
+		static bool write(const std::string& sourcePath, const std::vector<Entry>& entries);
+
+		const std::vector<Entry>& Entries() const;
+		// Size of the mapped cache in bytes
+		size_t Size() const;
+	};
+}
@@ -0,0 +1,659 @@
+#include "MeshOptimizer.h"
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+using namespace Pinball;
+
+namespace
+{
+	// Bitwise hash & equality for vertices, so only exact duplicates are merged (hard edges keep their separate normals)
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			uint32_t words[Vertex::Stride];
+			std::memcpy(words, v.GetData(), sizeof(words));
+
+			// FNV-1a over the 6 words
+			uint32_t hash = 2166136261u;
+			for (int i = 0; i < Vertex::Stride; i++)
+			{
+				hash = (hash ^ words[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const
+		{
+			return std::memcmp(a.GetData(), b.GetData(), sizeof(Vertex)) == 0;
+		}
+	};
+
+	// Hash & equality on vertex positions only, to find vertices split by normal seams
+	struct PositionHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			uint32_t words[3];
+			std::memcpy(words, v.GetData(), sizeof(words));
+
+			uint32_t hash = 2166136261u;
+			for (int i = 0; i < 3; i++)
+			{
+				hash = (hash ^ words[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const
+		{
+			return std::memcmp(a.GetData(), b.GetData(), sizeof(float) * 3) == 0;
+		}
+	};
+
+	// Symmetric 4x4 quadric error matrix (upper triangle): error(p) = [p 1] Q [p 1]^T, with planes weighted by triangle area
+	struct Quadric
+	{
+		double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+		// Total weight of the planes
+		double w;
+	};
+
+	void quadricAddPlane(Quadric& q, double a, double b, double c, double d, double weight)
+	{
+		q.a00 += a * a * weight; q.a01 += a * b * weight; q.a02 += a * c * weight; q.a03 += a * d * weight;
+		q.a11 += b * b * weight; q.a12 += b * c * weight; q.a13 += b * d * weight;
+		q.a22 += c * c * weight; q.a23 += c * d * weight;
+		q.a33 += d * d * weight;
+		q.w += weight;
+	}
+
+	void quadricAdd(Quadric& q, const Quadric& other)
+	{
+		q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02; q.a03 += other.a03;
+		q.a11 += other.a11; q.a12 += other.a12; q.a13 += other.a13;
+		q.a22 += other.a22; q.a23 += other.a23;
+		q.a33 += other.a33;
+		q.w += other.w;
+	}
+
+	// Weighted mean of the squared distances from the vertex's position to the quadric's planes
+	double quadricError(const Quadric& q, const Vertex& v)
+	{
+		double x = v.pX(), y = v.pY(), z = v.pZ();
+		double error = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x
+			+ q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y
+			+ q.a22 * z * z + 2.0 * q.a23 * z
+			+ q.a33;
+
+		// Rounding can push the error of points on the planes slightly below 0
+		return (error < 0.0 || q.w <= 0.0) ? 0.0 : error / q.w;
+	}
+
+	// Unnormalised triangle normal
+	void triangleNormal(const Vertex& a, const Vertex& b, const Vertex& c, double* normal)
+	{
+		double e1[3] = { (double)b.pX() - a.pX(), (double)b.pY() - a.pY(), (double)b.pZ() - a.pZ() };
+		double e2[3] = { (double)c.pX() - a.pX(), (double)c.pY() - a.pY(), (double)c.pZ() - a.pZ() };
+		normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	// Moving position "from" onto position "to"
+	struct Collapse
+	{
+		unsigned int from, to;
+		double cost;
+
+		bool operator<(const Collapse& other) const
+		{
+			return cost < other.cost;
+		}
+	};
+
+	// Tuning constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	const int kCacheSize = 32;
+	const float kCacheDecayPower = 1.5f;
+	const float kLastTriScore = 0.75f;
+	const float kValenceBoostScale = 2.0f;
+	const float kValenceBoostPower = 0.5f;
+
+	float vertexScore(int cachePosition, unsigned int remainingTris)
+	{
+		// Vertices without any triangles left to emit are of no interest
+		if (remainingTris == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// Used by the last triangle, so fixed score to avoid favouring any of its edges
+				score = kLastTriScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / (kCacheSize - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+			}
+		}
+
+		// Boost vertices with few triangles left, so lone triangles don't get left behind
+		score += kValenceBoostScale * std::pow((float)remainingTris, -kValenceBoostPower);
+
+		return score;
+	}
+}
+
+void MeshOptimizer::weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	if (indices.empty())
+	{
+		indices.resize(vertices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			indices[i] = (unsigned int)i;
+		}
+	}
+
+	std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> lookup;
+	lookup.reserve(vertices.size());
+
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+
+	// Remap of each source vertex to its welded counterpart
+	std::vector<unsigned int> remap(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		auto it = lookup.find(vertices[i]);
+		if (it == lookup.end())
+		{
+			it = lookup.emplace(vertices[i], (unsigned int)welded.size()).first;
+			welded.push_back(vertices[i]);
+		}
+		remap[i] = it->second;
+	}
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		indices[i] = remap[indices[i]];
+	}
+
+	vertices.swap(welded);
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0)
+	{
+		return;
+	}
+
+	// Triangle adjacency per vertex, stored as one flat array with per-vertex offsets
+	std::vector<unsigned int> remainingTris(vertexCount, 0);
+	for (size_t i = 0; i < triCount * 3; i++)
+	{
+		remainingTris[indices[i]]++;
+	}
+
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remainingTris[v];
+	}
+
+	std::vector<unsigned int> adjacency(triCount * 3);
+	{
+		std::vector<unsigned int> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t t = 0; t < triCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				adjacency[cursor[indices[t * 3 + k]]++] = (unsigned int)t;
+			}
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = vertexScore(-1, remainingTris[v]);
+	}
+
+	std::vector<bool> emitted(triCount, false);
+
+	// Initial triangle: the best scoring one overall
+	int bestTri = -1;
+	float bestScore = -1.0f;
+	for (size_t t = 0; t < triCount; t++)
+	{
+		float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestTri = (int)t;
+		}
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(triCount * 3);
+
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(kCacheSize + 3);
+	newCache.reserve(kCacheSize + 3);
+
+	// Fallback position for when the cache holds no more live triangles
+	size_t scanPosition = 0;
+
+	while (bestTri >= 0)
+	{
+		const unsigned int* tri = &indices[bestTri * 3];
+		emitted[bestTri] = true;
+
+		// Emit the triangle and remove it from its vertices' live adjacency
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = tri[k];
+			result.push_back(v);
+
+			unsigned int* begin = &adjacency[adjacencyOffsets[v]];
+			unsigned int* end = begin + remainingTris[v];
+			for (unsigned int* it = begin; it != end; it++)
+			{
+				if (*it == (unsigned int)bestTri)
+				{
+					*it = *(end - 1);
+					remainingTris[v]--;
+					break;
+				}
+			}
+		}
+
+		// Push the triangle's vertices to the front of the LRU cache
+		newCache.assign(tri, tri + 3);
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+			{
+				newCache.push_back(v);
+			}
+		}
+
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = (i < (size_t)kCacheSize) ? (int)i : -1;
+			vertexScores[v] = vertexScore(cachePosition[v], remainingTris[v]);
+		}
+
+		if (newCache.size() > (size_t)kCacheSize)
+		{
+			newCache.resize(kCacheSize);
+		}
+		cache.swap(newCache);
+
+		// Next triangle: the best one touching a cached vertex
+		bestTri = -1;
+		bestScore = -1.0f;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			const unsigned int* adj = &adjacency[adjacencyOffsets[v]];
+			for (unsigned int j = 0; j < remainingTris[v]; j++)
+			{
+				unsigned int t = adj[j];
+				float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTri = (int)t;
+				}
+			}
+		}
+
+		// Nothing left around the cache (eg. a disconnected piece of the mesh), continue with the next unemitted triangle
+		if (bestTri < 0)
+		{
+			while (scanPosition < triCount && emitted[scanPosition])
+			{
+				scanPosition++;
+			}
+			if (scanPosition < triCount)
+			{
+				bestTri = (int)scanPosition;
+			}
+		}
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int& newIndex = remap[indices[i]];
+		if (newIndex == unused)
+		{
+			newIndex = (unsigned int)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = newIndex;
+	}
+
+	// Vertices not referenced by any triangle are dropped
+	vertices.swap(reordered);
+}
+
+float MeshOptimizer::simplify(Span<const Vertex> vertices, Span<const unsigned int> indices, std::vector<unsigned int>& destination, size_t targetIndexCount)
+{
+	destination.assign(indices.begin(), indices.end());
+	const size_t vertexCount = vertices.size();
+
+	// Vertices sharing a position are represented by the first of them
+	std::vector<unsigned int> position(vertexCount);
+	{
+		std::unordered_map<Vertex, unsigned int, PositionHash, PositionEqual> lookup;
+		lookup.reserve(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			position[i] = lookup.emplace(vertices[i], (unsigned int)i).first->second;
+		}
+	}
+
+	// Vertices of each position (its wedges), stored as one flat array with per-position offsets
+	std::vector<unsigned int> wedgeOffsets(vertexCount + 1, 0);
+	std::vector<unsigned int> wedges(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		wedgeOffsets[position[i] + 1]++;
+	}
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		wedgeOffsets[i + 1] += wedgeOffsets[i];
+	}
+	{
+		std::vector<unsigned int> cursor(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			wedges[cursor[position[i]]++] = (unsigned int)i;
+		}
+	}
+
+	// Error quadric of each position, from the planes of the triangles around it
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t t = 0; t + 2 < destination.size(); t += 3)
+	{
+		const Vertex& a = vertices[destination[t]];
+		double normal[3];
+		triangleNormal(a, vertices[destination[t + 1]], vertices[destination[t + 2]], normal);
+
+		double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length <= 0.0)
+		{
+			continue;
+		}
+		normal[0] /= length;
+		normal[1] /= length;
+		normal[2] /= length;
+		double d = -(normal[0] * a.pX() + normal[1] * a.pY() + normal[2] * a.pZ());
+
+		for (int k = 0; k < 3; k++)
+		{
+			quadricAddPlane(quadrics[position[destination[t + k]]], normal[0], normal[1], normal[2], d, length * 0.5);
+		}
+	}
+
+	// Positions on open borders or non-manifold edges (edges not shared by exactly 2 triangles) stay in place, so the mesh outline is kept
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, unsigned int> edgeUse;
+		edgeUse.reserve(destination.size());
+		for (size_t t = 0; t + 2 < destination.size(); t += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint64_t a = position[destination[t + k]], b = position[destination[t + (k + 1) % 3]];
+				edgeUse[(std::min(a, b) << 32) | std::max(a, b)]++;
+			}
+		}
+		for (auto it = edgeUse.begin(); it != edgeUse.end(); it++)
+		{
+			if (it->second != 2)
+			{
+				locked[it->first >> 32] = true;
+				locked[it->first & 0xffffffffu] = true;
+			}
+		}
+	}
+
+	double maxError = 0.0;
+
+	std::vector<unsigned int> adjacencyOffsets, adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> positionRemap(vertexCount), remap(vertexCount);
+	std::vector<bool> touched;
+
+	// Each pass collapses the cheapest edges that don't overlap each other, until the target is reached or nothing can be collapsed
+	while (destination.size() > targetIndexCount)
+	{
+		const size_t triCount = destination.size() / 3;
+
+		// Triangles around each position
+		adjacencyOffsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < triCount * 3; i++)
+		{
+			adjacencyOffsets[position[destination[i]] + 1]++;
+		}
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		adjacency.resize(triCount * 3);
+		{
+			std::vector<unsigned int> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < triCount * 3; i++)
+			{
+				adjacency[cursor[position[destination[i]]]++] = (unsigned int)(i / 3);
+			}
+		}
+
+		// Candidate collapses: every interior edge once (from the triangle where it goes from the lower to the higher position), in its cheaper direction
+		collapses.clear();
+		for (size_t t = 0; t < triCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = position[destination[t * 3 + k]], b = position[destination[t * 3 + (k + 1) % 3]];
+				if (a >= b || (locked[a] && locked[b]))
+				{
+					continue;
+				}
+
+				Quadric q = quadrics[a];
+				quadricAdd(q, quadrics[b]);
+
+				const double unusable = std::numeric_limits<double>::max();
+				double costAB = locked[a] ? unusable : quadricError(q, vertices[b]);
+				double costBA = locked[b] ? unusable : quadricError(q, vertices[a]);
+
+				Collapse collapse = { a, b, costAB };
+				if (costBA < costAB)
+				{
+					collapse.from = b;
+					collapse.to = a;
+					collapse.cost = costBA;
+				}
+				collapses.push_back(collapse);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			positionRemap[i] = (unsigned int)i;
+		}
+		touched.assign(vertexCount, false);
+
+		const size_t trianglesToRemove = std::max((destination.size() - targetIndexCount) / 3, (size_t)1);
+		size_t trianglesRemoved = 0;
+		size_t collapsesDone = 0;
+
+		for (size_t c = 0; c < collapses.size() && trianglesRemoved < trianglesToRemove; c++)
+		{
+			const Collapse& collapse = collapses[c];
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			// Reject collapses that would flip any of the remaining triangles around the moved position
+			bool flips = false;
+			for (unsigned int j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; j++)
+			{
+				unsigned int tri[3];
+				bool collapsed = false;
+				for (int k = 0; k < 3; k++)
+				{
+					tri[k] = position[destination[adjacency[j] * 3 + k]];
+					collapsed |= tri[k] == collapse.to;
+				}
+				if (collapsed)
+				{
+					continue;
+				}
+
+				double before[3], after[3];
+				triangleNormal(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], before);
+				for (int k = 0; k < 3; k++)
+				{
+					tri[k] = (tri[k] == collapse.from) ? collapse.to : tri[k];
+				}
+				triangleNormal(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], after);
+
+				flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0;
+			}
+			if (flips)
+			{
+				continue;
+			}
+
+			positionRemap[collapse.from] = collapse.to;
+			quadricAdd(quadrics[collapse.to], quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.cost);
+			collapsesDone++;
+
+			// Triangles around the moved position can't take part in another collapse this pass
+			for (unsigned int j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+			{
+				bool collapsed = false;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int p = position[destination[adjacency[j] * 3 + k]];
+					touched[p] = true;
+					collapsed |= p == collapse.to;
+				}
+				trianglesRemoved += collapsed ? 1 : 0;
+			}
+		}
+
+		if (collapsesDone == 0)
+		{
+			break;
+		}
+
+		// Moved vertices take the wedge of their new position with the closest normal
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = (unsigned int)v;
+
+			unsigned int target = positionRemap[position[v]];
+			if (target == position[v])
+			{
+				continue;
+			}
+
+			float bestDot = -std::numeric_limits<float>::max();
+			for (unsigned int j = wedgeOffsets[target]; j < wedgeOffsets[target + 1]; j++)
+			{
+				const Vertex& w = vertices[wedges[j]];
+				float dot = w.nX() * vertices[v].nX() + w.nY() * vertices[v].nY() + w.nZ() * vertices[v].nZ();
+				if (dot > bestDot)
+				{
+					bestDot = dot;
+					remap[v] = wedges[j];
+				}
+			}
+		}
+
+		// Rewrite the triangles, dropping the ones that collapsed to a line
+		size_t written = 0;
+		for (size_t t = 0; t < triCount; t++)
+		{
+			unsigned int a = remap[destination[t * 3]], b = remap[destination[t * 3 + 1]], c = remap[destination[t * 3 + 2]];
+			if (position[a] == position[b] || position[b] == position[c] || position[c] == position[a])
+			{
+				continue;
+			}
+
+			destination[written++] = a;
+			destination[written++] = b;
+			destination[written++] = c;
+		}
+		destination.resize(written);
+	}
+
+	return (float)std::sqrt(maxError);
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::analyzeVertexCache(Span<const unsigned int> indices, size_t vertexCount, unsigned int cacheSize)
+{
+	CacheStats ret = { 0.0f, 0.0f };
+	if (indices.empty() || vertexCount == 0)
+	{
+		return ret;
+	}
+
+	// FIFO cache simulated with per-vertex timestamps: a vertex is cached if it was inserted less than cacheSize misses ago
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	unsigned int misses = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (time - timestamps[v] > cacheSize)
+		{
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+
+	ret.acmr = (float)misses / (float)(indices.size() / 3);
+	ret.atvr = (float)misses / (float)vertexCount;
+	return ret;
+}
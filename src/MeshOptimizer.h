@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Vertex.h"
+#include "Span.h"
+#include <vector>
+#include <cstddef>
+
+namespace Pinball
+{
+	// Index buffer optimisation utilities used when building a Mesh.
+	namespace MeshOptimizer
+	{
+		// Post-transform vertex cache efficiency of an index buffer
+		struct CacheStats
+		{
+			// Average cache miss ratio: vertex shader invocations per triangle (0.5 is ideal for large grids, 3.0 is the worst case)
+			float acmr;
+			// Average transformed vertex ratio: vertex shader invocations per unique vertex (1.0 is ideal)
+			float atvr;
+		};
+
+		// Merges bit-identical vertices and remaps the index buffer to the merged vertices.
+		// If indices is empty, vertices are treated as an unindexed triangle list and indices are generated.
+		void weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+		// Reorders triangles for the post-transform vertex cache (Tom Forsyth's linear-speed algorithm).
+		void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+		// Reorders vertices by first use in the index buffer, so vertex fetches walk the buffer linearly.
+		void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+		// Quadric error metric simplification (Garland & Heckbert) by edge collapses onto existing vertices, so the result indexes the same vertex buffer.
+		// Vertices sharing a position collapse together; positions on open borders are kept in place.
+		// Writes a triangle list of at most targetIndexCount indices (or as close as the mesh allows) to destination,
+		// and returns the resulting geometric error in mesh units.
+		float simplify(Span<const Vertex> vertices, Span<const unsigned int> indices, std::vector<unsigned int>& destination, size_t targetIndexCount);
+
+		// Simulates a FIFO post-transform cache of the given size over the index buffer.
+		CacheStats analyzeVertexCache(Span<const unsigned int> indices, size_t vertexCount, unsigned int cacheSize = 16);
+	}
+}
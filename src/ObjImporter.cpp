@@ -0,0 +1,659 @@
+#include "ObjImporter.h"
+#include "MappedFile.h"
+#include "TaskPool.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+
+using namespace Pinball;
+
+namespace
+{
+	// Face corner: 0-based file-wide position & normal indices (-1 if the corner has no normal)
+	struct Corner
+	{
+		int position;
+		int normal;
+		// Number of corners of the face, on its first corner (0 on the others)
+		int faceSize;
+	};
+
+	// A negative (relative) index, stored as an index local to its chunk until the chunks' offsets are known
+	struct Fixup
+	{
+		size_t corner;
+		bool normal;
+	};
+
+	// "o" or "g" line: the corners from firstCorner onwards belong to the named group
+	struct GroupStart
+	{
+		std::string name;
+		size_t firstCorner;
+		bool isObject;
+	};
+
+	// What one thread parsed from its part of the file
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> positions;
+		std::vector<float> normals;
+		// Face corners, face after face (faces are triangulated when the meshes are filled)
+		std::vector<Corner> corners;
+		std::vector<Fixup> fixups;
+		std::vector<GroupStart> groups;
+	};
+
+	// Powers of ten used by Assimp's fast_atof, to parse numbers to the same floats
+	const double DecimalTable[16] = {
+		0.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001, 0.00000001, 0.000000001,
+		0.0000000001, 0.00000000001, 0.000000000001, 0.0000000000001, 0.00000000000001, 0.000000000000001
+	};
+	// Decimals Assimp reads before ignoring the rest
+	const unsigned int RelevantDecimals = 15;
+
+	bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	// Reads up to maxDigits decimal digits (skipping any after those), and returns how many were read in digits
+	uint64_t readDigits(const char*& c, const char* end, unsigned int maxDigits, unsigned int& digits)
+	{
+		uint64_t value = 0;
+		digits = 0;
+		while (c < end && isDigit(*c))
+		{
+			if (digits < maxDigits)
+			{
+				value = value * 10 + (uint64_t)(*c - '0');
+				digits++;
+			}
+			c++;
+		}
+		return value;
+	}
+
+	// Same algorithm as Assimp's fast_atoreal_move<float>, so both importers produce bit-identical vertices
+	float readFloat(const char*& c, const char* end)
+	{
+		bool negative = c < end && *c == '-';
+		if (c < end && (*c == '-' || *c == '+'))
+		{
+			c++;
+		}
+
+		unsigned int digits;
+		float value = (float)readDigits(c, end, 20, digits);
+
+		if (c + 1 < end && (*c == '.' || *c == ',') && isDigit(c[1]))
+		{
+			c++;
+			double fraction = (double)readDigits(c, end, RelevantDecimals, digits);
+			fraction *= DecimalTable[digits];
+			value += (float)fraction;
+		}
+		else if (c < end && *c == '.')
+		{
+			c++;
+		}
+
+		if (c < end && (*c == 'e' || *c == 'E'))
+		{
+			c++;
+			bool negativeExponent = c < end && *c == '-';
+			if (c < end && (*c == '-' || *c == '+'))
+			{
+				c++;
+			}
+			float exponent = (float)readDigits(c, end, 20, digits);
+			value *= std::pow(10.0f, negativeExponent ? -exponent : exponent);
+		}
+
+		return negative ? -value : value;
+	}
+
+	int readInt(const char*& c, const char* end)
+	{
+		bool negative = c < end && *c == '-';
+		if (c < end && (*c == '-' || *c == '+'))
+		{
+			c++;
+		}
+		unsigned int digits;
+		int value = (int)readDigits(c, end, 10, digits);
+		return negative ? -value : value;
+	}
+
+	void skipSpaces(const char*& c, const char* end)
+	{
+		while (c < end && isSpace(*c))
+		{
+			c++;
+		}
+	}
+
+	// Rest of the line, without trailing whitespace
+	std::string readName(const char*& c, const char* end)
+	{
+		skipSpaces(c, end);
+		const char* start = c;
+		while (c < end && *c != '\n' && *c != '\r')
+		{
+			c++;
+		}
+		const char* last = c;
+		while (last > start && isSpace(last[-1]))
+		{
+			last--;
+		}
+		return std::string(start, last);
+	}
+
+	void readVector(const char*& c, const char* end, std::vector<float>& out)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			skipSpaces(c, end);
+			out.push_back(readFloat(c, end));
+		}
+	}
+
+	// Converts a 1-based OBJ index to a 0-based one. Relative (negative) indices are made local to the chunk and recorded for fixing up later.
+	int resolveIndex(int index, size_t localCount, Chunk& chunk, bool normal)
+	{
+		if (index > 0)
+		{
+			return index - 1;
+		}
+
+		Fixup fixup = { chunk.corners.size(), normal };
+		chunk.fixups.push_back(fixup);
+		return (int)localCount + index;
+	}
+
+	void readFace(const char*& c, const char* end, Chunk& chunk)
+	{
+		std::vector<Corner> polygon;
+		std::vector<bool> relativePosition, relativeNormal;
+
+		while (true)
+		{
+			skipSpaces(c, end);
+			if (c >= end || !(isDigit(*c) || *c == '-' || *c == '+'))
+			{
+				break;
+			}
+
+			int position = readInt(c, end);
+			int normal = 0;
+			if (c < end && *c == '/')
+			{
+				c++;
+				// Texture coordinate, ignored
+				if (c < end && *c != '/')
+				{
+					readInt(c, end);
+				}
+				if (c < end && *c == '/')
+				{
+					c++;
+					normal = readInt(c, end);
+				}
+			}
+
+			Corner corner = { position, normal, 0 };
+			polygon.push_back(corner);
+
+			// Skip anything else up to the next corner
+			while (c < end && !isSpace(*c) && *c != '\n' && *c != '\r')
+			{
+				c++;
+			}
+		}
+
+		// Lines & points aren't faces
+		if (polygon.size() < 3)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < polygon.size(); i++)
+		{
+			Corner corner;
+			corner.position = resolveIndex(polygon[i].position, chunk.positions.size() / 3, chunk, false);
+			corner.normal = polygon[i].normal == 0 ? -1 : resolveIndex(polygon[i].normal, chunk.normals.size() / 3, chunk, true);
+			corner.faceSize = i == 0 ? (int)polygon.size() : 0;
+			chunk.corners.push_back(corner);
+		}
+	}
+
+	// First corner of a quad's split, as aiProcess_Triangulate picks it: the concave corner if there is one
+	size_t quadStart(const Vertex* quad)
+	{
+		for (size_t i = 0; i < 4; i++)
+		{
+			const Vertex& v = quad[i];
+			const Vertex& v0 = quad[(i + 3) % 4];
+			const Vertex& v1 = quad[(i + 2) % 4];
+			const Vertex& v2 = quad[(i + 1) % 4];
+
+			float left[3] = { v0.pX() - v.pX(), v0.pY() - v.pY(), v0.pZ() - v.pZ() };
+			float diagonal[3] = { v1.pX() - v.pX(), v1.pY() - v.pY(), v1.pZ() - v.pZ() };
+			float right[3] = { v2.pX() - v.pX(), v2.pY() - v.pY(), v2.pZ() - v.pZ() };
+			for (float* edge : { left, diagonal, right })
+			{
+				float length = std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+				edge[0] /= length;
+				edge[1] /= length;
+				edge[2] /= length;
+			}
+
+			float angle = std::acos(left[0] * diagonal[0] + left[1] * diagonal[1] + left[2] * diagonal[2])
+				+ std::acos(right[0] * diagonal[0] + right[1] * diagonal[1] + right[2] * diagonal[2]);
+			if (angle > 3.1415926538f)
+			{
+				return i;
+			}
+		}
+		return 0;
+	}
+
+	void parseChunk(Chunk& chunk)
+	{
+		const char* c = chunk.begin;
+		const char* end = chunk.end;
+
+		while (c < end)
+		{
+			skipSpaces(c, end);
+			if (c < end)
+			{
+				if (c + 1 < end && c[0] == 'v' && isSpace(c[1]))
+				{
+					c += 2;
+					readVector(c, end, chunk.positions);
+				}
+				else if (c + 2 < end && c[0] == 'v' && c[1] == 'n' && isSpace(c[2]))
+				{
+					c += 3;
+					readVector(c, end, chunk.normals);
+				}
+				else if (c + 1 < end && c[0] == 'f' && isSpace(c[1]))
+				{
+					c += 2;
+					readFace(c, end, chunk);
+				}
+				else if (c + 1 < end && (c[0] == 'o' || c[0] == 'g') && isSpace(c[1]))
+				{
+					bool isObject = c[0] == 'o';
+					c += 2;
+					GroupStart group = { readName(c, end), chunk.corners.size(), isObject };
+					chunk.groups.push_back(group);
+				}
+			}
+
+			// Next line
+			while (c < end && *c != '\n')
+			{
+				c++;
+			}
+			c++;
+		}
+	}
+
+	// Corners [first, last) of a chunk that belong to a group
+	struct CornerRange
+	{
+		size_t chunk;
+		size_t first, last;
+	};
+
+	struct Group
+	{
+		std::string name;
+		std::vector<CornerRange> ranges;
+	};
+}
+
+bool ObjImporter::import(const std::string& filePath, std::vector<ObjImporter::ImportedMesh>& meshes, unsigned int threadCount)
+{
+	meshes.clear();
+
+	std::unique_ptr<MappedFile> file = MappedFile::open(filePath);
+	if (!file)
+	{
+		return false;
+	}
+
+	import(Span<const unsigned char>(file->Data(), file->Size()), meshes, threadCount);
+	return true;
+}
+
+void ObjImporter::import(Span<const unsigned char> contents, std::vector<ObjImporter::ImportedMesh>& meshes, unsigned int threadCount)
+{
+	meshes.clear();
+
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	}
+
+	// Split into chunks of at least 256 KB, ending on line breaks
+	const char* data = (const char*)contents.data();
+	const char* dataEnd = data + contents.size();
+	const size_t minChunkSize = 256 * 1024;
+	size_t chunkCount = contents.size() / minChunkSize + 1;
+	chunkCount = chunkCount < threadCount ? chunkCount : threadCount;
+
+	std::vector<Chunk> chunks(chunkCount);
+	const char* chunkBegin = data;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = (i + 1 == chunkCount) ? dataEnd : data + contents.size() * (i + 1) / chunkCount;
+		if (chunkEnd < chunkBegin)
+		{
+			chunkEnd = chunkBegin;
+		}
+		while (chunkEnd < dataEnd && chunkEnd[-1] != '\n')
+		{
+			chunkEnd++;
+		}
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	TaskPool::parallelFor(chunkCount, threadCount, [&](size_t i) { parseChunk(chunks[i]); });
+
+	// Concatenate positions & normals, and make the chunks' indices file-wide
+	size_t positionCount = 0, normalCount = 0;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		positionCount += chunks[i].positions.size();
+		normalCount += chunks[i].normals.size();
+	}
+	std::vector<float> positions, normals;
+	positions.reserve(positionCount);
+	normals.reserve(normalCount);
+
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		Chunk& chunk = chunks[i];
+		for (size_t j = 0; j < chunk.fixups.size(); j++)
+		{
+			Corner& corner = chunk.corners[chunk.fixups[j].corner];
+			if (chunk.fixups[j].normal)
+			{
+				corner.normal += (int)(normals.size() / 3);
+			}
+			else
+			{
+				corner.position += (int)(positions.size() / 3);
+			}
+		}
+
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.normals);
+	}
+
+	// Collect each group's corners across chunks. Like Assimp, "g" starts a new group unless it names the current one,
+	// and "o" continues an earlier object of the same name.
+	std::vector<Group> groups;
+	int current = -1;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const Chunk& chunk = chunks[i];
+		size_t first = 0;
+		for (size_t j = 0; j <= chunk.groups.size(); j++)
+		{
+			size_t last = (j < chunk.groups.size()) ? chunk.groups[j].firstCorner : chunk.corners.size();
+			if (last > first)
+			{
+				if (current < 0)
+				{
+					Group group;
+					group.name = "defaultobject";
+					groups.push_back(group);
+					current = (int)groups.size() - 1;
+				}
+				CornerRange range = { i, first, last };
+				groups[current].ranges.push_back(range);
+			}
+			first = last;
+
+			if (j < chunk.groups.size())
+			{
+				const GroupStart& start = chunk.groups[j];
+				if (current >= 0 && groups[current].name == start.name)
+				{
+					continue;
+				}
+
+				current = -1;
+				if (start.isObject)
+				{
+					for (size_t k = 0; k < groups.size(); k++)
+					{
+						if (groups[k].name == start.name)
+						{
+							current = (int)k;
+						}
+					}
+				}
+				if (current < 0)
+				{
+					Group group;
+					group.name = start.name;
+					groups.push_back(group);
+					current = (int)groups.size() - 1;
+				}
+			}
+		}
+	}
+
+	// Groups without faces don't make meshes
+	std::vector<Group> nonEmpty;
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		if (!groups[i].ranges.empty())
+		{
+			nonEmpty.push_back(std::move(groups[i]));
+		}
+	}
+
+	// One vertex per face corner, as Assimp does (triangulating doesn't add any); Mesh welds them afterwards
+	meshes.resize(nonEmpty.size());
+	const int maxPosition = (int)(positions.size() / 3), maxNormal = (int)(normals.size() / 3);
+	TaskPool::parallelFor(nonEmpty.size(), threadCount, [&](size_t i)
+	{
+		const Group& group = nonEmpty[i];
+		ImportedMesh& mesh = meshes[i];
+		mesh.name = group.name;
+
+		size_t cornerCount = 0, triangleCount = 0;
+		for (size_t j = 0; j < group.ranges.size(); j++)
+		{
+			const CornerRange& range = group.ranges[j];
+			const std::vector<Corner>& corners = chunks[range.chunk].corners;
+			cornerCount += range.last - range.first;
+			for (size_t k = range.first; k < range.last; k++)
+			{
+				triangleCount += corners[k].faceSize > 0 ? corners[k].faceSize - 2 : 0;
+			}
+		}
+		mesh.vertices.reserve(cornerCount);
+		mesh.indices.reserve(triangleCount * 3);
+
+		for (size_t j = 0; j < group.ranges.size(); j++)
+		{
+			const CornerRange& range = group.ranges[j];
+			const std::vector<Corner>& corners = chunks[range.chunk].corners;
+			// Ranges start on a face's first corner (groups only change between faces)
+			for (size_t face = range.first; face < range.last; face += corners[face].faceSize)
+			{
+				size_t faceSize = (size_t)corners[face].faceSize;
+				unsigned int base = (unsigned int)mesh.vertices.size();
+				for (size_t k = face; k < face + faceSize; k++)
+				{
+					const Corner& corner = corners[k];
+					// Out of range indices read as the origin / no normal rather than failing the whole file
+					const float* p = (corner.position >= 0 && corner.position < maxPosition) ? &positions[corner.position * 3] : nullptr;
+					const float* n = (corner.normal >= 0 && corner.normal < maxNormal) ? &normals[corner.normal * 3] : nullptr;
+					mesh.vertices.emplace_back(p ? p[0] : 0.0f, p ? p[1] : 0.0f, p ? p[2] : 0.0f, n ? n[0] : 0.0f, n ? n[1] : 0.0f, n ? n[2] : 0.0f);
+				}
+
+				// Triangulated like aiProcess_Triangulate does: quads are split along the diagonal from their concave corner (if any),
+				// other polygons are fanned from their first corner. Assimp ear-clips polygons of more than 4 corners, so those may split differently.
+				size_t start = faceSize == 4 ? quadStart(&mesh.vertices[base]) : 0;
+				for (size_t t = 1; t + 1 < faceSize; t++)
+				{
+					mesh.indices.push_back(base + (unsigned int)start);
+					mesh.indices.push_back(base + (unsigned int)((start + t) % faceSize));
+					mesh.indices.push_back(base + (unsigned int)((start + t + 1) % faceSize));
+				}
+			}
+		}
+	});
+}
+
+namespace
+{
+	// Writes a grid of quads split into objects of about 10k faces each, until the file is about bytes long
+	void writeSynthetic(const std::string& filePath, size_t bytes)
+	{
+		std::ofstream out(filePath, std::ios::trunc);
+		out << "# Synthetic OBJ benchmark file" << std::endl;
+
+		const int gridSize = 100;
+		for (int object = 0; out.tellp() < (std::streamoff)bytes; object++)
+		{
+			out << "o Synthetic_Object." << object << std::endl;
+			for (int z = 0; z <= gridSize; z++)
+			{
+				for (int x = 0; x <= gridSize; x++)
+				{
+					out << "v " << x * 0.013f << " " << (object % 17) * 0.37f + x * z * 0.0001f << " " << z * -0.029f << std::endl;
+				}
+			}
+			out << "vn 0.0000 1.0000 0.0000" << std::endl << "vn 0.0000 0.7071 0.7071" << std::endl;
+
+			// Indices relative to the end of this object's vertices, so the file can be cut into chunks anywhere
+			const int vertexCount = (gridSize + 1) * (gridSize + 1);
+			for (int z = 0; z < gridSize; z++)
+			{
+				for (int x = 0; x < gridSize; x++)
+				{
+					int i = z * (gridSize + 1) + x - vertexCount;
+					int n = (x + z) % 2 - 2;
+					out << "f " << i << "//" << n << " " << i + 1 << "//" << n << " " << i + gridSize + 2 << "//" << n << " " << i + gridSize + 1 << "//" << n << std::endl;
+				}
+			}
+		}
+	}
+
+	// Compares the meshes against Assimp's, bit for bit
+	bool sameAsAssimp(const std::vector<ObjImporter::ImportedMesh>& meshes, const aiScene* scene)
+	{
+		if (meshes.size() != scene->mNumMeshes || scene->mRootNode->mNumChildren < scene->mNumMeshes)
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const ObjImporter::ImportedMesh& mesh = meshes[i];
+			const aiMesh* other = scene->mMeshes[i];
+			if (mesh.name != scene->mRootNode->mChildren[i]->mName.C_Str() || mesh.vertices.size() != other->mNumVertices || mesh.indices.size() != other->mNumFaces * 3)
+			{
+				return false;
+			}
+
+			for (size_t j = 0; j < mesh.vertices.size(); j++)
+			{
+				const float* data = mesh.vertices[j].GetData();
+				if (memcmp(data, &other->mVertices[j], 3 * sizeof(float)) != 0 || (other->mNormals && memcmp(data + 3, &other->mNormals[j], 3 * sizeof(float)) != 0))
+				{
+					return false;
+				}
+			}
+
+			for (size_t j = 0; j < other->mNumFaces; j++)
+			{
+				if (other->mFaces[j].mNumIndices != 3 || memcmp(&mesh.indices[j * 3], other->mFaces[j].mIndices, 3 * sizeof(unsigned int)) != 0)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+void ObjImporter::benchmark(const std::vector<std::string>& filePaths, size_t syntheticBytes)
+{
+	std::vector<std::string> files = filePaths;
+	const std::string syntheticPath = "ObjImporterBenchmark.obj";
+	if (syntheticBytes > 0)
+	{
+		std::cout << "Writing " << syntheticBytes / (1024 * 1024) << " MB synthetic file " << syntheticPath << std::endl;
+		writeSynthetic(syntheticPath, syntheticBytes);
+		files.push_back(syntheticPath);
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+	std::cout << "OBJ import benchmark (" << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		std::vector<ImportedMesh> meshes;
+
+		auto start = Clock::now();
+		bool read = import(files[i], meshes, 1);
+		auto mid = Clock::now();
+		read = read && import(files[i], meshes);
+		auto end = Clock::now();
+
+		if (!read)
+		{
+			std::cout << "  " << files[i] << ": can't be read" << std::endl;
+			continue;
+		}
+
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(files[i], aiProcess_Triangulate);
+		auto assimpEnd = Clock::now();
+
+		double singleMs = std::chrono::duration<double, std::milli>(mid - start).count();
+		double parallelMs = std::chrono::duration<double, std::milli>(end - mid).count();
+		double assimpMs = std::chrono::duration<double, std::milli>(assimpEnd - end).count();
+		bool match = scene && scene->mRootNode && sameAsAssimp(meshes, scene);
+
+		std::cout << "  " << files[i] << ": " << meshes.size() << " meshes, Assimp " << assimpMs << " ms, 1 thread " << singleMs << " ms ("
+			<< assimpMs / singleMs << "x), all threads " << parallelMs << " ms (" << assimpMs / parallelMs << "x)" << (match ? "" : ", RESULTS DIFFER") << std::endl;
+	}
+
+	if (syntheticBytes > 0)
+	{
+		std::remove(syntheticPath.c_str());
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Vertex.h"
+#include "Span.h"
+#include <string>
+#include <vector>
+
+namespace Pinball
+{
+	// Wavefront OBJ parser, an alternative to Assimp for Mesh::fromFile (see Mesh::ImportBackend).
+	// The file is memory-mapped and split into line-aligned chunks that are parsed in parallel;
+	// the chunks are then stitched together and the objects' vertex buffers are filled in parallel.
+	// Meant to produce the same meshes as Assimp's OBJ importer with aiProcess_Triangulate: one mesh per "o"/"g" group with faces,
+	// one vertex per face corner (position + normal), triangles & quads split the way Assimp splits them.
+	// Polygons of more than 4 corners are fan-triangulated, where Assimp ear-clips them, so files with those may triangulate differently.
+	// Texture coordinates, materials, smoothing groups, lines & points are ignored. benchmark checks the result against Assimp.
+	namespace ObjImporter
+	{
+		struct ImportedMesh
+		{
+			// Untrimmed group name ("defaultobject" for faces before any group, like Assimp)
+			std::string name;
+			std::vector<Vertex> vertices;
+			std::vector<unsigned int> indices;
+		};
+
+		// Parses the OBJ file at filePath into meshes, in file order. Uses every hardware thread if threadCount is 0.
+		// Returns false (with meshes left empty) if the file can't be read.
+		bool import(const std::string& filePath, std::vector<ImportedMesh>& meshes, unsigned int threadCount = 0);
+		// Parses OBJ file contents already in memory (eg. a mapped ResourcePack)
+		void import(Span<const unsigned char> contents, std::vector<ImportedMesh>& meshes, unsigned int threadCount = 0);
+
+		// Times this importer (single & multi-threaded) against Assimp on each file, and checks both produce the same meshes.
+		// Also generates & measures a synthetic OBJ file of about syntheticBytes (skipped if 0).
+		void benchmark(const std::vector<std::string>& filePaths, size_t syntheticBytes);
+	}
+}
@@ -1,9 +1,33 @@
 #include "Particle.h"
+#include "AssetRegistry.h"
+#include "Primitives.h"
 #include <random>
 
 using namespace Pinball;
 
-Mesh* Particle::_SparkMesh = nullptr;
+namespace
+{
+	// Generated at compile time, see Primitives.h
+	constexpr auto sSparkSphere = Primitives::makeSphere<8, 4>(0.05f);
+}
+
+MeshAsset Particle::sparkMesh(physx::PxCooking* cooking)
+{
+	return AssetRegistry::Global().GetMesh("Spark", [cooking]()
+	{
+		Mesh mesh = Mesh::fromStatic(sSparkSphere, cooking, Mesh::MeshType::Sphere);
+		mesh.Name("Spark");
+		mesh.SetVertexFormat(Mesh::VertexFormat::HalfFloat);
+		// Sparks close to the camera use the full sphere, the many smaller ones on screen use its simplified levels of detail.
+		mesh.GenerateLods(Mesh::MaxLodCount);
+		return mesh;
+	});
+}
+
+void Particle::PrewarmMeshes(physx::PxCooking* cooking)
+{
+	sparkMesh(cooking);
+}
 
 Particle::Particle(physx::PxCooking* cooking, physx::PxVec3 origin, ParticleType type)
 {
@@ -13,17 +37,12 @@ Particle::Particle(physx::PxCooking* cooking, physx::PxVec3 origin, ParticleType
 	case ParticleType::ePARTICLE_SPARK:
 		mDuration = 0.33f;
 
-		// Initialise the spark mesh if it hasn't been initialised yet. It should be of fairly low complexity.
-		if (_SparkMesh == nullptr)
-		{
-			_SparkMesh = new Mesh(Mesh::createSphere(cooking, 0.05f, 4, 2));
-		}
-
-		// Reuse the mesh
-		Geometry(*_SparkMesh);
-
 		// Disable collision for particles for better performance.
+		// Set first, so every spark gets the same shared shape (and material) straight away.
 		SetupFiltering(FilterGroup::ePARTICLE, 0);
+
+		// Reuse the mesh (shared, not copied)
+		Geometry(sparkMesh(cooking));
 	}
 
 	Transform(physx::PxTransform(origin));
@@ -16,9 +16,12 @@ namespace Pinball {
 		bool mKill; // should this particle be deleted?
 		bool mFirstFrame; // is this the first frame of the particle's lifetime?
 
-		// Cached meshes to reuse
-		static Mesh* _SparkMesh;
+		// Shared spark mesh, from the primitive cache
+		static MeshAsset sparkMesh(physx::PxCooking* cooking);
 	public:
+		// Builds the particle meshes ahead of time, so the first particles spawned don't stall the frame
+		static void PrewarmMeshes(physx::PxCooking* cooking);
+
 		// Creates a particle of a given type at a given point in the scene.
 		Particle(physx::PxCooking* cooking, physx::PxVec3 origin, ParticleType type);
 
@@ -0,0 +1,214 @@
+#include "PhysicsRegistry.h"
+
+using namespace Pinball;
+
+namespace
+{
+	// Appends a value's bytes to a key (only used with types that have no padding)
+	template<typename T> void appendKey(std::string& key, const T& value)
+	{
+		key.append((const char*)&value, sizeof(T));
+	}
+
+	void appendKey(std::string& key, const physx::PxMeshScale& scale)
+	{
+		appendKey(key, scale.scale.x);
+		appendKey(key, scale.scale.y);
+		appendKey(key, scale.scale.z);
+		appendKey(key, scale.rotation.x);
+		appendKey(key, scale.rotation.y);
+		appendKey(key, scale.rotation.z);
+		appendKey(key, scale.rotation.w);
+	}
+}
+
+PhysicsRegistry::PhysicsRegistry()
+{
+	mMaterialHits = mMaterialMisses = mShapeHits = mShapeMisses = 0;
+}
+
+PhysicsRegistry& PhysicsRegistry::Global()
+{
+	static PhysicsRegistry registry;
+	return registry;
+}
+
+void PhysicsRegistry::prune()
+{
+	for (auto it = mShapes.begin(); it != mShapes.end();)
+	{
+		it = it->second.expired() ? mShapes.erase(it) : std::next(it);
+	}
+	for (auto it = mMaterials.begin(); it != mMaterials.end();)
+	{
+		it = it->second.expired() ? mMaterials.erase(it) : std::next(it);
+	}
+}
+
+std::string PhysicsRegistry::shapeKey(const physx::PxGeometry& geometry, const physx::PxMaterial* material, const physx::PxTransform& localPose, const physx::PxFilterData& filterData)
+{
+	std::string key;
+	appendKey(key, (int)geometry.getType());
+	switch (geometry.getType())
+	{
+	case physx::PxGeometryType::eSPHERE:
+		appendKey(key, static_cast<const physx::PxSphereGeometry&>(geometry).radius);
+		break;
+	case physx::PxGeometryType::ePLANE:
+		break;
+	case physx::PxGeometryType::eCAPSULE:
+	{
+		const physx::PxCapsuleGeometry& capsule = static_cast<const physx::PxCapsuleGeometry&>(geometry);
+		appendKey(key, capsule.radius);
+		appendKey(key, capsule.halfHeight);
+		break;
+	}
+	case physx::PxGeometryType::eBOX:
+	{
+		const physx::PxBoxGeometry& box = static_cast<const physx::PxBoxGeometry&>(geometry);
+		appendKey(key, box.halfExtents.x);
+		appendKey(key, box.halfExtents.y);
+		appendKey(key, box.halfExtents.z);
+		break;
+	}
+	case physx::PxGeometryType::eCONVEXMESH:
+	{
+		const physx::PxConvexMeshGeometry& convex = static_cast<const physx::PxConvexMeshGeometry&>(geometry);
+		appendKey(key, convex.convexMesh);
+		appendKey(key, convex.scale);
+		appendKey(key, (physx::PxU32)convex.meshFlags);
+		break;
+	}
+	case physx::PxGeometryType::eTRIANGLEMESH:
+	{
+		const physx::PxTriangleMeshGeometry& triangles = static_cast<const physx::PxTriangleMeshGeometry&>(geometry);
+		appendKey(key, triangles.triangleMesh);
+		appendKey(key, triangles.scale);
+		appendKey(key, (physx::PxU32)triangles.meshFlags);
+		break;
+	}
+	case physx::PxGeometryType::eHEIGHTFIELD:
+	{
+		const physx::PxHeightFieldGeometry& heightField = static_cast<const physx::PxHeightFieldGeometry&>(geometry);
+		appendKey(key, heightField.heightField);
+		appendKey(key, heightField.heightScale);
+		appendKey(key, heightField.rowScale);
+		appendKey(key, heightField.columnScale);
+		appendKey(key, (physx::PxU32)heightField.heightFieldFlags);
+		break;
+	}
+	default:
+		return std::string();
+	}
+
+	appendKey(key, material);
+	appendKey(key, localPose.p.x);
+	appendKey(key, localPose.p.y);
+	appendKey(key, localPose.p.z);
+	appendKey(key, localPose.q.x);
+	appendKey(key, localPose.q.y);
+	appendKey(key, localPose.q.z);
+	appendKey(key, localPose.q.w);
+	appendKey(key, filterData.word0);
+	appendKey(key, filterData.word1);
+	appendKey(key, filterData.word2);
+	appendKey(key, filterData.word3);
+	return key;
+}
+
+MaterialHandle PhysicsRegistry::Material(float staticFriction, float dynamicFriction, float restitution)
+{
+	std::string key;
+	appendKey(key, staticFriction);
+	appendKey(key, dynamicFriction);
+	appendKey(key, restitution);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	MaterialHandle material = mMaterials[key].lock();
+	if (material)
+	{
+		mMaterialHits++;
+		return material;
+	}
+
+	physx::PxMaterial* pxMaterial = PxGetPhysics().createMaterial(staticFriction, dynamicFriction, restitution);
+	if (pxMaterial == nullptr)
+	{
+		mMaterials.erase(key);
+		return nullptr;
+	}
+	mMaterialMisses++;
+	// Shapes made with the material keep their own PhysX reference to it
+	material = MaterialHandle(pxMaterial, [](physx::PxMaterial* released) { released->release(); });
+	mMaterials[key] = material;
+	prune();
+	return material;
+}
+
+ShapeHandle PhysicsRegistry::Shape(const physx::PxGeometry& geometry, const MaterialHandle& material, const physx::PxTransform& localPose, const physx::PxFilterData& filterData)
+{
+	std::string key = shapeKey(geometry, material.get(), localPose, filterData);
+	if (key.empty() || !material)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	ShapeHandle shape = mShapes[key].lock();
+	if (shape)
+	{
+		mShapeHits++;
+		return shape;
+	}
+
+	physx::PxShape* pxShape = PxGetPhysics().createShape(geometry, *material, false);
+	if (pxShape == nullptr)
+	{
+		mShapes.erase(key);
+		return nullptr;
+	}
+	pxShape->setLocalPose(localPose);
+	pxShape->setSimulationFilterData(filterData);
+	mShapeMisses++;
+	// The handle holds the material, so it stays registered (and shared) for as long as a shape uses it.
+	// Actors hold their own PhysX references to their shapes, so a shape outlives its handles until its actors are released.
+	// (The deleter lives as long as the registry's weak reference, so it drops the material itself.)
+	shape = ShapeHandle(pxShape, [held = material](physx::PxShape* released) mutable { released->release(); held.reset(); });
+	mShapes[key] = shape;
+	prune();
+	return shape;
+}
+
+PhysicsRegistry::Stats PhysicsRegistry::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	prune();
+
+	Stats stats;
+	stats.materialHits = mMaterialHits;
+	stats.materialMisses = mMaterialMisses;
+	stats.shapeHits = mShapeHits;
+	stats.shapeMisses = mShapeMisses;
+	stats.materials = mMaterials.size();
+	stats.shapes = mShapes.size();
+	return stats;
+}
+
+void PhysicsRegistry::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaterialHits = mMaterialMisses = mShapeHits = mShapeMisses = 0;
+}
+
+PhysicsRegistry::LiveCounts PhysicsRegistry::liveCounts()
+{
+	physx::PxPhysics& physics = PxGetPhysics();
+
+	LiveCounts counts;
+	counts.materials = physics.getNbMaterials();
+	counts.shapes = physics.getNbShapes();
+	counts.convexMeshes = physics.getNbConvexMeshes();
+	counts.triangleMeshes = physics.getNbTriangleMeshes();
+	counts.heightFields = physics.getNbHeightFields();
+	return counts;
+}
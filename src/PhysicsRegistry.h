@@ -0,0 +1,68 @@
+#pragma once
+
+#include <PxPhysicsAPI.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <memory>
+
+namespace Pinball
+{
+	typedef std::shared_ptr<physx::PxMaterial> MaterialHandle;
+	typedef std::shared_ptr<physx::PxShape> ShapeHandle;
+
+	// Shared PhysX materials & shapes. Materials are deduplicated by friction & restitution, shapes by geometry (including its scale),
+	// material, local pose & filter data, so eg. every spark shares one sphere shape and one material instead of creating its own.
+	// A material or shape is released when its last handle is dropped (shapes stay alive while they're attached to an actor).
+	// Thread-safe.
+	class PhysicsRegistry
+	{
+	public:
+		struct Stats
+		{
+			// Requests served by a material/shape that was already alive
+			size_t materialHits, shapeHits;
+			// Materials/shapes created
+			size_t materialMisses, shapeMisses;
+			// Distinct materials & shapes currently handed out
+			size_t materials, shapes;
+		};
+
+		// Live PhysX objects, whether they came from the registry or not
+		struct LiveCounts
+		{
+			physx::PxU32 materials, shapes, convexMeshes, triangleMeshes, heightFields;
+		};
+	private:
+		// The registry doesn't keep anything alive itself: entries expire with their last handle
+		std::map<std::string, std::weak_ptr<physx::PxMaterial>> mMaterials;
+		std::map<std::string, std::weak_ptr<physx::PxShape>> mShapes;
+		std::mutex mMutex;
+		size_t mMaterialHits, mMaterialMisses, mShapeHits, mShapeMisses;
+
+		// Drops the entries whose objects were released. Expects mMutex to be held.
+		void prune();
+
+		// Everything that makes two shapes interchangeable. Empty if the geometry type isn't supported.
+		static std::string shapeKey(const physx::PxGeometry& geometry, const physx::PxMaterial* material, const physx::PxTransform& localPose, const physx::PxFilterData& filterData);
+	public:
+		PhysicsRegistry();
+		PhysicsRegistry(const PhysicsRegistry&) = delete;
+		PhysicsRegistry& operator=(const PhysicsRegistry&) = delete;
+
+		// Registry used by the game
+		static PhysicsRegistry& Global();
+
+		// The material with these properties, created on first use
+		MaterialHandle Material(float staticFriction, float dynamicFriction, float restitution);
+		// A (non-exclusive) simulation shape, created on first use. Shared shapes can't be changed once they're attached to an actor in a scene,
+		// so everything about the shape is part of the request: to change its filter data, request another shape and swap it in.
+		ShapeHandle Shape(const physx::PxGeometry& geometry, const MaterialHandle& material, const physx::PxTransform& localPose = physx::PxTransform(physx::PxIdentity), const physx::PxFilterData& filterData = physx::PxFilterData());
+
+		Stats GetStats();
+		void ResetStats();
+
+		// Counts of the PhysX objects currently alive, to check they stay flat over a long session
+		static LiveCounts liveCounts();
+	};
+}
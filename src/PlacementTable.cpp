@@ -0,0 +1,166 @@
+#include "PlacementTable.h"
+#include "ResourcePack.h"
+#include "Util.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+using namespace Pinball;
+
+namespace
+{
+	// File layout (native endianness):
+	//	FileHeader
+	//	Material * materialCount
+	//	Placement * placementCount, sorted by nameHash (8 byte aligned)
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t materialCount;
+		uint32_t placementCount;
+		// Source file the placements were baked from
+		uint64_t sourceSize;
+		int64_t sourceTime;
+	};
+
+	const char Magic[4] = { 'P', 'B', 'P', 'L' };
+
+	size_t placementsOffset(uint32_t materialCount)
+	{
+		size_t offset = sizeof(FileHeader) + materialCount * sizeof(PlacementTable::Material);
+		return (offset + alignof(PlacementTable::Placement) - 1) / alignof(PlacementTable::Placement) * alignof(PlacementTable::Placement);
+	}
+}
+
+PlacementTable::PlacementTable()
+{
+}
+
+std::string PlacementTable::pathFor(const std::string& sourcePath)
+{
+	return sourcePath + ".placements";
+}
+
+bool PlacementTable::parse(const std::string& sourcePath, Span<const unsigned char> data, Span<const unsigned char> packedSource)
+{
+	if (data.size() < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data.data(), sizeof(FileHeader));
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version)
+	{
+		std::cout << "Placement table " << pathFor(sourcePath) << " is from another version, ignoring it." << std::endl;
+		return false;
+	}
+
+	// Packed tables are baked right before packing (see --build-pack), so they're checked against the source's packed size & time
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	bool found = packedSource.empty() ? statFile(sourcePath, sourceSize, sourceTime) : ResourcePack::findSourceInfo(sourcePath, sourceSize, sourceTime);
+	if (!found || sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+	{
+		std::cout << "Placement table " << pathFor(sourcePath) << " is out of date." << std::endl;
+		return false;
+	}
+
+	size_t offset = placementsOffset(header.materialCount);
+	if (offset > data.size() || (uint64_t)header.placementCount * sizeof(Placement) > data.size() - offset)
+	{
+		std::cout << "Placement table " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+		return false;
+	}
+
+	mMaterials = Span<const Material>((const Material*)(data.data() + sizeof(FileHeader)), header.materialCount);
+	mPlacements = Span<const Placement>((const Placement*)(data.data() + offset), header.placementCount);
+
+	for (size_t i = 0; i < mPlacements.size(); i++)
+	{
+		if (mPlacements[i].material >= mMaterials.size() || (i > 0 && mPlacements[i - 1].nameHash > mPlacements[i].nameHash))
+		{
+			std::cout << "Placement table " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<const PlacementTable> PlacementTable::open(const std::string& sourcePath)
+{
+	std::shared_ptr<PlacementTable> table(new PlacementTable());
+
+	// Packed tables stay mapped as long as their pack is mounted, ie. until the program exits
+	Span<const unsigned char> packedSource = ResourcePack::find(sourcePath);
+	if (!packedSource.empty())
+	{
+		if (!table->parse(sourcePath, ResourcePack::find(pathFor(sourcePath)), packedSource))
+		{
+			return nullptr;
+		}
+		return table;
+	}
+
+	table->mFile = MappedFile::open(pathFor(sourcePath));
+	if (!table->mFile || !table->parse(sourcePath, Span<const unsigned char>(table->mFile->Data(), table->mFile->Size()), Span<const unsigned char>()))
+	{
+		return nullptr;
+	}
+	return table;
+}
+
+bool PlacementTable::write(const std::string& sourcePath, const std::vector<PlacementTable::Material>& materials, std::vector<PlacementTable::Placement> placements)
+{
+	FileHeader header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.materialCount = (uint32_t)materials.size();
+	header.placementCount = (uint32_t)placements.size();
+	if (!statFile(sourcePath, header.sourceSize, header.sourceTime))
+	{
+		return false;
+	}
+
+	std::sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) { return a.nameHash < b.nameHash; });
+
+	std::string path = pathFor(sourcePath);
+	// Levels loading in the background may map the table while it's rebaked
+	bool written = writeFileAtomic(path, [&](std::ostream& out)
+	{
+		out.write((const char*)&header, sizeof(FileHeader));
+		out.write((const char*)materials.data(), materials.size() * sizeof(Material));
+
+		const char padding[alignof(Placement)] = {};
+		out.write(padding, placementsOffset(header.materialCount) - sizeof(FileHeader) - materials.size() * sizeof(Material));
+		out.write((const char*)placements.data(), placements.size() * sizeof(Placement));
+	});
+	if (!written)
+	{
+		std::cerr << "Failed to write placement table " << path << std::endl;
+		return false;
+	}
+
+	std::cout << "Baked " << placements.size() << " placements into " << path << std::endl;
+	return true;
+}
+
+const PlacementTable::Placement* PlacementTable::Find(const std::string& name) const
+{
+	uint64_t hash = hashBytes(name.data(), name.size());
+	const Placement* placement = std::lower_bound(mPlacements.begin(), mPlacements.end(), hash, [](const Placement& p, uint64_t h) { return p.nameHash < h; });
+	return (placement != mPlacements.end() && placement->nameHash == hash) ? placement : nullptr;
+}
+
+Span<const PlacementTable::Material> PlacementTable::Materials() const
+{
+	return mMaterials;
+}
+
+Span<const PlacementTable::Placement> PlacementTable::Placements() const
+{
+	return mPlacements;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Span.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace Pinball
+{
+	// Compact binary table of where each level object goes and how it collides, baked from the level's origins model
+	// (see Level::bakePlacements) and written next to it as <origins>.placements.
+	// Loading it is a single read of the mapped file, so placing the level doesn't import any meshes.
+	// Placements are sorted by name hash for lookup; the table is rebaked when the origins file's size & modification time change.
+	class PlacementTable
+	{
+	public:
+		// Bump whenever the file layout changes
+		static const uint32_t Version = 2;
+
+		// Physics material, referenced by index from placements
+		struct Material
+		{
+			float staticFriction, dynamicFriction, restitution;
+		};
+
+		struct Placement
+		{
+			enum Flags
+			{
+				// Flat surface that may collide through a heightfield sampled from it (see Level::SetHeightFieldCellSize)
+				HeightField = 1
+			};
+
+			// hashBytes of the object's name
+			uint64_t nameHash;
+			float position[3];
+			// Quaternion (x, y, z, w)
+			float rotation[4];
+			float scale[3];
+			// Index into Materials()
+			uint32_t material;
+			// Collision filtering (see GameObject::SetupFiltering), none if filterGroup is 0
+			uint32_t filterGroup, filterMask;
+			// Combination of Flags
+			uint32_t flags;
+		};
+	private:
+		// Mapped table file, or null if the table is read from a mounted ResourcePack
+		std::unique_ptr<MappedFile> mFile;
+		Span<const Material> mMaterials;
+		Span<const Placement> mPlacements;
+
+		PlacementTable();
+
+		// Checks the header against the source file (or its packed contents, if packedSource isn't empty) and finds the tables
+		bool parse(const std::string& sourcePath, Span<const unsigned char> data, Span<const unsigned char> packedSource);
+	public:
+		// Path of the table baked from a model file
+		static std::string pathFor(const std::string& sourcePath);
+
+		// Maps the table baked from sourcePath. Returns nullptr if there's none, or it's out of date or unreadable.
+		static std::shared_ptr<const PlacementTable> open(const std::string& sourcePath);
+
+		// Writes the table for sourcePath. Placements are sorted by name hash.
+		static bool write(const std::string& sourcePath, const std::vector<Material>& materials, std::vector<Placement> placements);
+
+		// Placement of the named object, or nullptr
+		const Placement* Find(const std::string& name) const;
+
+		Span<const Material> Materials() const;
+		Span<const Placement> Placements() const;
+	};
+}
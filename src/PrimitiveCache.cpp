@@ -0,0 +1,139 @@
+#include "PrimitiveCache.h"
+#include <tuple>
+
+using namespace Pinball;
+
+namespace
+{
+	// Primitives the game requests with fixed parameters, generated at compile time (see Primitives.h).
+	// Matching requests wrap this static data instead of tessellating.
+	// Default box (eg. the debug box)
+	constexpr auto sUnitBox = Primitives::makeBox(1.0f);
+
+	template <size_t VertexCount, size_t IndexCount>
+	bool matches(const Primitives::MeshData<VertexCount, IndexCount>& data, float size, size_t stacks, size_t slices)
+	{
+		return data.size == size && data.stacks == stacks && data.slices == slices;
+	}
+}
+
+bool PrimitiveCache::Key::operator<(const PrimitiveCache::Key& other) const
+{
+	return std::tie(type, size, stacks, slices, vertexFormat, lodCount) < std::tie(other.type, other.size, other.stacks, other.slices, other.vertexFormat, other.lodCount);
+}
+
+PrimitiveCache::PrimitiveCache()
+{
+	mHits = 0;
+	mMisses = 0;
+}
+
+PrimitiveCache& PrimitiveCache::Global()
+{
+	static PrimitiveCache cache;
+	return cache;
+}
+
+Mesh PrimitiveCache::build(const PrimitiveCache::Key& key, physx::PxCooking* cooking)
+{
+	Mesh ret;
+	switch (key.type)
+	{
+	case Mesh::MeshType::Sphere:
+		ret = Mesh::createSphere(cooking, key.size, key.stacks, key.slices);
+		ret.Name("Sphere");
+		break;
+	case Mesh::MeshType::Box:
+		if (matches(sUnitBox, key.size, 0, 0))
+		{
+			ret = Mesh::fromStatic(sUnitBox, cooking, Mesh::MeshType::Box);
+		}
+		else
+		{
+			ret = Mesh::createBox(cooking, key.size);
+		}
+		ret.Name("Box");
+		break;
+	default:
+		ret = Mesh::createPlane(cooking);
+		ret.Name("Plane");
+		break;
+	}
+
+	ret.SetVertexFormat((Mesh::VertexFormat)key.vertexFormat);
+	if (key.lodCount > 1)
+	{
+		ret.GenerateLods(key.lodCount);
+	}
+
+	return ret;
+}
+
+MeshAsset PrimitiveCache::get(const PrimitiveCache::Key& key, physx::PxCooking* cooking)
+{
+	std::shared_future<MeshAsset> entry;
+	std::promise<MeshAsset> promise;
+	bool isNew = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto it = mMeshes.find(key);
+		if (it != mMeshes.end())
+		{
+			mHits++;
+			entry = it->second;
+		}
+		else
+		{
+			mMisses++;
+			entry = mMeshes[key] = promise.get_future().share();
+			isNew = true;
+		}
+	}
+
+	// Built outside the lock, so requests for other primitives aren't held up
+	if (isNew)
+	{
+		promise.set_value(Mesh::makeAsset(build(key, cooking)));
+	}
+
+	return entry.get();
+}
+
+MeshAsset PrimitiveCache::Sphere(physx::PxCooking* cooking, float radius, size_t stacks, size_t slices, Mesh::VertexFormat format, size_t lodCount)
+{
+	Key key = { Mesh::MeshType::Sphere, radius, stacks, slices, format, lodCount };
+	return get(key, cooking);
+}
+
+MeshAsset PrimitiveCache::Box(physx::PxCooking* cooking, float size, Mesh::VertexFormat format)
+{
+	Key key = { Mesh::MeshType::Box, size, 0, 0, format, 1 };
+	return get(key, cooking);
+}
+
+MeshAsset PrimitiveCache::Plane(physx::PxCooking* cooking)
+{
+	Key key = { Mesh::MeshType::Plane, 0.0f, 0, 0, Mesh::VertexFormat::Float, 1 };
+	return get(key, cooking);
+}
+
+PrimitiveCache::Stats PrimitiveCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Stats ret = { mHits, mMisses, mMeshes.size() };
+	return ret;
+}
+
+void PrimitiveCache::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mHits = 0;
+	mMisses = 0;
+}
+
+void PrimitiveCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMeshes.clear();
+}
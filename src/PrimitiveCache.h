@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Mesh.h"
+#include <map>
+#include <mutex>
+#include <future>
+
+namespace Pinball
+{
+	// Shared procedural primitives (render & PhysX geometry), built once per set of shape parameters.
+	// Requesting the same primitive again returns the existing asset, so eg. 1000 spheres of the same size cost one tessellation and one PhysX geometry.
+	// Thread-safe: concurrent requests for the same primitive wait for a single build.
+	class PrimitiveCache
+	{
+	public:
+		struct Stats
+		{
+			// Requests served from the cache
+			size_t hits;
+			// Requests that built a new primitive
+			size_t misses;
+			// Primitives currently cached
+			size_t entries;
+		};
+	private:
+		// Shape parameters, plus the render options that change the built asset
+		struct Key
+		{
+			int type;
+			float size;
+			size_t stacks, slices;
+			int vertexFormat;
+			size_t lodCount;
+
+			bool operator<(const Key& other) const;
+		};
+
+		// Entries are inserted before they are built, so other threads requesting the same key wait on the future instead of building it again
+		std::map<Key, std::shared_future<MeshAsset>> mMeshes;
+		std::mutex mMutex;
+		size_t mHits, mMisses;
+
+		MeshAsset get(const Key& key, physx::PxCooking* cooking);
+		static Mesh build(const Key& key, physx::PxCooking* cooking);
+	public:
+		PrimitiveCache();
+
+		// Process-wide cache used by the game
+		static PrimitiveCache& Global();
+
+		// Returns the shared sphere/box/plane mesh with the given parameters, building it on first use (see Mesh::createSphere etc.).
+		// Calling these at startup pre-warms the cache.
+		MeshAsset Sphere(physx::PxCooking* cooking, float radius = 1.0f, size_t stacks = 16, size_t slices = 8, Mesh::VertexFormat format = Mesh::VertexFormat::Float, size_t lodCount = 1);
+		MeshAsset Box(physx::PxCooking* cooking, float size = 1.0f, Mesh::VertexFormat format = Mesh::VertexFormat::Float);
+		MeshAsset Plane(physx::PxCooking* cooking);
+
+		Stats GetStats();
+		void ResetStats();
+
+		// Drops the cache's references. Meshes still used by GameObjects stay alive until they're released.
+		void Clear();
+	};
+}
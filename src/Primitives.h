@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Vertex.h"
+#include <cstddef>
+
+namespace Pinball
+{
+	// Primitive meshes generated at compile time. Initialise a static constexpr variable with one of the make functions, eg.
+	//	static constexpr auto sparkSphere = Primitives::makeSphere<8, 4>(0.05f);
+	// and its vertices & indices are emitted as static data, so nothing is tessellated at runtime.
+	// Mesh::fromStatic wraps that storage without copying it.
+	// Everything here is constexpr, so it has to stay in this header.
+	namespace Primitives
+	{
+		// Vertex & index arrays of a generated primitive
+		template <size_t VertexCount, size_t IndexCount>
+		struct MeshData
+		{
+			Vertex vertices[VertexCount];
+			unsigned int indices[IndexCount];
+
+			// Parameters the primitive was generated with: sphere radius or box edge length, and tessellation (spheres only)
+			float size;
+			size_t stacks, slices;
+		};
+
+		constexpr double Pi = 3.14159265358979323846;
+
+		// Taylor series sine, as std::sin isn't constexpr. Accurate to about 1e-9 once reduced to [-pi, pi].
+		constexpr double sine(double x)
+		{
+			double turns = x / (2.0 * Pi);
+			long long wholeTurns = (long long)(turns < 0.0 ? turns - 0.5 : turns + 0.5);
+			x -= wholeTurns * 2.0 * Pi;
+
+			double term = x;
+			double sum = x;
+			for (int n = 1; n < 12; n++)
+			{
+				term *= -x * x / ((2 * n) * (2 * n + 1));
+				sum += term;
+			}
+			return sum;
+		}
+
+		constexpr double cosine(double x)
+		{
+			return sine(x + Pi / 2.0);
+		}
+
+		// Same rings as Mesh::createSphere: Stacks + 1 rings of Slices * 2 + 1 vertices (the last one closes the seam).
+		// The pole rows only have one triangle per quad, the other one would be degenerate.
+		template <size_t Stacks, size_t Slices>
+		using SphereData = MeshData<(Stacks + 1) * (Slices * 2 + 1), (Stacks - 1) * Slices * 2 * 6>;
+
+		// UV sphere centred on the origin, with outward unit normals
+		template <size_t Stacks, size_t Slices>
+		constexpr SphereData<Stacks, Slices> makeSphere(float radius)
+		{
+			static_assert(Stacks >= 2 && Slices >= 1, "A sphere needs at least 2 stacks and 1 slice");
+
+			SphereData<Stacks, Slices> data{};
+			data.size = radius;
+			data.stacks = Stacks;
+			data.slices = Slices;
+
+			const size_t ringVertices = Slices * 2 + 1;
+
+			size_t v = 0;
+			for (size_t y = 0; y <= Stacks; y++)
+			{
+				double theta = Pi * y / Stacks;
+				double sinTheta = sine(theta);
+				double cosTheta = cosine(theta);
+
+				for (size_t x = 0; x < ringVertices; x++)
+				{
+					double phi = Pi * x / Slices;
+					float nx = (float)(cosine(phi) * sinTheta);
+					float ny = (float)cosTheta;
+					float nz = (float)(sine(phi) * sinTheta);
+					// Exact poles, so they weld like Mesh::createSphere's (the series leaves sine(pi) slightly off 0)
+					if (y == 0 || y == Stacks)
+					{
+						nx = 0.0f;
+						ny = y == 0 ? 1.0f : -1.0f;
+						nz = 0.0f;
+					}
+
+					data.vertices[v++] = Vertex(nx * radius, ny * radius, nz * radius, nx, ny, nz);
+				}
+			}
+
+			size_t i = 0;
+			for (size_t y = 0; y < Stacks; y++)
+			{
+				for (size_t x = 0; x < Slices * 2; x++)
+				{
+					unsigned int top = (unsigned int)(y * ringVertices + x);
+					unsigned int bottom = (unsigned int)((y + 1) * ringVertices + x);
+
+					// Collapses onto the bottom pole in the last row
+					if (y != Stacks - 1)
+					{
+						data.indices[i++] = top;
+						data.indices[i++] = bottom;
+						data.indices[i++] = bottom + 1;
+					}
+
+					// Collapses onto the top pole in the first row
+					if (y != 0)
+					{
+						data.indices[i++] = bottom + 1;
+						data.indices[i++] = top + 1;
+						data.indices[i++] = top;
+					}
+				}
+			}
+
+			return data;
+		}
+
+		typedef MeshData<8, 36> BoxData;
+
+		// Cube centred on the origin, matching Mesh::createBox once welded: faces share the corner vertices, whose normals point out of the corners
+		constexpr BoxData makeBox(float size)
+		{
+			BoxData data{};
+			data.size = size;
+
+			// Corner i is at +halfSize on x if (i & 1), on y if (i & 2) and on z if (i & 4)
+			float halfSize = size / 2.0f;
+			for (size_t i = 0; i < 8; i++)
+			{
+				float x = (i & 1) ? halfSize : -halfSize;
+				float y = (i & 2) ? halfSize : -halfSize;
+				float z = (i & 4) ? halfSize : -halfSize;
+				data.vertices[i] = Vertex(x, y, z, x, y, z);
+			}
+
+			// Front, bottom, back, top, left, right: same triangles & winding as Mesh::createBox
+			const unsigned int faces[36] = {
+				4, 5, 6, 6, 7, 5,
+				0, 4, 5, 1, 0, 5,
+				0, 1, 2, 2, 3, 1,
+				2, 6, 7, 3, 2, 7,
+				0, 4, 6, 6, 2, 0,
+				1, 5, 7, 7, 3, 1
+			};
+			for (size_t i = 0; i < 36; i++)
+			{
+				data.indices[i] = faces[i];
+			}
+
+			return data;
+		}
+	}
+}
@@ -1,11 +1,97 @@
 #include "Renderer.h"
+#include <cstdint>
+#include <cstring>
 
 using namespace Pinball;
 
+namespace
+{
+	// Octahedral normal encoding: projects the unit normal onto an octahedron and unfolds it into [-1, 1]^2
+	glm::vec2 octEncode(glm::vec3 n)
+	{
+		float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (sum <= 0.0f)
+		{
+			return glm::vec2(0.0f);
+		}
+		n /= sum;
+
+		glm::vec2 ret(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			ret.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			ret.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return ret;
+	}
+
+	// Packs the mesh's vertices in the given Mesh::VertexFormat. Compact formats store positions in [-1, 1] relative to the bounding box.
+	std::vector<unsigned char> packVertices(Span<const Vertex> vertices, const Bounds& bounds, int format, float* scale, float* bias)
+	{
+		std::vector<unsigned char> ret;
+
+		if (format == Mesh::VertexFormat::Float)
+		{
+			const unsigned char* data = (const unsigned char*)vertices.data();
+			ret.assign(data, data + vertices.bytes());
+			for (int c = 0; c < 3; c++)
+			{
+				scale[c] = 1.0f;
+				bias[c] = 0.0f;
+			}
+			return ret;
+		}
+
+		// Per-mesh scale & bias from the bounding box
+		physx::PxVec3 boxCenter = bounds.Center(), boxHalfExtents = bounds.HalfExtents();
+		glm::vec3 center(boxCenter.x, boxCenter.y, boxCenter.z);
+		glm::vec3 halfExtents = glm::max(glm::vec3(boxHalfExtents.x, boxHalfExtents.y, boxHalfExtents.z), glm::vec3(1e-6f));
+		for (int c = 0; c < 3; c++)
+		{
+			scale[c] = halfExtents[c];
+			bias[c] = center[c];
+		}
+
+		// Both compact formats are 8 bytes of position followed by 4 bytes of normal
+		const size_t stride = 12;
+		ret.resize(vertices.size() * stride);
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			const Vertex& v = vertices[i];
+			glm::vec4 p(glm::clamp((glm::vec3(v.pX(), v.pY(), v.pZ()) - center) / halfExtents, -1.0f, 1.0f), 0.0f);
+			glm::vec3 n(v.nX(), v.nY(), v.nZ());
+
+			uint64_t packedPos;
+			uint32_t packedNormal;
+			if (format == Mesh::VertexFormat::HalfFloat)
+			{
+				packedPos = glm::packHalf4x16(p);
+				packedNormal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+			}
+			else
+			{
+				packedPos = glm::packSnorm4x16(p);
+				packedNormal = glm::packSnorm2x16(octEncode(n));
+			}
+
+			std::memcpy(&ret[i * stride], &packedPos, sizeof(packedPos));
+			std::memcpy(&ret[i * stride + sizeof(packedPos)], &packedNormal, sizeof(packedNormal));
+		}
+
+		return ret;
+	}
+}
+
 bool Renderer::mInitialised = false;
 
 Renderer::Renderer(std::string name, int w, int h)
 {
+	mForcedVertexFormat = -1;
+	mLodErrorThreshold = 1.0f;
+	mFrameStats = mStats = { 0, 0, 0, 0, 0.0 };
+	mTimerPending[0] = mTimerPending[1] = false;
+	mFrameIndex = 0;
+
 	Init();
 	Create(name, w, h);
 }
@@ -56,15 +142,17 @@ void Renderer::Create(std::string name, int width, int height)
 	glGenBuffers(1, &mIBO);
 	glGenVertexArrays(1, &mVAO);
 
+	// GPU timer queries for frame statistics
+	glGenQueries(2, mTimerQueries);
+
 	// Display window
 	glfwShowWindow(mWindow);
 }
 
 void Renderer::Draw(GameObject& obj, Camera cam, std::vector<Light> lights, GLuint* shader)
 {
-	// Retrieve raw vertex & index buffers from the GameObject
-	float* verts = obj.Geometry().GetRenderData();
-	unsigned int* indices = obj.Geometry().GetIndices();
+	// Retrieve the GPU buffers for the GameObject's shared mesh (uploaded on first use)
+	const GpuMesh& gpuMesh = getGpuMesh(obj.GeometryAsset());
 
 	// If a different shader has been provided than from the last draw call, change to that.
 	if (shader != nullptr)
@@ -76,18 +164,8 @@ void Renderer::Draw(GameObject& obj, Camera cam, std::vector<Light> lights, GLui
 		}
 	}
 
-	// Bind vertex array & buffer objects and feed with geometry data
-	glBindVertexArray(mVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-	glBufferData(GL_ARRAY_BUFFER, obj.Geometry().GetCount() * 6 * sizeof(float), verts, GL_STATIC_DRAW);
-	// Vertex Position
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-	// Vertex Normals (for lighting)
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (GLvoid*)(sizeof(float)*3));
-	glEnableVertexAttribArray(1);
-	// Unbind vertex buffer object
-	//glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// Bind the mesh's vertex array (vertex & index buffers are already attached to it)
+	glBindVertexArray(gpuMesh.vao);
 
 	// Get model, view & projection matrices
 	glm::mat4* mvp = getTransform(obj, cam);
@@ -98,51 +176,85 @@ void Renderer::Draw(GameObject& obj, Camera cam, std::vector<Light> lights, GLui
 	glUniformMatrix4fv(glGetUniformLocation(mCurrentShader, "_View"), 1, false, view);
 	glUniformMatrix4fv(glGetUniformLocation(mCurrentShader, "_Proj"), 1, false, proj);
 	
-	// Pass object colour to shader
-	float* color = obj.Geometry().Color();
-	glUniform3fv(glGetUniformLocation(mCurrentShader, "_Color"), 1, color);
+	// Pass vertex decode parameters & object colour to shader
+	setVertexDecode(gpuMesh);
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_Color"), 1, obj.Color());
 
 	// Pass scene lighting to shader
-	// Sun light
-	float* sunDir = lights[0].Dir();
-	float* sunCol = lights[0].Color();
-	glUniform3fv(glGetUniformLocation(mCurrentShader, "_Sun.direction"), 1, sunDir);
-	glUniform3fv(glGetUniformLocation(mCurrentShader, "_Sun.color"), 1, sunCol);
-	// Point lights
-	for (size_t i = 1; i < lights.size(); i++)
+	setLights(lights);
+
+	// Indexed draw call for this object's triangles, at the level of detail its size on screen calls for.
+	// The index buffer is bound while the mesh's own VAO is bound, so it is recorded in that VAO's state.
+	drawLod(gpuMesh, selectLod(obj, gpuMesh, mvp[1] * mvp[0]));
+
+	// Unbind vertex array object
+	glBindVertexArray(0);
+
+	// Cleanup to stop memory leaks
+	delete[] mvp;
+	delete[] model;
+	delete[] view;
+	delete[] proj;
+}
+
+void Renderer::DrawStatic(const StaticBatch& batch, Camera cam, std::vector<Light> lights, GLuint* shader)
+{
+	if (batch.IsEmpty())
 	{
-		float* plPos = lights[i].PointPos();
-		float* plCol = lights[i].Color();
+		return;
+	}
 
-		glUniform3fv(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].position").c_str()), 1, plPos);
-		glUniform3fv(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].color").c_str()), 1, plCol);
-		glUniform1f(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].kc").c_str()), lights[i].kc);
-		glUniform1f(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].kl").c_str()), lights[i].kl);
-		glUniform1f(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].kq").c_str()), lights[i].kq);
+	// Retrieve the GPU buffers for the batch (uploaded on first use, or again if it was rebuilt)
+	const GpuBatch& gpuBatch = getGpuBatch(batch);
 
-		delete[] plCol;
-		delete[] plPos;
+	// If a different shader has been provided than from the last draw call, change to that.
+	if (shader != nullptr)
+	{
+		if (mCurrentShader != *shader)
+		{
+			glUseProgram(*shader);
+			mCurrentShader = *shader;
+		}
 	}
 
-	// Set scene point light count. 
-	// This must not be greater than the maximum number of point lights defined in the fragment shader (POINT_LIGHT_COUNT)
-	glUniform1i(glGetUniformLocation(mCurrentShader, "_LightCount"), lights.size() - 1); // -1 as the sun light is in the same array but is a separate uniform
+	glBindVertexArray(gpuBatch.vao);
 
-	// Non-indexed draw call for this object's triangles
-	// Indexed draw exhibited severe flicker so all meshes are remapped to be unindexed on import (ie. contain duplicate triangles)
-	glDrawArrays(GL_TRIANGLES, 0, obj.Geometry().GetCount());
+	// The batch's vertices are in world space, so only view & projection matrices are needed
+	glm::mat4 view, proj;
+	getCameraTransform(cam, view, proj);
+	float* model = mat4ToRaw(glm::mat4(1.0f)), * viewRaw = mat4ToRaw(view), * projRaw = mat4ToRaw(proj);
+
+	// Uniforms shared by the whole batch are set once
+	glUniformMatrix4fv(glGetUniformLocation(mCurrentShader, "_Model"), 1, false, model);
+	glUniformMatrix4fv(glGetUniformLocation(mCurrentShader, "_View"), 1, false, viewRaw);
+	glUniformMatrix4fv(glGetUniformLocation(mCurrentShader, "_Proj"), 1, false, projRaw);
+
+	const float identityScale[3] = { 1.0f, 1.0f, 1.0f }, identityBias[3] = { 0.0f, 0.0f, 0.0f };
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_PosScale"), 1, identityScale);
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_PosBias"), 1, identityBias);
+	glUniform1i(glGetUniformLocation(mCurrentShader, "_OctNormals"), 0);
+
+	setLights(lights);
+
+	// One draw call per colour
+	const std::vector<StaticBatch::DrawRange>& ranges = batch.GetDrawRanges();
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		glUniform3fv(glGetUniformLocation(mCurrentShader, "_Color"), 1, ranges[i].color);
+		glDrawElements(GL_TRIANGLES, (GLsizei)ranges[i].indexCount, GL_UNSIGNED_INT, (GLvoid*)(ranges[i].indexOffset * sizeof(unsigned int)));
+
+		mFrameStats.drawCalls++;
+		mFrameStats.triangles += ranges[i].indexCount / 3;
+		mFrameStats.lodDrawCalls[0]++;
+		mFrameStats.lodTriangles[0] += ranges[i].indexCount / 3;
+	}
 
-	// Unbind vertex array object
 	glBindVertexArray(0);
 
 	// Cleanup to stop memory leaks
-	delete[] mvp;
 	delete[] model;
-	delete[] view;
-	delete[] proj;
-	delete[] verts;
-	delete[] sunDir;
-	delete[] sunCol;
+	delete[] viewRaw;
+	delete[] projRaw;
 }
 
 void Renderer::DrawParticles(Level& level, Camera cam, GLuint* shader)
@@ -150,10 +262,8 @@ void Renderer::DrawParticles(Level& level, Camera cam, GLuint* shader)
 	if (level.NbParticles() == 0)
 		return;
 
-	// Retrieve raw vertex & index buffers from the GameObject
-	float* verts = level.ParticleAt(0)->Geometry().GetData();
-	size_t vertCount = level.ParticleAt(0)->Geometry().GetCount();
-	unsigned int* indices = level.ParticleAt(0)->Geometry().GetIndices();
+	// Retrieve the GPU buffers for the first particle's mesh (all particles share it)
+	const GpuMesh& gpuMesh = getGpuMesh(level.ParticleAt(0)->GeometryAsset());
 
 	// If a different shader has been provided than from the last draw call, change to that.
 	if (shader != nullptr)
@@ -165,17 +275,13 @@ void Renderer::DrawParticles(Level& level, Camera cam, GLuint* shader)
 		}
 	}
 
+	// All particles share the mesh, so its decode parameters only need to be set once
+	setVertexDecode(gpuMesh);
+
 	for (size_t i = 0; i < level.NbParticles(); i++)
 	{
-		// Bind vertex array & buffer objects and feed with geometry data
-		glBindVertexArray(mVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-		glBufferData(GL_ARRAY_BUFFER, vertCount * 3 * sizeof(float), verts, GL_STATIC_DRAW);
-		// Vertex Position
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (GLvoid*)0);
-		glEnableVertexAttribArray(0);
-		// Unbind vertex buffer object
-		//glBindBuffer(GL_ARRAY_BUFFER, 0);
+		// Bind the mesh's vertex array (the spark shader only reads positions)
+		glBindVertexArray(gpuMesh.vao);
 
 		// Get model, view & projection matrices
 		glm::mat4* mvp = getTransform(*level.ParticleAt(i), cam);
@@ -194,9 +300,8 @@ void Renderer::DrawParticles(Level& level, Camera cam, GLuint* shader)
 		}
 		glUniform1f(glGetUniformLocation(mCurrentShader, "_Opacity"), opacity);
 
-		// Non-indexed draw call for this object's triangles
-		// Indexed draw exhibited severe flicker so all meshes are remapped to be unindexed on import (ie. contain duplicate triangles)
-		glDrawArrays(GL_TRIANGLES, 0, vertCount);
+		// Indexed draw call for this particle's triangles (sparks are small, so mostly drawn from the coarser levels of detail)
+		drawLod(gpuMesh, selectLod(*level.ParticleAt(i), gpuMesh, mvp[1] * mvp[0]));
 
 		// Unbind vertex array object
 		glBindVertexArray(0);
@@ -207,7 +312,6 @@ void Renderer::DrawParticles(Level& level, Camera cam, GLuint* shader)
 		delete[] view;
 		delete[] proj;
 	}
-	delete[] verts;
 }
 
 void Renderer::DrawImage(Image& img, float x, float y, float w, float h, GLuint* shader)
@@ -251,6 +355,454 @@ void Renderer::DrawImage(Image& img, float x, float y, float w, float h, GLuint*
 	glBindVertexArray(0);
 }
 
+const Renderer::GpuMesh& Renderer::getGpuMesh(const MeshAsset& mesh)
+{
+	auto it = mGpuMeshes.find(mesh.get());
+	if (it != mGpuMeshes.end())
+	{
+		if (!it->second.mesh.expired())
+		{
+			return it->second;
+		}
+		releaseGpuMesh(it->second);
+	}
+
+	GpuMesh gpuMesh;
+	mFrameStats.uploadedBytes += uploadMesh(mesh, (mForcedVertexFormat >= 0) ? mForcedVertexFormat : mesh->GetVertexFormat(), gpuMesh);
+	mFrameStats.residentVertexBytes += gpuMesh.vertexBytes;
+	createVertexArray(gpuMesh);
+
+	std::lock_guard<std::mutex> lock(mGpuMeshesMutex);
+	return mGpuMeshes[mesh.get()] = gpuMesh;
+}
+
+void Renderer::releaseGpuMesh(GpuMesh& gpuMesh)
+{
+	glDeleteVertexArrays(1, &gpuMesh.vao);
+	glDeleteBuffers(1, &gpuMesh.vbo);
+	glDeleteBuffers(1, &gpuMesh.ibo);
+	gpuMesh.vao = gpuMesh.vbo = gpuMesh.ibo = 0;
+	mFrameStats.residentVertexBytes -= gpuMesh.vertexBytes;
+	gpuMesh.vertexBytes = 0;
+}
+
+size_t Renderer::uploadMesh(const MeshAsset& mesh, int format, GpuMesh& gpuMesh)
+{
+	gpuMesh.mesh = mesh;
+	gpuMesh.bounds = mesh->GetBounds();
+	gpuMesh.indexCount = mesh->GetIndexCount();
+	gpuMesh.format = format;
+	gpuMesh.vao = 0;
+
+	glGenBuffers(1, &gpuMesh.vbo);
+	glGenBuffers(1, &gpuMesh.ibo);
+
+	// Upload vertex & index data once
+	std::vector<unsigned char> verts = packVertices(mesh->GetVertices(), mesh->GetBounds(), gpuMesh.format, gpuMesh.posScale, gpuMesh.posBias);
+	gpuMesh.vertexBytes = verts.size();
+	glBindBuffer(GL_ARRAY_BUFFER, gpuMesh.vbo);
+	glBufferData(GL_ARRAY_BUFFER, verts.size(), verts.data(), GL_STATIC_DRAW);
+
+	// Full detail indices followed by the ones of the coarser levels of detail
+	Span<const unsigned int> indices = mesh->GetIndices();
+	Span<const unsigned int> lodIndices = mesh->GetLodIndices();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes() + lodIndices.bytes(), nullptr, GL_STATIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.bytes(), indices.data());
+	if (!lodIndices.empty())
+	{
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes(), lodIndices.bytes(), lodIndices.data());
+	}
+
+	for (size_t i = 0; i < mesh->GetLodCount(); i++)
+	{
+		gpuMesh.lods.push_back(mesh->GetLod(i));
+	}
+	if (gpuMesh.lods.empty())
+	{
+		Mesh::Lod lod = { 0, gpuMesh.indexCount, 0.0f };
+		gpuMesh.lods.push_back(lod);
+	}
+
+	return verts.size() + indices.bytes() + lodIndices.bytes();
+}
+
+void Renderer::createVertexArray(GpuMesh& gpuMesh)
+{
+	// The index buffer binding is stored in the VAO
+	glGenVertexArrays(1, &gpuMesh.vao);
+	glBindVertexArray(gpuMesh.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, gpuMesh.vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh.ibo);
+
+	switch (gpuMesh.format)
+	{
+	case Mesh::VertexFormat::HalfFloat:
+		// Vertex Position (4 halves, w is padding)
+		glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, 12, (GLvoid*)0);
+		// Vertex Normals (10_10_10_2, unpacked to [-1, 1])
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 12, (GLvoid*)8);
+		break;
+	case Mesh::VertexFormat::Snorm16Oct:
+		// Vertex Position (4 shorts, w is padding)
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, 12, (GLvoid*)0);
+		// Vertex Normals (octahedral, decoded in the vertex shader)
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, 12, (GLvoid*)8);
+		break;
+	default:
+		// Vertex Position
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		// Vertex Normals (for lighting)
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(float) * 3));
+		break;
+	}
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glBindVertexArray(0);
+}
+
+void Renderer::ReleaseMeshes()
+{
+	std::lock_guard<std::mutex> lock(mGpuMeshesMutex);
+	for (auto it = mGpuMeshes.begin(); it != mGpuMeshes.end(); it++)
+	{
+		glDeleteVertexArrays(1, &it->second.vao);
+		glDeleteBuffers(1, &it->second.vbo);
+		glDeleteBuffers(1, &it->second.ibo);
+	}
+	mGpuMeshes.clear();
+	mFrameStats.residentVertexBytes = 0;
+
+	for (auto it = mGpuBatches.begin(); it != mGpuBatches.end(); it++)
+	{
+		glDeleteVertexArrays(1, &it->second.vao);
+		glDeleteBuffers(1, &it->second.vbo);
+		glDeleteBuffers(1, &it->second.ibo);
+	}
+	mGpuBatches.clear();
+}
+
+void Renderer::ReleaseUnusedMeshes()
+{
+	std::lock_guard<std::mutex> lock(mGpuMeshesMutex);
+	for (auto it = mGpuMeshes.begin(); it != mGpuMeshes.end();)
+	{
+		if (it->second.mesh.expired())
+		{
+			releaseGpuMesh(it->second);
+			it = mGpuMeshes.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
+void Renderer::ReleaseBatch(const StaticBatch& batch)
+{
+	auto it = mGpuBatches.find(&batch);
+	if (it != mGpuBatches.end())
+	{
+		glDeleteVertexArrays(1, &it->second.vao);
+		glDeleteBuffers(1, &it->second.vbo);
+		glDeleteBuffers(1, &it->second.ibo);
+		mGpuBatches.erase(it);
+	}
+}
+
+GLFWwindow* Renderer::CreateSharedContext()
+{
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* context = glfwCreateWindow(1, 1, "Loader", nullptr, mWindow);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	return context;
+}
+
+Renderer::PreloadedLevel Renderer::PreloadLevel(Level& level, int forcedFormat)
+{
+	PreloadedLevel preloaded;
+	preloaded.uploadedBytes = 0;
+
+	// Meshes can be shared between objects (eg. bumpers), so each is uploaded once
+	std::unordered_map<const Mesh*, bool> uploaded;
+	for (size_t i = 0; i < level.NbActors(); i++)
+	{
+		GameObject* object = level.At(i);
+		if (object->GetPxActor() == nullptr || level.StaticGeometry().Contains(object))
+		{
+			continue;
+		}
+
+		MeshAsset mesh = object->GeometryAsset();
+		if (!mesh || !uploaded.emplace(mesh.get(), true).second)
+		{
+			continue;
+		}
+		{
+			// Already uploaded for the current level
+			std::lock_guard<std::mutex> lock(mGpuMeshesMutex);
+			auto resident = mGpuMeshes.find(mesh.get());
+			if (resident != mGpuMeshes.end() && resident->second.mesh.lock() == mesh)
+			{
+				continue;
+			}
+		}
+
+		GpuMesh gpuMesh;
+		preloaded.uploadedBytes += uploadMesh(mesh, (forcedFormat >= 0) ? forcedFormat : mesh->GetVertexFormat(), gpuMesh);
+		preloaded.meshes.push_back(gpuMesh);
+	}
+
+	preloaded.batch = &level.StaticGeometry();
+	preloaded.gpuBatch.vao = preloaded.gpuBatch.vbo = preloaded.gpuBatch.ibo = 0;
+	preloaded.gpuBatch.version = preloaded.batch->Version();
+	preloaded.uploadedBytes += uploadBatch(*preloaded.batch, preloaded.gpuBatch);
+
+	// Wait here rather than on the main thread, so adopting the buffers never stalls a frame
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(fence);
+
+	return preloaded;
+}
+
+void Renderer::AdoptLevel(Renderer::PreloadedLevel& preloaded)
+{
+	for (size_t i = 0; i < preloaded.meshes.size(); i++)
+	{
+		GpuMesh& gpuMesh = preloaded.meshes[i];
+
+		// Uploaded since the level was preloaded (eg. drawn by the current level), or in a format that's since been switched away from
+		MeshAsset mesh = gpuMesh.mesh.lock();
+		auto it = mesh ? mGpuMeshes.find(mesh.get()) : mGpuMeshes.end();
+		bool stale = mForcedVertexFormat >= 0 && gpuMesh.format != mForcedVertexFormat;
+		if (!mesh || stale || (it != mGpuMeshes.end() && !it->second.mesh.expired()))
+		{
+			glDeleteBuffers(1, &gpuMesh.vbo);
+			glDeleteBuffers(1, &gpuMesh.ibo);
+			continue;
+		}
+		if (it != mGpuMeshes.end())
+		{
+			// Left by an expired mesh at the same address
+			releaseGpuMesh(it->second);
+		}
+
+		createVertexArray(gpuMesh);
+		mFrameStats.residentVertexBytes += gpuMesh.vertexBytes;
+		std::lock_guard<std::mutex> lock(mGpuMeshesMutex);
+		mGpuMeshes[mesh.get()] = gpuMesh;
+	}
+	preloaded.meshes.clear();
+
+	if (preloaded.batch != nullptr)
+	{
+		ReleaseBatch(*preloaded.batch);
+		createVertexArray(preloaded.gpuBatch);
+		mGpuBatches[preloaded.batch] = preloaded.gpuBatch;
+		preloaded.batch = nullptr;
+	}
+}
+
+void Renderer::setVertexDecode(const GpuMesh& gpuMesh)
+{
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_PosScale"), 1, gpuMesh.posScale);
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_PosBias"), 1, gpuMesh.posBias);
+	glUniform1i(glGetUniformLocation(mCurrentShader, "_OctNormals"), gpuMesh.format == Mesh::VertexFormat::Snorm16Oct);
+}
+
+void Renderer::setLights(std::vector<Light>& lights)
+{
+	// Sun light
+	float* sunDir = lights[0].Dir();
+	float* sunCol = lights[0].Color();
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_Sun.direction"), 1, sunDir);
+	glUniform3fv(glGetUniformLocation(mCurrentShader, "_Sun.color"), 1, sunCol);
+	// Point lights
+	for (size_t i = 1; i < lights.size(); i++)
+	{
+		float* plPos = lights[i].PointPos();
+		float* plCol = lights[i].Color();
+
+		glUniform3fv(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].position").c_str()), 1, plPos);
+		glUniform3fv(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].color").c_str()), 1, plCol);
+		glUniform1f(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].kc").c_str()), lights[i].kc);
+		glUniform1f(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].kl").c_str()), lights[i].kl);
+		glUniform1f(glGetUniformLocation(mCurrentShader, (std::string("_Lights[") + std::to_string(i-1) + "].kq").c_str()), lights[i].kq);
+
+		delete[] plCol;
+		delete[] plPos;
+	}
+
+	// Set scene point light count. 
+	// This must not be greater than the maximum number of point lights defined in the fragment shader (POINT_LIGHT_COUNT)
+	glUniform1i(glGetUniformLocation(mCurrentShader, "_LightCount"), lights.size() - 1); // -1 as the sun light is in the same array but is a separate uniform
+
+
+	delete[] sunDir;
+	delete[] sunCol;
+}
+
+const Renderer::GpuBatch& Renderer::getGpuBatch(const StaticBatch& batch)
+{
+	GpuBatch& gpuBatch = mGpuBatches[&batch];
+	if (gpuBatch.vao != 0 && gpuBatch.version == batch.Version())
+	{
+		return gpuBatch;
+	}
+
+	gpuBatch.version = batch.Version();
+	mFrameStats.uploadedBytes += uploadBatch(batch, gpuBatch);
+	if (gpuBatch.vao == 0)
+	{
+		createVertexArray(gpuBatch);
+	}
+
+	return gpuBatch;
+}
+
+size_t Renderer::uploadBatch(const StaticBatch& batch, GpuBatch& gpuBatch)
+{
+	if (gpuBatch.vbo == 0)
+	{
+		glGenBuffers(1, &gpuBatch.vbo);
+		glGenBuffers(1, &gpuBatch.ibo);
+	}
+
+	Span<const Vertex> verts = batch.GetVertices();
+	glBindBuffer(GL_ARRAY_BUFFER, gpuBatch.vbo);
+	glBufferData(GL_ARRAY_BUFFER, verts.bytes(), verts.data(), GL_STATIC_DRAW);
+
+	Span<const unsigned int> indices = batch.GetIndices();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuBatch.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes(), indices.data(), GL_STATIC_DRAW);
+
+	return verts.bytes() + indices.bytes();
+}
+
+void Renderer::createVertexArray(GpuBatch& gpuBatch)
+{
+	// The batch is already in world space, so it's drawn from plain floats (no per-mesh position decode)
+	glGenVertexArrays(1, &gpuBatch.vao);
+	glBindVertexArray(gpuBatch.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, gpuBatch.vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuBatch.ibo);
+
+	// Vertex Position
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+	// Vertex Normals (for lighting)
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(float) * 3));
+	glEnableVertexAttribArray(1);
+
+	glBindVertexArray(0);
+}
+
+size_t Renderer::selectLod(GameObject& obj, const GpuMesh& gpuMesh, const glm::mat4& modelView)
+{
+	// A coarser level is only picked once its error is this fraction of the threshold, so objects near a switching distance don't flicker between levels
+	const float hysteresis = 0.75f;
+
+	const size_t lodCount = gpuMesh.lods.size();
+	if (lodCount == 1)
+	{
+		return 0;
+	}
+
+	// Pixels per mesh unit at the depth of the nearest point of the mesh's bounding sphere.
+	// The error is measured in mesh units, so the object's scale applies too.
+	const Bounds& bounds = gpuMesh.bounds;
+	float scale = std::fmax(obj.Scale().X(), std::fmax(obj.Scale().Y(), obj.Scale().Z()));
+	glm::vec4 sphereCenter = modelView * glm::vec4(bounds.sphereCenter.x, bounds.sphereCenter.y, bounds.sphereCenter.z, 1.0f);
+	float depth = std::fmax(-sphereCenter.z - bounds.sphereRadius * scale, 0.01f);
+	float pixelsPerUnit = scale * mHeight / (2.0f * depth * std::tan(glm::radians(FieldOfView) / 2.0f));
+
+	size_t lod = std::min((size_t)obj.LodLevel(), lodCount - 1);
+	while (lod > 0 && gpuMesh.lods[lod].error * pixelsPerUnit > mLodErrorThreshold)
+	{
+		lod--;
+	}
+	while (lod + 1 < lodCount && gpuMesh.lods[lod + 1].error * pixelsPerUnit < mLodErrorThreshold * hysteresis)
+	{
+		lod++;
+	}
+
+	obj.LodLevel((unsigned int)lod);
+	return lod;
+}
+
+void Renderer::drawLod(const GpuMesh& gpuMesh, size_t lod)
+{
+	const Mesh::Lod& range = gpuMesh.lods[lod];
+	glDrawElements(GL_TRIANGLES, (GLsizei)range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.indexOffset * sizeof(unsigned int)));
+
+	mFrameStats.drawCalls++;
+	mFrameStats.triangles += range.indexCount / 3;
+	mFrameStats.lodDrawCalls[lod]++;
+	mFrameStats.lodTriangles[lod] += range.indexCount / 3;
+}
+
+void Renderer::LodErrorThreshold(float pixels)
+{
+	mLodErrorThreshold = pixels;
+}
+
+void Renderer::ForceVertexFormat(int format)
+{
+	if (format >= Mesh::VertexFormat::VertexFormatCount)
+	{
+		format = -1;
+	}
+
+	if (format != mForcedVertexFormat)
+	{
+		mForcedVertexFormat = format;
+		ReleaseMeshes();
+	}
+}
+
+int Renderer::ForcedVertexFormat()
+{
+	return mForcedVertexFormat;
+}
+
+void Renderer::BeginFrame()
+{
+	// Counters restart every frame, except for what is currently resident on the GPU
+	size_t resident = mFrameStats.residentVertexBytes;
+	mFrameStats = { 0, 0, 0, resident, 0.0 };
+
+	glBeginQuery(GL_TIME_ELAPSED, mTimerQueries[mFrameIndex % 2]);
+}
+
+void Renderer::EndFrame()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	mTimerPending[mFrameIndex % 2] = true;
+
+	// Read back the previous frame's timer, which the GPU has most likely finished by now
+	double gpuTimeMs = mStats.gpuTimeMs;
+	unsigned int previous = (mFrameIndex + 1) % 2;
+	if (mTimerPending[previous])
+	{
+		GLuint64 elapsedNs = 0;
+		glGetQueryObjectui64v(mTimerQueries[previous], GL_QUERY_RESULT, &elapsedNs);
+		gpuTimeMs = elapsedNs / 1000000.0;
+		mTimerPending[previous] = false;
+	}
+
+	mStats = mFrameStats;
+	mStats.gpuTimeMs = gpuTimeMs;
+	mFrameIndex++;
+}
+
+const RenderStats& Renderer::Stats()
+{
+	return mStats;
+}
+
 GLFWwindow* Renderer::Window()
 {
 	return mWindow;
@@ -258,15 +810,59 @@ GLFWwindow* Renderer::Window()
 
 void Renderer::CreateTexture(Image& img)
 {
+	if (img.mTexture == 0)
+	{
+		glGenTextures(1, &img.mTexture);
+	}
 	glBindTexture(GL_TEXTURE_2D, img.mTexture);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	// Minified images sample their mip chain (nearest level & texel, so they keep their unfiltered look)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.mWidth, img.mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.mData);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	if (!img.mCache)
+	{
+		// Not cached (eg. decoded from a pack without its cache): build the mip chain here
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.mWidth, img.mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.mData);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		mFrameStats.uploadedBytes += (size_t)img.mWidth * img.mHeight * 4;
+		return;
+	}
+
+	// Every level is staged in one pixel buffer with a single copy out of the mapped cache, then the levels are specified from it
+	const std::vector<TextureCache::Level>& levels = img.mCache->Levels();
+	Span<const unsigned char> pixels = img.mCache->Pixels();
+
+	GLuint pbo;
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, pixels.size(), nullptr, GL_STREAM_DRAW);
+	void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, pixels.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (staging != nullptr)
+	{
+		memcpy(staging, pixels.data(), pixels.size());
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, pixels.size(), pixels.data(), GL_STREAM_DRAW);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		// With a pixel buffer bound, the data pointer is an offset into it
+		glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, levels[i].width, levels[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (const GLvoid*)levels[i].offset);
+	}
+
+	// The driver keeps the buffer's storage alive until the copies are done
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &pbo);
+
+	mFrameStats.uploadedBytes += pixels.size();
 }
 
 unsigned int Renderer::compileShader(std::string vSource, std::string fSource)
@@ -303,19 +899,21 @@ glm::mat4* Renderer::getTransform(GameObject& obj, Camera cam)
 	model *= glm::mat4_cast(modelRot);
 	model = glm::scale(model, glm::vec3(obj.Scale().X(), obj.Scale().Y(), obj.Scale().Z())); // TODO: no scaling for now
 
+	ret[0] = model;
+	getCameraTransform(cam, ret[1], ret[2]);
+
+	return ret;
+}
+
+void Renderer::getCameraTransform(Camera cam, glm::mat4& view, glm::mat4& proj)
+{
 	physx::PxVec3 camPos = cam.Position();
-	glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(camPos.x, camPos.y, camPos.z) * -1.0f);
+	view = glm::translate(glm::mat4(1.0f), glm::vec3(camPos.x, camPos.y, camPos.z) * -1.0f);
 	physx::PxQuat camOrient = cam.Orientation();
 	view *= glm::mat4_cast(glm::quat(camOrient.w, camOrient.x, camOrient.y, camOrient.z));
 	/*view = glm::rotate(view, glm::radians(camRot.x), glm::vec3(1.f, 0.f, 0.f));
 	view = glm::rotate(view, glm::radians(camRot.y), glm::vec3(0.f, 1.f, 0.f));
 	view = glm::rotate(view, glm::radians(camRot.z), glm::vec3(0.f, 0.f, 1.f));*/
 
-	glm::mat4 proj = glm::perspective(glm::radians(60.0f), (float)mWidth / (float)mHeight, 0.01f, 1000.0f);
-
-	ret[0] = model;
-	ret[1] = view;
-	ret[2] = proj;
-
-	return ret;
+	proj = glm::perspective(glm::radians(FieldOfView), (float)mWidth / (float)mHeight, 0.01f, 1000.0f);
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
 
 // OpenGL includes
 #include <GL/glew.h>
@@ -18,11 +21,13 @@
 #include <3rdparty/stb_image.h>
 
 #include "GameObject.h"
+#include "StaticBatch.h"
 #include "Particle.h"
 #include "Level.h"
 #include "Camera.h"
 #include "Light.h"
 #include "Util.h"
+#include "TextureCache.h"
 
 namespace Pinball
 {
@@ -33,14 +38,23 @@ namespace Pinball
 	private:
 		int mWidth, mHeight;
 		int mSpectrum;
+		// Decoded pixels, only kept if the image couldn't be cached
 		unsigned char* mData;
+		// Pixels & mip chain, mapped from the image's TextureCache
+		std::shared_ptr<const TextureCache> mCache;
 
 		unsigned int mTexture; // OpenGL texture handle for this image
 	public:
 		Image();
 		Image(std::string filePath);
+		// Frees the pixel data. Images own their pixels, so they can't be copied (share them through AssetRegistry instead).
+		~Image();
+		Image(const Image&) = delete;
+		Image& operator=(const Image&) = delete;
+		// Maps the image's TextureCache, or decodes the image (as RGBA8) and writes its cache if it has none
 		void Load(std::string filePath);
-		unsigned char* GetData();
+		// RGBA8 pixels of the full size image
+		const unsigned char* GetData();
 
 		// Returns OpenGL texture handle
 		unsigned int& GetTexture();
@@ -50,16 +64,116 @@ namespace Pinball
 		int Height();
 	};
 
+	// Draw & upload counters for the last complete frame (see Renderer::BeginFrame/EndFrame)
+	struct RenderStats
+	{
+		unsigned int drawCalls;
+		size_t triangles;
+		// Vertex + index bytes uploaded to the GPU during the frame
+		size_t uploadedBytes;
+		// Vertex bytes of all meshes currently uploaded
+		size_t residentVertexBytes;
+		// GPU time spent on the frame's draw calls. Measured with a timer query, so it lags a frame behind the other counters.
+		double gpuTimeMs;
+		// Draw calls & triangles drawn at each level of detail
+		unsigned int lodDrawCalls[Mesh::MaxLodCount];
+		size_t lodTriangles[Mesh::MaxLodCount];
+	};
+
 	class Renderer 
 	{
 	protected:
-		// Buffers
+		// Buffers (used for immediate geometry, eg. 2D images)
 		unsigned int mVAO, mVBO, mIBO;
 
+		// GPU-side copy of a mesh: its own vertex array, vertex buffer & index buffer, uploaded once.
+		struct GpuMesh
+		{
+			unsigned int vao, vbo, ibo;
+			size_t indexCount;
+
+			// Index ranges of the mesh's levels of detail in the index buffer (at least one)
+			std::vector<Mesh::Lod> lods;
+
+			// Layout the vertex buffer was uploaded in (Mesh::VertexFormat)
+			int format;
+			size_t vertexBytes;
+			// Position decode: position = stored * posScale + posBias (identity for Mesh::Float)
+			float posScale[3], posBias[3];
+
+			// Bounds of the mesh, for level of detail selection
+			Bounds bounds;
+			// Weak, so uploading a mesh doesn't keep it (or its AssetRegistry asset) alive.
+			// Once it expires, its address may be reused by another mesh, so the buffers are stale.
+			std::weak_ptr<const Mesh> mesh;
+		};
+
+		// Uploaded meshes, by mesh address
+		std::unordered_map<const Mesh*, GpuMesh> mGpuMeshes;
+		// Held while mGpuMeshes is changed, as PreloadLevel reads it from the loading thread (the main thread is the only writer, so it reads without it)
+		std::mutex mGpuMeshesMutex;
+
+		// Returns the GPU buffers for the mesh, uploading it on first use (or again if the buffers were left by an expired mesh at the same address)
+		const GpuMesh& getGpuMesh(const MeshAsset& mesh);
+		// Deletes an uploaded mesh's buffers & vertex array
+		void releaseGpuMesh(GpuMesh& gpuMesh);
+
+		// Creates & fills the mesh's vertex & index buffers in the given Mesh::VertexFormat. Doesn't create its vertex array,
+		// as those can't be shared between contexts. Returns the number of bytes uploaded.
+		size_t uploadMesh(const MeshAsset& mesh, int format, GpuMesh& gpuMesh);
+		// Creates the vertex array of an uploaded mesh, in the current context
+		void createVertexArray(GpuMesh& gpuMesh);
+
+		// Passes the mesh's vertex decode parameters to the current shader
+		void setVertexDecode(const GpuMesh& gpuMesh);
+
+		// Passes the scene lights to the current shader (the first one is the sun)
+		void setLights(std::vector<Light>& lights);
+
+		// GPU-side copy of a StaticBatch
+		struct GpuBatch
+		{
+			unsigned int vao, vbo, ibo;
+			// StaticBatch::Version() at upload time
+			unsigned int version;
+		};
+
+		// Uploaded static batches, by batch address
+		std::unordered_map<const StaticBatch*, GpuBatch> mGpuBatches;
+
+		// Returns the GPU buffers for the batch, uploading it on first use or after it was rebuilt
+		const GpuBatch& getGpuBatch(const StaticBatch& batch);
+
+		// Fills the batch's vertex & index buffers (creating them if needed). Returns the number of bytes uploaded.
+		size_t uploadBatch(const StaticBatch& batch, GpuBatch& gpuBatch);
+		// Creates the vertex array of an uploaded batch, in the current context
+		void createVertexArray(GpuBatch& gpuBatch);
+
+		// Largest error (in pixels) a level of detail may have on screen to be drawn
+		float mLodErrorThreshold;
+
+		// Picks the level of detail to draw the object with, from its projected error with the given model-view matrix
+		size_t selectLod(GameObject& object, const GpuMesh& gpuMesh, const glm::mat4& modelView);
+
+		// Issues the indexed draw call for one level of detail of the bound mesh
+		void drawLod(const GpuMesh& gpuMesh, size_t lod);
+
+		// Overrides the per-mesh vertex format when >= 0 (see ForceVertexFormat)
+		int mForcedVertexFormat;
+
+		// Counters for the frame being drawn & the last finished one
+		RenderStats mFrameStats, mStats;
+		// GL_TIME_ELAPSED queries, alternated between frames so results are read a frame later without stalling
+		unsigned int mTimerQueries[2];
+		bool mTimerPending[2];
+		unsigned int mFrameIndex;
+
 		// Window
 		GLFWwindow* mWindow;
 		// Window properties
 		unsigned int mWidth, mHeight;
+		// Vertical field of view of the projection, in degrees (also used to measure LOD error in pixels)
+		static constexpr float FieldOfView = 60.0f;
 
 		// Prevents Init() from executing more than once
 		static bool mInitialised;
@@ -69,15 +183,60 @@ namespace Pinball
 
 		// Creates model, view & projection matrices for transformation
 		glm::mat4* getTransform(GameObject& object, Camera camera);
+		// Creates view & projection matrices
+		void getCameraTransform(Camera camera, glm::mat4& view, glm::mat4& projection);
 	public:
+		// A level's buffers, uploaded ahead of time from another thread (see PreloadLevel) and waiting for AdoptLevel
+		struct PreloadedLevel
+		{
+			std::vector<GpuMesh> meshes;
+			const StaticBatch* batch;
+			GpuBatch gpuBatch;
+			size_t uploadedBytes;
+		};
+
 		static void Init();
 
 		Renderer(std::string name = "Renderer", int width = 1280, int height = 720);
 
 		void Create(std::string name, int width, int height);
 
+		// Frees the GPU buffers of all uploaded meshes
+		void ReleaseMeshes();
+		// Frees the GPU buffers of meshes that were destroyed (eg. after a level was released & its assets evicted from the AssetRegistry)
+		void ReleaseUnusedMeshes();
+		// Frees the GPU buffers of a static batch that's about to be destroyed
+		void ReleaseBatch(const StaticBatch& batch);
+
+		// Creates a hidden window whose context shares buffers & textures with this renderer's, to upload from another thread.
+		// Main thread only; make it current on the uploading thread with glfwMakeContextCurrent.
+		GLFWwindow* CreateSharedContext();
+		// Uploads the buffers of every object in the level & its static batch, in the given vertex format (see ForcedVertexFormat).
+		// Meshes already uploaded (eg. shared with the current level) are skipped.
+		// Call on a thread with a shared context current: returns once the GPU has finished the uploads.
+		PreloadedLevel PreloadLevel(Level& level, int forcedFormat);
+		// Main thread: creates the vertex arrays of a preloaded level's buffers, so it's drawn without uploading anything
+		void AdoptLevel(PreloadedLevel& preloaded);
+
+		// Uploads every mesh in the given Mesh::VertexFormat instead of its own, or in its own format again if format < 0.
+		// Already uploaded meshes are released so they get re-uploaded on their next draw.
+		void ForceVertexFormat(int format);
+		int ForcedVertexFormat();
+
+		// Sets how large (in pixels) the simplification error of a level of detail may get on screen before a finer one is used
+		void LodErrorThreshold(float pixels);
+
+		// Frame statistics: call BeginFrame before the first draw of a frame and EndFrame after the last one
+		void BeginFrame();
+		void EndFrame();
+		// Statistics of the last frame finished with EndFrame
+		const RenderStats& Stats();
+
 		void Draw(GameObject& object, Camera camera, std::vector<Light> lights, GLuint* shader = nullptr);
 
+		// Draws all objects of a static batch, with one draw call per colour. Objects in the batch shouldn't also be drawn with Draw.
+		void DrawStatic(const StaticBatch& batch, Camera camera, std::vector<Light> lights, GLuint* shader = nullptr);
+
 		// If drawing multiple particles of the same type, use DrawParticles, as it only copies the particle geometry once.
 		// This assumes that ALL particles in the level are of the same type.
 		void DrawParticles(Level& level, Camera camera, GLuint* shader = nullptr);
@@ -0,0 +1,416 @@
+#include "ResourcePack.h"
+#include "Util.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace Pinball;
+
+namespace
+{
+	// File layout (native endianness):
+	//	FileHeader
+	//	IndexEntry * fileCount, sorted by nameHash
+	//	names
+	//	per file: data (Alignment byte aligned)
+	// Offsets are from the start of the file.
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t fileCount;
+		uint32_t alignment;
+	};
+
+	const char Magic[4] = { 'P', 'B', 'P', 'K' };
+
+	size_t alignUp(size_t offset, size_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// Pack names use '/' separators and no leading "./"
+	std::string normalise(std::string name)
+	{
+		std::replace(name.begin(), name.end(), '\\', '/');
+		while (name.compare(0, 2, "./") == 0)
+		{
+			name.erase(0, 2);
+		}
+		return name;
+	}
+
+	bool hasExtension(const std::string& path, const std::string& extension)
+	{
+		return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+	}
+
+	// Packs mounted with ResourcePack::mount, in mount order
+	std::vector<std::unique_ptr<ResourcePack>> sMounted;
+	std::mutex sMountedMutex;
+}
+
+struct ResourcePack::IndexEntry
+{
+	uint64_t nameHash;
+	uint64_t dataOffset, dataSize;
+	// Size & modification time of the loose file when it was packed
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t nameOffset, nameLength;
+};
+
+ResourcePack::ResourcePack()
+{
+	mIndex = nullptr;
+	mCount = 0;
+}
+
+ResourcePack::~ResourcePack()
+{
+}
+
+bool ResourcePack::parse()
+{
+	const unsigned char* data = mFile->Data();
+	size_t size = mFile->Size();
+	if (size < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data, sizeof(FileHeader));
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.alignment != Alignment)
+	{
+		std::cout << "Resource pack " << mPath << " is from another version, ignoring it." << std::endl;
+		return false;
+	}
+
+	if ((uint64_t)header.fileCount * sizeof(IndexEntry) > size - sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	// The header is 16 bytes, so the index is suitably aligned in the mapping
+	mIndex = (const IndexEntry*)(data + sizeof(FileHeader));
+	mCount = header.fileCount;
+
+	for (uint32_t i = 0; i < mCount; i++)
+	{
+		const IndexEntry& entry = mIndex[i];
+		if (entry.nameOffset > size || entry.nameLength > size - entry.nameOffset || entry.dataOffset > size || entry.dataSize > size - entry.dataOffset
+			|| (i > 0 && mIndex[i - 1].nameHash > entry.nameHash))
+		{
+			std::cout << "Resource pack " << mPath << " is corrupt, ignoring it." << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::unique_ptr<ResourcePack> ResourcePack::open(const std::string& path)
+{
+	std::unique_ptr<ResourcePack> pack(new ResourcePack());
+	pack->mPath = path;
+	pack->mFile = MappedFile::open(path);
+	if (!pack->mFile || !pack->parse())
+	{
+		return nullptr;
+	}
+
+	pack->mLooseStates.reset(new std::atomic<uint8_t>[pack->mCount]);
+	for (uint32_t i = 0; i < pack->mCount; i++)
+	{
+		pack->mLooseStates[i] = LooseUnchecked;
+	}
+	return pack;
+}
+
+std::vector<std::string> ResourcePack::listFiles(const std::string& directory)
+{
+	std::vector<std::string> ret;
+	std::vector<std::string> pending(1, directory);
+
+	while (!pending.empty())
+	{
+		std::string current = pending.back();
+		pending.pop_back();
+
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((current + "/*").c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+		{
+			continue;
+		}
+		do
+		{
+			std::string name = data.cFileName;
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+			((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? pending : ret).push_back(current + "/" + name);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR* dir = opendir(current.c_str());
+		if (dir == nullptr)
+		{
+			continue;
+		}
+		while (dirent* entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+
+			std::string path = current + "/" + name;
+			struct stat info;
+			if (stat(path.c_str(), &info) == 0)
+			{
+				(S_ISDIR(info.st_mode) ? pending : ret).push_back(path);
+			}
+		}
+		closedir(dir);
+#endif
+	}
+
+	// Listing order depends on the file system; sorted so packs build reproducibly
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
+
+bool ResourcePack::build(const std::string& packPath, const std::vector<std::string>& directories)
+{
+	std::vector<std::string> files;
+	for (size_t i = 0; i < directories.size(); i++)
+	{
+		std::vector<std::string> listed = listFiles(directories[i]);
+		for (size_t j = 0; j < listed.size(); j++)
+		{
+			if (!hasExtension(listed[j], ".blend") && !hasExtension(listed[j], ".blend1"))
+			{
+				files.push_back(listed[j]);
+			}
+		}
+	}
+
+	// Read everything first, so the layout is known before writing
+	std::vector<std::string> names(files.size()), contents(files.size());
+	std::vector<uint64_t> sourceSizes(files.size());
+	std::vector<int64_t> sourceTimes(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		std::ifstream in(files[i], std::ios::binary);
+		if (!in || !statFile(files[i], sourceSizes[i], sourceTimes[i]))
+		{
+			std::cerr << "Failed to read " << files[i] << " for resource pack " << packPath << std::endl;
+			return false;
+		}
+		contents[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		names[i] = normalise(files[i]);
+	}
+
+	// Index sorted by name hash, for binary search
+	std::vector<IndexEntry> index(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		index[i].nameHash = hashBytes(names[i].data(), names[i].size());
+		index[i].dataSize = contents[i].size();
+		index[i].sourceSize = sourceSizes[i];
+		index[i].sourceTime = sourceTimes[i];
+		index[i].nameLength = (uint32_t)names[i].size();
+		// File number until the offsets are laid out
+		index[i].dataOffset = i;
+	}
+	std::sort(index.begin(), index.end(), [](const IndexEntry& a, const IndexEntry& b) { return a.nameHash < b.nameHash; });
+
+	size_t offset = sizeof(FileHeader) + index.size() * sizeof(IndexEntry);
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		index[i].nameOffset = (uint32_t)offset;
+		offset += index[i].nameLength;
+	}
+	std::vector<size_t> order(index.size());
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		order[i] = (size_t)index[i].dataOffset;
+		offset = alignUp(offset, Alignment);
+		index[i].dataOffset = offset;
+		offset += index[i].dataSize;
+	}
+
+	FileHeader header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.fileCount = (uint32_t)index.size();
+	header.alignment = (uint32_t)Alignment;
+
+	std::ofstream out(packPath, std::ios::binary | std::ios::trunc);
+	out.write((const char*)&header, sizeof(FileHeader));
+	out.write((const char*)index.data(), index.size() * sizeof(IndexEntry));
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		out.write(names[order[i]].data(), names[order[i]].size());
+	}
+
+	const char padding[Alignment] = {};
+	size_t written = sizeof(FileHeader) + index.size() * sizeof(IndexEntry);
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		written += index[i].nameLength;
+	}
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		out.write(padding, index[i].dataOffset - written);
+		out.write(contents[order[i]].data(), contents[order[i]].size());
+		written = index[i].dataOffset + index[i].dataSize;
+	}
+
+	if (!out)
+	{
+		std::cerr << "Failed to write resource pack " << packPath << std::endl;
+		return false;
+	}
+
+	std::cout << "Packed " << index.size() << " files into " << packPath << " (" << written << " bytes)" << std::endl;
+	return true;
+}
+
+bool ResourcePack::mount(const std::string& path)
+{
+	std::unique_ptr<ResourcePack> pack = open(path);
+	if (!pack)
+	{
+		return false;
+	}
+
+	std::cout << "Mounted resource pack " << path << " (" << pack->Count() << " files, " << pack->Size() << " bytes)" << std::endl;
+
+	std::lock_guard<std::mutex> lock(sMountedMutex);
+	sMounted.push_back(std::move(pack));
+	return true;
+}
+
+const ResourcePack::IndexEntry* ResourcePack::findEntry(const std::string& path, const ResourcePack** pack)
+{
+	const IndexEntry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(sMountedMutex);
+		if (sMounted.empty())
+		{
+			return nullptr;
+		}
+
+		std::string name = normalise(path);
+		for (size_t i = sMounted.size(); i > 0 && entry == nullptr; i--)
+		{
+			entry = sMounted[i - 1]->lookup(name);
+			*pack = sMounted[i - 1].get();
+		}
+	}
+
+	if (entry != nullptr && (*pack)->looseEdited(entry, path))
+	{
+		return nullptr;
+	}
+	return entry;
+}
+
+bool ResourcePack::looseEdited(const IndexEntry* entry, const std::string& path) const
+{
+	// Concurrent first lookups may both stat the file, which is harmless
+	std::atomic<uint8_t>& state = mLooseStates[entry - mIndex];
+	if (state == LooseUnchecked)
+	{
+		// Shipped builds have no loose copies, so a loose file that differs from its packed copy was edited after packing
+		uint64_t size;
+		int64_t time;
+		bool edited = statFile(path, size, time) && (size != entry->sourceSize || time != entry->sourceTime);
+		state = edited ? LooseEdited : LooseMatches;
+	}
+	return state == LooseEdited;
+}
+
+Span<const unsigned char> ResourcePack::find(const std::string& path)
+{
+	const ResourcePack* pack = nullptr;
+	const IndexEntry* entry = findEntry(path, &pack);
+	if (entry == nullptr)
+	{
+		return Span<const unsigned char>();
+	}
+	return Span<const unsigned char>(pack->mFile->Data() + entry->dataOffset, (size_t)entry->dataSize);
+}
+
+bool ResourcePack::findSourceInfo(const std::string& path, uint64_t& size, int64_t& time)
+{
+	const ResourcePack* pack = nullptr;
+	const IndexEntry* entry = findEntry(path, &pack);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+	size = entry->sourceSize;
+	time = entry->sourceTime;
+	return true;
+}
+
+const ResourcePack::IndexEntry* ResourcePack::lookup(const std::string& name) const
+{
+	uint64_t hash = hashBytes(name.data(), name.size());
+	const IndexEntry* end = mIndex + mCount;
+	const IndexEntry* entry = std::lower_bound(mIndex, end, hash, [](const IndexEntry& e, uint64_t h) { return e.nameHash < h; });
+
+	// Names are compared too, in case of hash collisions
+	const unsigned char* data = mFile->Data();
+	for (; entry != end && entry->nameHash == hash; entry++)
+	{
+		if (entry->nameLength == name.size() && memcmp(data + entry->nameOffset, name.data(), name.size()) == 0)
+		{
+			return entry;
+		}
+	}
+	return nullptr;
+}
+
+Span<const unsigned char> ResourcePack::Find(const std::string& name) const
+{
+	const IndexEntry* entry = lookup(name);
+	if (entry == nullptr)
+	{
+		return Span<const unsigned char>();
+	}
+	return Span<const unsigned char>(mFile->Data() + entry->dataOffset, (size_t)entry->dataSize);
+}
+
+size_t ResourcePack::Count() const
+{
+	return mCount;
+}
+
+size_t ResourcePack::Size() const
+{
+	return mFile->Size();
+}
+
+std::string ResourcePack::Path() const
+{
+	return mPath;
+}
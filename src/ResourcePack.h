@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Span.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+namespace Pinball
+{
+	// Single-file archive of the game's resources (shaders, images, models & their mesh caches), built with --build-pack.
+	// The pack is memory-mapped and looked up through a name index sorted by hash; files are returned as views into the mapping, without copying.
+	// Mounted packs are searched by getFileContents, Image::Load, Mesh::fromFile & MeshCache before the loose files,
+	// using the same relative paths (eg. "GLSL/Diffuse.vert"). Each file's size & modification time are recorded when the pack is built,
+	// and a loose copy that no longer matches them (checked on the file's first lookup) is used instead of the packed one, so a stale pack never hides edited files.
+	class ResourcePack
+	{
+	public:
+		// Bump whenever the file layout changes
+		static const uint32_t Version = 2;
+		// Alignment of each file's data in the pack, so mapped buffers can be used in place
+		static const size_t Alignment = 64;
+	private:
+		struct IndexEntry;
+
+		std::unique_ptr<MappedFile> mFile;
+		const IndexEntry* mIndex;
+		uint32_t mCount;
+		std::string mPath;
+
+		// Whether each file's loose copy was modified since packing, per index entry. Each is stat'ed on its first lookup only.
+		enum LooseState { LooseUnchecked = 0, LooseMatches, LooseEdited };
+		std::unique_ptr<std::atomic<uint8_t>[]> mLooseStates;
+
+		ResourcePack();
+		ResourcePack(const ResourcePack&) = delete;
+		ResourcePack& operator=(const ResourcePack&) = delete;
+
+		// Checks the header & index. False if the pack is from another version or malformed.
+		bool parse();
+
+		// Index entry of the named file, or nullptr if it isn't in the pack
+		const IndexEntry* lookup(const std::string& name) const;
+		// True if the loose copy of entry at path exists and differs from it
+		bool looseEdited(const IndexEntry* entry, const std::string& path) const;
+		// Looks path up in the mounted packs, most recently mounted first, skipping files whose loose copy was modified since packing
+		static const IndexEntry* findEntry(const std::string& path, const ResourcePack** pack);
+	public:
+		~ResourcePack();
+
+		// Maps a pack file. Returns nullptr if it doesn't exist or is invalid.
+		static std::unique_ptr<ResourcePack> open(const std::string& path);
+
+		// Bundles every file under the given directories (relative to the working directory) into a pack.
+		// Blender sources (.blend, .blend1) are left out.
+		static bool build(const std::string& packPath, const std::vector<std::string>& directories);
+
+		// Paths of the files under directory (recursively), with '/' separators
+		static std::vector<std::string> listFiles(const std::string& directory);
+
+		// Mounts a pack for find. Mounted packs stay mapped until the program exits, so views into them never dangle.
+		static bool mount(const std::string& path);
+		// Looks path up in the mounted packs, most recently mounted first. Returns an empty span if no pack has it.
+		static Span<const unsigned char> find(const std::string& path);
+		// Size & modification time the file found by find had when it was packed, to validate caches packed along with their sources.
+		// False if no pack has it.
+		static bool findSourceInfo(const std::string& path, uint64_t& size, int64_t& time);
+
+		// Contents of the named file, or an empty span if it isn't in the pack
+		Span<const unsigned char> Find(const std::string& name) const;
+		// Number of files
+		size_t Count() const;
+		// Size of the mapped pack in bytes
+		size_t Size() const;
+		std::string Path() const;
+	};
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Pinball
+{
+	// Non-owning view over a contiguous array (pointer + element count).
+	// The viewed storage must outlive the span, so don't hold on to one across calls that modify its owner.
+	template <typename T>
+	class Span
+	{
+	private:
+		T* mData;
+		size_t mSize;
+	public:
+		Span() : mData(nullptr), mSize(0) {}
+		Span(T* data, size_t size) : mData(data), mSize(size) {}
+		// Views a contiguous container's elements (eg. a std::vector)
+		template <typename Container>
+		Span(Container& container) : mData(container.data()), mSize(container.size()) {}
+
+		T* data() const { return mData; }
+		size_t size() const { return mSize; }
+		bool empty() const { return mSize == 0; }
+
+		// Size of the viewed storage in bytes
+		size_t bytes() const { return mSize * sizeof(T); }
+
+		T& operator[](size_t i) const { return mData[i]; }
+
+		T* begin() const { return mData; }
+		T* end() const { return mData + mSize; }
+	};
+}
@@ -0,0 +1,125 @@
+#include "StaticBatch.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace Pinball;
+
+StaticBatch::StaticBatch()
+{
+	mBounds = Bounds::compute(nullptr, 0);
+	mVersion = 0;
+}
+
+void StaticBatch::Build(const std::vector<GameObject*>& objects)
+{
+	Clear();
+
+	// Objects sorted by colour, so objects sharing one end up next to each other and merge into a single draw range
+	std::vector<GameObject*> sorted = objects;
+	std::stable_sort(sorted.begin(), sorted.end(), [](GameObject* a, GameObject* b)
+	{
+		return std::lexicographical_compare(a->Color(), a->Color() + 3, b->Color(), b->Color() + 3);
+	});
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		GameObject* obj = sorted[i];
+		const Mesh& mesh = obj->Geometry();
+
+		// Same transform as the one the renderer builds for the object: translation * rotation * scale
+		physx::PxTransform transform = obj->Transform();
+		physx::PxVec3 scale(obj->Scale().X(), obj->Scale().Y(), obj->Scale().Z());
+
+		const unsigned int vertexOffset = (unsigned int)mVertices.size();
+		Span<const Vertex> vertices = mesh.GetVertices();
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			physx::PxVec3 p = transform.transform(physx::PxVec3(vertices[v].pX() * scale.x, vertices[v].pY() * scale.y, vertices[v].pZ() * scale.z));
+
+			// Normals transform by the inverse transpose, which for rotation * scale is rotation * inverse scale
+			physx::PxVec3 n = transform.q.rotate(physx::PxVec3(vertices[v].nX() / scale.x, vertices[v].nY() / scale.y, vertices[v].nZ() / scale.z));
+			n.normalize();
+
+			mVertices.push_back(Vertex(p.x, p.y, p.z, n.x, n.y, n.z));
+		}
+
+		ObjectRange objectRange = { obj, mIndices.size(), mesh.GetIndexCount() };
+		Span<const unsigned int> indices = mesh.GetIndices();
+		for (size_t j = 0; j < indices.size(); j++)
+		{
+			mIndices.push_back(indices[j] + vertexOffset);
+		}
+		mObjectRanges.push_back(objectRange);
+
+		const float* color = obj->Color();
+		if (mDrawRanges.empty() || !std::equal(color, color + 3, mDrawRanges.back().color))
+		{
+			DrawRange drawRange = { objectRange.indexOffset, 0, { color[0], color[1], color[2] } };
+			mDrawRanges.push_back(drawRange);
+		}
+		mDrawRanges.back().indexCount += objectRange.indexCount;
+	}
+
+	mBounds = Bounds::compute(mVertices.data(), mVertices.size());
+	mVersion++;
+
+	std::cout << "Static batch: " << mObjectRanges.size() << " objects, " << mVertices.size() << " vertices, "
+		<< mIndices.size() / 3 << " triangles in " << mDrawRanges.size() << " draw ranges" << std::endl;
+}
+
+void StaticBatch::Clear()
+{
+	mVertices.clear();
+	mIndices.clear();
+	mDrawRanges.clear();
+	mObjectRanges.clear();
+	mBounds = Bounds::compute(nullptr, 0);
+	mVersion++;
+}
+
+bool StaticBatch::Contains(const GameObject* object) const
+{
+	for (size_t i = 0; i < mObjectRanges.size(); i++)
+	{
+		if (mObjectRanges[i].object == object)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+Span<const Vertex> StaticBatch::GetVertices() const
+{
+	return Span<const Vertex>(mVertices.data(), mVertices.size());
+}
+
+Span<const unsigned int> StaticBatch::GetIndices() const
+{
+	return Span<const unsigned int>(mIndices.data(), mIndices.size());
+}
+
+const std::vector<StaticBatch::DrawRange>& StaticBatch::GetDrawRanges() const
+{
+	return mDrawRanges;
+}
+
+const std::vector<StaticBatch::ObjectRange>& StaticBatch::GetObjectRanges() const
+{
+	return mObjectRanges;
+}
+
+const Bounds& StaticBatch::GetBounds() const
+{
+	return mBounds;
+}
+
+unsigned int StaticBatch::Version() const
+{
+	return mVersion;
+}
+
+bool StaticBatch::IsEmpty() const
+{
+	return mIndices.empty();
+}
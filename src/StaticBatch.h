@@ -0,0 +1,60 @@
+#pragma once
+
+#include "GameObject.h"
+#include "Bounds.h"
+#include <vector>
+
+namespace Pinball
+{
+	// Render geometry of static GameObjects, pre-transformed into world space and merged into one vertex & index buffer.
+	// Objects are grouped by colour, so the whole batch is drawn with one draw call per distinct colour (see Renderer::DrawStatic).
+	// Only for objects that never move: the batch isn't updated if they do.
+	class StaticBatch
+	{
+	public:
+		// Consecutive objects with the same colour in the merged index buffer, drawn together
+		struct DrawRange
+		{
+			size_t indexOffset;
+			size_t indexCount;
+			float color[3];
+		};
+
+		// Where each object's triangles ended up in the merged index buffer
+		struct ObjectRange
+		{
+			GameObject* object;
+			size_t indexOffset;
+			size_t indexCount;
+		};
+	private:
+		// World-space vertices of all objects
+		std::vector<Vertex> mVertices;
+		std::vector<unsigned int> mIndices;
+
+		std::vector<DrawRange> mDrawRanges;
+		std::vector<ObjectRange> mObjectRanges;
+
+		Bounds mBounds;
+
+		// Incremented on each Build, so uploaded copies can tell they're out of date
+		unsigned int mVersion;
+	public:
+		StaticBatch();
+
+		// Merges the given objects' full detail geometry at their current transform & scale
+		void Build(const std::vector<GameObject*>& objects);
+		void Clear();
+
+		// Whether the object is drawn as part of this batch
+		bool Contains(const GameObject* object) const;
+
+		Span<const Vertex> GetVertices() const;
+		Span<const unsigned int> GetIndices() const;
+		const std::vector<DrawRange>& GetDrawRanges() const;
+		const std::vector<ObjectRange>& GetObjectRanges() const;
+		const Bounds& GetBounds() const;
+		unsigned int Version() const;
+		bool IsEmpty() const;
+	};
+}
@@ -0,0 +1,179 @@
+#include "TaskPool.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace Pinball;
+
+TaskPool::TaskPool(unsigned int threadCount)
+{
+	mPending = 0;
+	mStopping = false;
+	mStart = Clock::now();
+
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		mWorkers.emplace_back(&TaskPool::workerLoop, this, (int)i + 1);
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkerWake.notify_all();
+
+	for (size_t i = 0; i < mWorkers.size(); i++)
+	{
+		mWorkers[i].join();
+	}
+}
+
+double TaskPool::ElapsedMs() const
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - mStart).count();
+}
+
+void TaskPool::push(std::deque<TaskPool::Task>& queue, const std::string& name, std::function<void()> run)
+{
+	Task task = { name, std::move(run), ElapsedMs() };
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		queue.push_back(std::move(task));
+		mPending++;
+	}
+
+	if (&queue == &mMainTasks)
+	{
+		mMainWake.notify_one();
+	}
+	else
+	{
+		mWorkerWake.notify_one();
+	}
+}
+
+void TaskPool::execute(TaskPool::Task& task, int thread)
+{
+	double startMs = ElapsedMs();
+	task.run();
+	double endMs = ElapsedMs();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		TimelineEvent event = { task.name, thread, task.queuedMs, startMs, endMs };
+		mTimeline.push_back(event);
+		mPending--;
+	}
+	// The main thread may be waiting for everything to finish
+	mMainWake.notify_one();
+}
+
+void TaskPool::workerLoop(int thread)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWorkerWake.wait(lock, [this]() { return mStopping || !mWorkerTasks.empty(); });
+		if (mWorkerTasks.empty())
+		{
+			// Stopping, with nothing left to run
+			return;
+		}
+
+		Task task = std::move(mWorkerTasks.front());
+		mWorkerTasks.pop_front();
+
+		lock.unlock();
+		execute(task, thread);
+		lock.lock();
+	}
+}
+
+void TaskPool::RunMainTasks()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mMainTasks.empty())
+	{
+		Task task = std::move(mMainTasks.front());
+		mMainTasks.pop_front();
+
+		lock.unlock();
+		execute(task, 0);
+		lock.lock();
+	}
+}
+
+void TaskPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		if (!mMainTasks.empty())
+		{
+			Task task = std::move(mMainTasks.front());
+			mMainTasks.pop_front();
+
+			lock.unlock();
+			execute(task, 0);
+			lock.lock();
+		}
+		else if (mPending == 0)
+		{
+			return;
+		}
+		else
+		{
+			mMainWake.wait(lock);
+		}
+	}
+}
+
+void TaskPool::Mark(const std::string& name, double startMs)
+{
+	double ms = ElapsedMs();
+	if (startMs < 0.0)
+	{
+		startMs = ms;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	TimelineEvent event = { name, 0, startMs, startMs, ms };
+	mTimeline.push_back(event);
+}
+
+std::vector<TaskPool::TimelineEvent> TaskPool::Timeline()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<TimelineEvent> ret = mTimeline;
+	std::sort(ret.begin(), ret.end(), [](const TimelineEvent& a, const TimelineEvent& b) { return a.startMs < b.startMs; });
+	return ret;
+}
+
+void TaskPool::PrintTimeline()
+{
+	std::vector<TimelineEvent> timeline = Timeline();
+
+	std::cout << "Startup timeline (ms since start):" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	for (size_t i = 0; i < timeline.size(); i++)
+	{
+		const TimelineEvent& event = timeline[i];
+		std::cout << "  " << std::setw(8) << event.startMs << " - " << std::setw(8) << event.endMs << "  " << (event.thread == 0 ? "main    " : "worker ")
+			<< (event.thread == 0 ? "" : std::to_string(event.thread)) << "  " << event.name;
+		if (event.endMs > event.startMs)
+		{
+			std::cout << " (" << event.endMs - event.startMs << " ms, waited " << event.startMs - event.queuedMs << " ms)";
+		}
+		std::cout << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+	std::cout << std::setprecision(6);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <type_traits>
+
+namespace Pinball
+{
+	// Worker threads for CPU-only work (file reads, image decoding, model import, PhysX setup & cooking),
+	// plus a completion queue of tasks that have to run on the main thread (anything touching the GL context).
+	// Workers hand GL work over with RunOnMain; the main thread runs it from RunMainTasks or WaitIdle.
+	// Each task's queue, start & end times are recorded for PrintTimeline, to show the startup critical path.
+	class TaskPool
+	{
+	public:
+		struct TimelineEvent
+		{
+			std::string name;
+			// 0 for the main thread, 1 onwards for the workers
+			int thread;
+			// Milliseconds since the pool was created
+			double queuedMs, startMs, endMs;
+		};
+	private:
+		typedef std::chrono::high_resolution_clock Clock;
+
+		struct Task
+		{
+			std::string name;
+			std::function<void()> run;
+			double queuedMs;
+		};
+
+		std::vector<std::thread> mWorkers;
+		std::deque<Task> mWorkerTasks, mMainTasks;
+		std::mutex mMutex;
+		std::condition_variable mWorkerWake, mMainWake;
+		// Tasks queued or running, on any thread
+		size_t mPending;
+		bool mStopping;
+
+		Clock::time_point mStart;
+		std::vector<TimelineEvent> mTimeline;
+
+		void push(std::deque<Task>& queue, const std::string& name, std::function<void()> run);
+		// Runs a task & records it in the timeline
+		void execute(Task& task, int thread);
+		void workerLoop(int thread);
+	public:
+		// Starts threadCount workers (one per hardware thread if 0)
+		explicit TaskPool(unsigned int threadCount = 0);
+		// Waits for the queued worker tasks, then joins the workers
+		~TaskPool();
+		TaskPool(const TaskPool&) = delete;
+		TaskPool& operator=(const TaskPool&) = delete;
+
+		// Queues task for a worker thread. Tasks start in the order they're queued, so a task may wait on the result of one queued before it.
+		template <typename Function>
+		std::future<typename std::result_of<Function()>::type> Run(const std::string& name, Function task)
+		{
+			typedef typename std::result_of<Function()>::type Result;
+			std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+			std::future<Result> ret = packaged->get_future();
+			push(mWorkerTasks, name, [packaged]() { (*packaged)(); });
+			return ret;
+		}
+
+		// Queues task for the main thread. Can be called from any thread.
+		template <typename Function>
+		std::future<typename std::result_of<Function()>::type> RunOnMain(const std::string& name, Function task)
+		{
+			typedef typename std::result_of<Function()>::type Result;
+			std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+			std::future<Result> ret = packaged->get_future();
+			push(mMainTasks, name, [packaged]() { (*packaged)(); });
+			return ret;
+		}
+
+		// Main thread only: runs the main-thread tasks queued so far, without waiting for more
+		void RunMainTasks();
+		// Main thread only: runs main-thread tasks as they arrive until no task is queued or running anywhere
+		void WaitIdle();
+
+		// Runs task(i) for every i in [0, count) on up to threadCount threads (one per hardware thread if 0), including the calling one.
+		// Indices are handed out one at a time, so uneven tasks balance out. Returns once all are done.
+		template <typename Function>
+		static void parallelFor(size_t count, unsigned int threadCount, const Function& task)
+		{
+			if (threadCount == 0)
+			{
+				threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+			}
+
+			std::atomic<size_t> next(0);
+			auto worker = [&]()
+			{
+				for (size_t i = next++; i < count; i = next++)
+				{
+					task(i);
+				}
+			};
+
+			std::vector<std::thread> threads;
+			for (unsigned int i = 1; i < threadCount && i < count; i++)
+			{
+				threads.emplace_back(worker);
+			}
+			worker();
+			for (size_t i = 0; i < threads.size(); i++)
+			{
+				threads[i].join();
+			}
+		}
+
+		// Records a step run outside the pool, from startMs (see ElapsedMs) until now, in the timeline.
+		// Without startMs, records an instantaneous event (eg. the first frame).
+		void Mark(const std::string& name, double startMs = -1.0);
+		// Milliseconds since the pool was created
+		double ElapsedMs() const;
+
+		std::vector<TimelineEvent> Timeline();
+		// Prints every task in start order, with its thread, wait & run times
+		void PrintTimeline();
+	};
+}
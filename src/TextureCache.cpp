@@ -0,0 +1,251 @@
+#include "TextureCache.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include "Util.h"
+#include "ResourcePack.h"
+
+using namespace Pinball;
+
+namespace
+{
+	// File layout (native endianness):
+	//	FileHeader
+	//	LevelRecord * levelCount
+	//	pixels of each level, largest first, back to back (16 byte aligned)
+	// Level offsets are from the start of the pixels.
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t levelCount;
+		uint32_t pixelOffset;
+		uint64_t pixelBytes;
+		// Source file the image was decoded from
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+	};
+
+	struct LevelRecord
+	{
+		uint32_t width, height;
+		uint64_t offset, size;
+	};
+
+	const char Magic[4] = { 'P', 'B', 'T', 'X' };
+
+	// Halves an RGBA8 image (rounding down, to at least 1x1), averaging each 2x2 block.
+	// The last row & column of odd sizes are folded into the block before them.
+	std::vector<unsigned char> downsample(const unsigned char* src, int width, int height, int& outWidth, int& outHeight)
+	{
+		outWidth = width > 1 ? width / 2 : 1;
+		outHeight = height > 1 ? height / 2 : 1;
+
+		std::vector<unsigned char> dst((size_t)outWidth * outHeight * 4);
+		for (int y = 0; y < outHeight; y++)
+		{
+			int y0 = y * 2, y1 = (y == outHeight - 1) ? height - 1 : y0 + 1;
+			for (int x = 0; x < outWidth; x++)
+			{
+				int x0 = x * 2, x1 = (x == outWidth - 1) ? width - 1 : x0 + 1;
+				for (int c = 0; c < 4; c++)
+				{
+					unsigned int sum = 0, count = 0;
+					for (int sy = y0; sy <= y1; sy++)
+					{
+						for (int sx = x0; sx <= x1; sx++)
+						{
+							sum += src[((size_t)sy * width + sx) * 4 + c];
+							count++;
+						}
+					}
+					dst[((size_t)y * outWidth + x) * 4 + c] = (unsigned char)((sum + count / 2) / count);
+				}
+			}
+		}
+		return dst;
+	}
+}
+
+TextureCache::TextureCache()
+{
+}
+
+std::string TextureCache::pathFor(const std::string& sourcePath)
+{
+	return sourcePath + ".texcache";
+}
+
+bool TextureCache::parse(const std::string& sourcePath, Span<const unsigned char> packedSource)
+{
+	const unsigned char* data = mData.data();
+	size_t size = mData.size();
+	if (size < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data, sizeof(FileHeader));
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version)
+	{
+		std::cout << "Texture cache " << pathFor(sourcePath) << " is from another version, ignoring it." << std::endl;
+		return false;
+	}
+
+	if (!packedSource.empty())
+	{
+		// --build-pack refreshes the caches before packing them with their sources, so the source's packed size & time are enough
+		// (this avoids paging the whole source in just to hash it)
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!ResourcePack::findSourceInfo(sourcePath, sourceSize, sourceTime) || sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+		{
+			std::cout << "Packed texture cache " << pathFor(sourcePath) << " is out of date." << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		// Only hash the source if it looks modified, so it isn't read at all on a normal warm start
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!statFile(sourcePath, sourceSize, sourceTime))
+		{
+			return false;
+		}
+		if ((sourceSize != header.sourceSize || sourceTime != header.sourceTime) && hashFile(sourcePath) != header.sourceHash)
+		{
+			std::cout << "Texture cache " << pathFor(sourcePath) << " is out of date." << std::endl;
+			return false;
+		}
+	}
+
+	if (header.levelCount == 0 || header.pixelOffset > size || header.pixelBytes > size - header.pixelOffset
+		|| (uint64_t)header.levelCount * sizeof(LevelRecord) > size - sizeof(FileHeader))
+	{
+		std::cout << "Texture cache " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+		return false;
+	}
+	mPixels = Span<const unsigned char>(data + header.pixelOffset, (size_t)header.pixelBytes);
+
+	mLevels.reserve(header.levelCount);
+	for (uint32_t i = 0; i < header.levelCount; i++)
+	{
+		LevelRecord record;
+		memcpy(&record, data + sizeof(FileHeader) + i * sizeof(LevelRecord), sizeof(LevelRecord));
+
+		if (record.offset > mPixels.size() || record.size > mPixels.size() - record.offset || record.size != (uint64_t)record.width * record.height * 4)
+		{
+			std::cout << "Texture cache " << pathFor(sourcePath) << " is corrupt, ignoring it." << std::endl;
+			mLevels.clear();
+			return false;
+		}
+
+		Level level = { (int)record.width, (int)record.height, (size_t)record.offset, (size_t)record.size };
+		mLevels.push_back(level);
+	}
+
+	return true;
+}
+
+std::shared_ptr<const TextureCache> TextureCache::open(const std::string& sourcePath)
+{
+	std::shared_ptr<TextureCache> cache(new TextureCache());
+
+	// Packed caches stay mapped as long as their pack is mounted, ie. until the program exits
+	Span<const unsigned char> packedSource = ResourcePack::find(sourcePath);
+	if (!packedSource.empty())
+	{
+		cache->mData = ResourcePack::find(pathFor(sourcePath));
+		if (cache->mData.empty() || !cache->parse(sourcePath, packedSource))
+		{
+			return nullptr;
+		}
+		return cache;
+	}
+
+	cache->mFile = MappedFile::open(pathFor(sourcePath));
+	if (!cache->mFile)
+	{
+		return nullptr;
+	}
+	cache->mData = Span<const unsigned char>(cache->mFile->Data(), cache->mFile->Size());
+	if (!cache->parse(sourcePath, Span<const unsigned char>()))
+	{
+		return nullptr;
+	}
+	return cache;
+}
+
+bool TextureCache::write(const std::string& sourcePath, const unsigned char* pixels, int width, int height)
+{
+	if (pixels == nullptr || width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	if (!statFile(sourcePath, header.sourceSize, header.sourceTime))
+	{
+		return false;
+	}
+	header.sourceHash = hashFile(sourcePath);
+
+	// Mip chain down to 1x1, each level built from the one before it
+	std::vector<LevelRecord> records;
+	std::vector<unsigned char> levelPixels(pixels, pixels + (size_t)width * height * 4);
+	std::vector<unsigned char> allPixels;
+	while (true)
+	{
+		LevelRecord record = { (uint32_t)width, (uint32_t)height, allPixels.size(), levelPixels.size() };
+		records.push_back(record);
+		allPixels.insert(allPixels.end(), levelPixels.begin(), levelPixels.end());
+
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+		levelPixels = downsample(levelPixels.data(), width, height, width, height);
+	}
+
+	header.levelCount = (uint32_t)records.size();
+	header.pixelOffset = (uint32_t)((sizeof(FileHeader) + records.size() * sizeof(LevelRecord) + 15) / 16 * 16);
+	header.pixelBytes = allPixels.size();
+
+	std::vector<unsigned char> file(header.pixelOffset + allPixels.size(), 0);
+	memcpy(file.data(), &header, sizeof(FileHeader));
+	memcpy(file.data() + sizeof(FileHeader), records.data(), records.size() * sizeof(LevelRecord));
+	memcpy(file.data() + header.pixelOffset, allPixels.data(), allPixels.size());
+
+	// Images decoded on several workers may map the cache while it's rewritten
+	if (!writeFileAtomic(pathFor(sourcePath), [&](std::ostream& out) { out.write((const char*)file.data(), file.size()); }))
+	{
+		std::cerr << "Failed to write texture cache " << pathFor(sourcePath) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+const std::vector<TextureCache::Level>& TextureCache::Levels() const
+{
+	return mLevels;
+}
+
+Span<const unsigned char> TextureCache::Pixels() const
+{
+	return mPixels;
+}
+
+int TextureCache::Width() const
+{
+	return mLevels[0].width;
+}
+
+int TextureCache::Height() const
+{
+	return mLevels[0].height;
+}
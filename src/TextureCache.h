@@ -0,0 +1,57 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Span.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace Pinball
+{
+	// Binary cache of a decoded image with its full mip chain (RGBA8), written next to it as <image>.texcache after the first decode.
+	// Later launches memory-map the cache and upload its levels as they are (see Renderer::CreateTexture), skipping PNG decoding & glGenerateMipmap.
+	// The cache is versioned, and is discarded when the image file's size & modification time change and its contents hash differs.
+	class TextureCache
+	{
+	public:
+		// Bump whenever the file layout or the mip filter changes
+		static const uint32_t Version = 1;
+
+		// One mip level. Offsets are into Pixels(), tightly packed RGBA8 rows.
+		struct Level
+		{
+			int width, height;
+			size_t offset, size;
+		};
+	private:
+		// Mapped cache file, or null if the cache is read from a mounted ResourcePack
+		std::unique_ptr<MappedFile> mFile;
+		Span<const unsigned char> mData;
+		Span<const unsigned char> mPixels;
+		std::vector<Level> mLevels;
+
+		TextureCache();
+
+		// Checks the header against the source file (or its packed contents, if packedSource isn't empty) and reads the level table.
+		// False if the cache is stale or malformed.
+		bool parse(const std::string& sourcePath, Span<const unsigned char> packedSource);
+	public:
+		// Path of the cache file for an image file
+		static std::string pathFor(const std::string& sourcePath);
+
+		// Maps the cache of sourcePath. Returns nullptr if there's no cache, or it's out of date or unreadable.
+		// If a mounted ResourcePack has sourcePath, its packed cache is used in place instead (see --build-pack).
+		static std::shared_ptr<const TextureCache> open(const std::string& sourcePath);
+
+		// Builds the mip chain of a decoded RGBA8 image (box filtered down to 1x1) and writes the cache of sourcePath, replacing any previous one
+		static bool write(const std::string& sourcePath, const unsigned char* pixels, int width, int height);
+
+		// Mip levels, largest first
+		const std::vector<Level>& Levels() const;
+		// Pixels of every level, back to back
+		Span<const unsigned char> Pixels() const;
+		int Width() const;
+		int Height() const;
+	};
+}
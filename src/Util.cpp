@@ -1,6 +1,17 @@
 #pragma once
 
 #include "Util.h"
+#include "ResourcePack.h"
+#include <sstream>
+#include <thread>
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 bool strContains(std::string str, std::string substr)
 {
@@ -9,18 +20,91 @@ bool strContains(std::string str, std::string substr)
 
 std::string getFileContents(std::string path)
 {
+	Pinball::Span<const unsigned char> packed = Pinball::ResourcePack::find(path);
+	if (!packed.empty())
+	{
+		return std::string((const char*)packed.data(), packed.size());
+	}
+
+	// Read in one go rather than line by line
 	std::ifstream fs(path);
-	std::string ret = "";
-	while (fs.good())
+	std::ostringstream ret;
+	ret << fs.rdbuf();
+	return ret.str();
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
 	{
-		std::string currentLine = "";
-		std::getline(fs, currentLine);
-		ret += currentLine;
-		if (!fs.eof())
-			ret += "\n";
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
 	}
+	return hash;
+}
 
-	return ret;
+uint64_t hashFile(std::string path)
+{
+	std::ifstream file(path, std::ios::binary);
+	uint64_t hash = hashBytes(nullptr, 0);
+
+	char buffer[64 * 1024];
+	while (file)
+	{
+		file.read(buffer, sizeof(buffer));
+		hash = hashBytes(buffer, (size_t)file.gcount(), hash);
+	}
+	return hash;
+}
+
+bool statFile(const std::string& path, uint64_t& size, int64_t& time)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#endif
+	size = (uint64_t)info.st_size;
+	time = (int64_t)info.st_mtime;
+	return true;
+}
+
+bool writeFileAtomic(const std::string& path, const std::function<void(std::ostream&)>& write)
+{
+	// One temporary file per thread, so concurrent writers don't write into each other's
+	std::string tempPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		write(out);
+		out.flush();
+		if (!out)
+		{
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	// Fails while another process has path mapped, in which case the existing file is kept
+	bool renamed = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed)
+	{
+		std::remove(tempPath.c_str());
+	}
+	return renamed;
 }
 
 float* mat4ToRaw(glm::mat4 mat)
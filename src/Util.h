@@ -3,13 +3,28 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <cstdint>
+#include <functional>
 #include <glm/mat4x4.hpp>
 
 // Utility: returns true if str contains substr
 bool strContains(std::string str, std::string substr);
 
-// Utility: returns contents of a file as text. Used to get shader sources.
+// Utility: returns contents of a file as text, from a mounted ResourcePack if it has it. Used to get shader sources.
 std::string getFileContents(std::string path);
 
+// Utility: 64-bit FNV-1a hash of a byte range. Pass the previous result as hash to hash several ranges as one.
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// Utility: hashBytes of a file's contents (read as binary)
+uint64_t hashFile(std::string path);
+
+// Utility: gets a file's size & modification time. Returns false if it doesn't exist.
+bool statFile(const std::string& path, uint64_t& size, int64_t& time);
+
+// Utility: writes a file through a temporary file that's renamed over path once complete, so readers mapping path (and other threads
+// writing the same path) never see it half-written. write fills the stream. Returns false if writing or renaming failed.
+bool writeFileAtomic(const std::string& path, const std::function<void(std::ostream&)>& write);
+
 // Converts a glm mat4 type into a raw 4x4 float array.
 float* mat4ToRaw(glm::mat4 mat);
\ No newline at end of file
@@ -5,17 +5,25 @@ namespace Pinball
 	// Vertex format:
 	// position: 3*float
 	// normals: 3*float
+	// Stored inline so that a std::vector<Vertex> is a single contiguous interleaved buffer
+	// that can be handed to OpenGL and PhysX as-is.
 	class Vertex
 	{
 	private:
-		float* mData;
+		float mData[6];
 	public:
-		// Copies vertices to a new float array.
-		float* GetData();
+		// Number of floats per vertex
+		static const int Stride = 6;
+
+		// Returns a pointer to this vertex's 6 floats (no copy is made).
+		const float* GetData() const;
 
 		// Getters/setters for position and normal elements.
-		float pX(), pX(float), pY(), pY(float), pZ(), pZ(float), nX(), nX(float), nY(), nY(float), nZ(), nZ(float);
+		float pX() const, pX(float), pY() const, pY(float), pZ() const, pZ(float), nX() const, nX(float), nY() const, nY(float), nZ() const, nZ(float);
 
-		Vertex(float px = 0.0f, float py = 0.0f, float pz = 0.0f, float nx = 0.0f, float ny = 0.0f, float nz = 0.0f);
+		// constexpr (so defined here) for vertex data generated at compile time, see Primitives.h
+		constexpr Vertex(float px = 0.0f, float py = 0.0f, float pz = 0.0f, float nx = 0.0f, float ny = 0.0f, float nz = 0.0f) : mData{ px, py, pz, nx, ny, nz } {}
 	};
-}
\ No newline at end of file
+
+	static_assert(sizeof(Vertex) == Vertex::Stride * sizeof(float), "Vertex must be tightly packed to be used as an interleaved buffer");
+}
@@ -4,6 +4,8 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 
@@ -13,6 +15,17 @@
 #include "Middleware.h"
 #include "Light.h"
 #include "Renderer.h"
+#include "PrimitiveCache.h"
+#include "AllocationCounter.h"
+#include "CookingCache.h"
+#include "CookingProfiles.h"
+#include "ConvexDecomposition.h"
+#include "AssetRegistry.h"
+#include "PhysicsRegistry.h"
+#include "ObjImporter.h"
+#include "ResourcePack.h"
+#include "TaskPool.h"
+#include "LevelLoader.h"
 #include "Util.h"
 
 Pinball::Level* gLevel = nullptr;
@@ -205,121 +218,438 @@ physx::PxFilterFlags MyFilterShader(
 	return physx::PxFilterFlag::eDEFAULT;
 }
 
-int main(int* argc, char** argv)
+// Flipper hinges & physics tweaks for a freshly loaded level. The joints are handed over to the level, to be released with it.
+void setupLevel(Pinball::Level& level, physx::PxScene& scene)
 {
-	// Create renderer
-	Pinball::Renderer gfx("Pinball Game");
+	physx::PxVec3 hingeLocation = level.FlipperL()->Transform().p;
+	((physx::PxRigidDynamic*)level.FlipperL()->GetPxActor())->setMass(0.f);
+	((physx::PxRigidDynamic*)level.FlipperR()->GetPxActor())->setMass(0.f);
+	((physx::PxRigidDynamic*)level.FlipperL()->GetPxActor())->setMassSpaceInertiaTensor(physx::PxVec3(0.f, 10.f, 0.f));
+	((physx::PxRigidDynamic*)level.FlipperR()->GetPxActor())->setMassSpaceInertiaTensor(physx::PxVec3(0.f, 10.f, 0.f));
+
+	physx::PxSphericalJoint* flipperJointL = physx::PxSphericalJointCreate(PxGetPhysics(),
+		level.HingeL()->GetPxRigidActor(), physx::PxTransform(hingeLocation - level.HingeL()->Transform().p),
+		level.FlipperL()->GetPxRigidActor(), physx::PxTransform(physx::PxVec3(0.0f)));
+	level.AddJoint(flipperJointL);
+
+	level.FlipperL()->GetPxActor()->setActorFlag(physx::PxActorFlag::eDISABLE_GRAVITY, true);
+	scene.setVisualizationParameter(physx::PxVisualizationParameter::eJOINT_LOCAL_FRAMES, 1.0f);
+	scene.setVisualizationParameter(physx::PxVisualizationParameter::eJOINT_LIMITS, 1.0f);
+	flipperJointL->setConstraintFlag(physx::PxConstraintFlag::eVISUALIZATION, true);
 
-	// Shaders
-	GLuint diffuseShader, unlitShader, sparkShader, imgShader;
-	diffuseShader = Pinball::Renderer::compileShader(getFileContents("GLSL/Diffuse.vert"), getFileContents("GLSL/Diffuse.frag"));
-	unlitShader = Pinball::Renderer::compileShader(getFileContents("GLSL/Unlit.vert"), getFileContents("GLSL/Unlit.frag"));
-	sparkShader = Pinball::Renderer::compileShader(getFileContents("GLSL/Spark.vert"), getFileContents("GLSL/Spark.frag"));
-	imgShader = Pinball::Renderer::compileShader(getFileContents("GLSL/Image2D.vert"), getFileContents("GLSL/Image2D.frag"));
+	flipperJointL->setLimitCone(physx::PxJointLimitCone(physx::PxPi / 4, physx::PxPi / 4, 0.01f));
+	flipperJointL->setSphericalJointFlag(physx::PxSphericalJointFlag::eLIMIT_ENABLED, true);
 
-	// game-over screen image
-	Pinball::Image gameOverImg("Images/gameover.png");
-	gfx.CreateTexture(gameOverImg);
+	hingeLocation = level.FlipperR()->Transform().p;
 
-	bool running = true;
+	physx::PxSphericalJoint* flipperJointR = physx::PxSphericalJointCreate(PxGetPhysics(),
+		level.HingeR()->GetPxRigidActor(), physx::PxTransform(hingeLocation - level.HingeR()->Transform().p),
+		level.FlipperR()->GetPxRigidActor(), physx::PxTransform(physx::PxVec3(0.0f)));
+	level.AddJoint(flipperJointR);
+	level.FlipperR()->GetPxActor()->setActorFlag(physx::PxActorFlag::eDISABLE_GRAVITY, true);
 
-	// PhysX
-	physx::PxDefaultAllocator pxAlloc;
-	physx::PxDefaultErrorCallback pxErrClb;
-	physx::PxPvd* pxPvd = nullptr;
+	flipperJointR->setLimitCone(physx::PxJointLimitCone(physx::PxPi / 4, physx::PxPi / 4, 0.01f));
+	flipperJointR->setSphericalJointFlag(physx::PxSphericalJointFlag::eLIMIT_ENABLED, true);
+}
 
-	physx::PxFoundation* pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
-	pxPvd = physx::PxCreatePvd(*pxFoundation);
-	physx::PxPvdTransport* transport = physx::PxDefaultPvdSocketTransportCreate("localhost", 5425, 10);
-	pxPvd->connect(*transport, physx::PxPvdInstrumentationFlag::eALL);
-
-	physx::PxPhysics* pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale(), false, pxPvd);
-	PxInitExtensions(*pxPhysics, pxPvd);
-	physx::PxCookingParams cookingParams = physx::PxCookingParams(physx::PxTolerancesScale());
-	//cookingParams.meshPreprocessParams |= physx::PxMeshPreprocessingFlag::eDISABLE_CLEAN_MESH;
-	physx::PxCooking* cooking = PxCreateCooking(PX_PHYSICS_VERSION, PxGetPhysics().getFoundation(), cookingParams);
-
-	physx::PxSceneDesc sceneDesc = physx::PxSceneDesc(physx::PxTolerancesScale());
-	sceneDesc.gravity = physx::PxVec3(0.0f, -9.81f, 9.81f);
-	sceneDesc.filterShader = MyFilterShader;
-	sceneDesc.cpuDispatcher = physx::PxDefaultCpuDispatcherCreate(1);
-	sceneDesc.flags = physx::PxSceneFlag::eENABLE_CCD;
-	physx::PxScene* scene = PxGetPhysics().createScene(sceneDesc);
-	scene->setSimulationEventCallback(new MySimulationEventCallback());
-
-	Pinball::Mesh boxMesh = Pinball::Mesh::createBox(cooking);
-	boxMesh.Color(0.0f, 1.0f, 0.0f);
-	Pinball::GameObject boxObj(boxMesh);
-	boxObj.Transform(physx::PxTransform(physx::PxVec3(0.0f, 3.0f, 0.f), physx::PxQuat(physx::PxIdentity)));
+int main(int argc, char** argv)
+{
+	// Model importer used when a mesh cache is out of date, how often attract mode swaps to the next table (0 never),
+	// which cooking profiles meshes get (by mesh name or type, eg. --cooking-profile Flipper=convex-gauss),
+	// whether the table collides as triangle meshes or as their convex decomposition (--table-collision convex),
+	// the error bound of the simplified collision proxies generated for level meshes (--collision-proxy-error, none by default),
+	// the sample spacing of the heightfields flat surfaces like the floor collide through (--heightfield-cell, none by default),
+	// and how many bytes of assets nothing holds the AssetRegistry keeps, eg. the tables swapped out in attract mode (--asset-budget, no limit by default)
+	double attractSwapSeconds = 0.0;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (std::string(argv[i]) == "--cooking-profile")
+		{
+			Pinball::CookingProfiles::Global().AssignRule(argv[i + 1]);
+		}
+		if (std::string(argv[i]) == "--import-backend")
+		{
+			Pinball::Mesh::SetImportBackend(std::string(argv[i + 1]) == "assimp" ? Pinball::Mesh::AssimpImport : Pinball::Mesh::ObjImport);
+		}
+		else if (std::string(argv[i]) == "--attract-swap")
+		{
+			attractSwapSeconds = std::stod(argv[i + 1]);
+		}
+		else if (std::string(argv[i]) == "--table-collision")
+		{
+			Pinball::Level::SetCollisionMode(std::string(argv[i + 1]) == "convex" ? Pinball::Level::ConvexHullCollision : Pinball::Level::TriangleMeshCollision);
+		}
+		else if (std::string(argv[i]) == "--collision-proxy-error")
+		{
+			Pinball::Level::SetCollisionProxyError(std::stof(argv[i + 1]));
+		}
+		else if (std::string(argv[i]) == "--heightfield-cell")
+		{
+			Pinball::Level::SetHeightFieldCellSize(std::stof(argv[i + 1]));
+		}
+		else if (std::string(argv[i]) == "--asset-budget")
+		{
+			Pinball::AssetRegistry::Global().SetBudget((size_t)std::stoull(argv[i + 1]));
+		}
+	}
+	// The table's triangle meshes are what the ball collides with every step, so they get the faster midphase.
+	// After the rules given above, which take precedence.
+	Pinball::CookingProfiles::Global().AssignType(Pinball::Mesh::TriangleList, "bvh34");
 
-	Pinball::Mesh planeMesh = Pinball::Mesh::createPlane(cooking);
-	Pinball::GameObject planeObj(planeMesh, Pinball::GameObject::Type::Static);
+	// Bake mode: rebuild the level's placement table from its origins model and exit
+	if (argc > 1 && std::string(argv[1]) == "--bake-placements")
+	{
+		return Pinball::Level::bakePlacements(argc > 2 ? argv[2] : "Models/level_origins.obj") ? 0 : 1;
+	}
 
-	// TODO: change to std::map?
-	std::vector<Pinball::Mesh> levelMeshes = Pinball::Mesh::fromFile("Models/level_meshes.obj", cooking);
-	std::vector<Pinball::Mesh> levelOrigins = Pinball::Mesh::fromFile("Models/level_origins.obj", cooking, false);
-	Pinball::GameObject tableObj;
-	Pinball::GameObject ballObj;
-	std::map<std::string, Pinball::GameObject> levelObjects;
+	// Bake mode: decompose the level's triangle-list meshes into convex hulls (for --table-collision convex) and exit
+	if (argc > 1 && std::string(argv[1]) == "--bake-hulls")
+	{
+		return Pinball::ConvexDecomposition::bake(argc > 2 ? argv[2] : "Models/level_meshes.obj", Pinball::ConvexDecomposition::defaultOptions()) ? 0 : 1;
+	}
 
-	physx::PxSphericalJoint* flipperJointL = nullptr, *flipperJointR = nullptr;
+	// Build mode: refresh the models' mesh caches, the images' texture caches, the level's placement table & convex decomposition,
+	// then bundle them with the shaders, images & models into one pack and exit
+	if (argc > 1 && std::string(argv[1]) == "--build-pack")
+	{
+		if (!Pinball::Level::bakePlacements("Models/level_origins.obj")
+			|| !Pinball::ConvexDecomposition::bake("Models/level_meshes.obj", Pinball::ConvexDecomposition::defaultOptions()))
+		{
+			return 1;
+		}
 
-	gLevel = new Pinball::Level("Models/level_meshes.obj", "Models/level_origins.obj", cooking);
-	gLevel->SetScene(scene);
+		std::vector<std::string> models = Pinball::ResourcePack::listFiles("Models");
+		for (size_t i = 0; i < models.size(); i++)
+		{
+			if (models[i].substr(models[i].find_last_of(".") + 1) == "obj")
+			{
+				Pinball::Mesh::fromFile(models[i], nullptr, false);
+			}
+		}
+		std::vector<std::string> images = Pinball::ResourcePack::listFiles("Images");
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			if (images[i].substr(images[i].find_last_of(".") + 1) == "png")
+			{
+				// Decoding an image writes its cache, if it's missing or stale
+				Pinball::Image image(images[i]);
+			}
+		}
+		return Pinball::ResourcePack::build(argc > 2 ? argv[2] : "Resources.pack", { "GLSL", "Images", "Models" }) ? 0 : 1;
+	}
+
+	// Resources are read from the pack if there is one, and from the loose files otherwise (or if they were edited since packing)
+	Pinball::ResourcePack::mount("Resources.pack");
+
+	// Benchmark mode: time the OBJ importer against Assimp on the game's models & a 50 MB synthetic file, and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-import")
+	{
+		Pinball::ObjImporter::benchmark({ "Models/level.obj", "Models/level_meshes.obj" }, 50 * 1024 * 1024);
+		return 0;
+	}
+
+	// Benchmark mode: time the mesh bounds kernel and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-bounds")
+	{
+		Pinball::Bounds::benchmark();
+		return 0;
+	}
 
-	physx::PxVec3 hingeLocation = gLevel->HingeL()->Transform().p + (gLevel->FlipperR()->Transform().p - gLevel->HingeL()->Transform().p) * 0.9;
-	
-	hingeLocation = gLevel->FlipperL()->Transform().p;
-	((physx::PxRigidDynamic*)gLevel->FlipperL()->GetPxActor())->setMass(0.f);
-	((physx::PxRigidDynamic*)gLevel->FlipperR()->GetPxActor())->setMass(0.f);
-	((physx::PxRigidDynamic*)gLevel->FlipperL()->GetPxActor())->setMassSpaceInertiaTensor(physx::PxVec3(0.f, 10.f, 0.f));
-	((physx::PxRigidDynamic*)gLevel->FlipperR()->GetPxActor())->setMassSpaceInertiaTensor(physx::PxVec3(0.f, 10.f, 0.f));
+	// Check mode: load the level meshes and report how many heap allocations & mesh copies a warm load (from the mesh cache) takes.
+	// Fails if any mesh data was copied, or if the allocation count exceeds the budget: the one given, or else the count of a warm-up load,
+	// so a load that allocates more than the one before it (eg. something cached per load that grows) is caught.
+	if (argc > 1 && std::string(argv[1]) == "--check-load-allocations")
+	{
+		auto loadLevelMeshes = []()
+		{
+			std::vector<Pinball::MeshAsset> assets;
+			std::vector<Pinball::Mesh> meshes = Pinball::Mesh::fromFile("Models/level_meshes.obj", nullptr, false);
+			assets.reserve(meshes.size());
+			for (size_t i = 0; i < meshes.size(); i++)
+			{
+				assets.push_back(Pinball::Mesh::makeAsset(std::move(meshes[i])));
+			}
+			return assets;
+		};
 
-	boxObj.Transform(physx::PxTransform(hingeLocation));
+		// The first load may have to import the model & write its mesh cache, which isn't the steady state
+		loadLevelMeshes();
 
-	//levelObjects["FlipperL"].Transform(physx::PxTransform(physx::PxIdentity));
+		// Warm-up: the steady-state count the measured load is held to, unless a budget is given
+		Pinball::AllocationCounter::Reset();
+		loadLevelMeshes();
+		size_t budget = argc > 2 ? std::stoul(argv[2]) : Pinball::AllocationCounter::Count();
 
-	flipperJointL = physx::PxSphericalJointCreate(*pxPhysics,
-		gLevel->HingeL()->GetPxRigidActor(), physx::PxTransform(hingeLocation - gLevel->HingeL()->Transform().p),
-		gLevel->FlipperL()->GetPxRigidActor(), physx::PxTransform(physx::PxVec3(0.0f)));
+		Pinball::Mesh::ResetCopiedBytes();
+		Pinball::AllocationCounter::Reset();
+		std::vector<Pinball::MeshAsset> assets = loadLevelMeshes();
 
+		size_t allocations = Pinball::AllocationCounter::Count();
+		std::cout << "Loaded " << assets.size() << " meshes: " << allocations << " allocations (" << Pinball::AllocationCounter::Bytes() << " bytes), "
+			<< Pinball::Mesh::CopiedBytes() << " mesh bytes copied, budget " << budget << " allocations" << std::endl;
 
-	//flipperJointL->setLimit(physx::PxJointAngularLimitPair(-physx::PxPi / 4, physx::PxPi / 4));
-	//flipperJointL->setRevoluteJointFlag(physx::PxRevoluteJointFlag::eLIMIT_ENABLED, true);
+		bool failed = Pinball::Mesh::CopiedBytes() > 0 || allocations > budget;
+		std::cout << (failed ? "FAILED" : "OK") << std::endl;
+		return failed ? 1 : 0;
+	}
 
-	//flipperJointL->setDriveVelocity(1.0f);
-	gLevel->FlipperL()->GetPxActor()->setActorFlag(physx::PxActorFlag::eDISABLE_GRAVITY, true);
-	boxObj.GetPxActor()->setActorFlag(physx::PxActorFlag::eDISABLE_GRAVITY, true);
-	//((physx::PxRigidDynamic*)levelObjects["FlipperL"].GetPxActor())->setCMassLocalPose(physx::PxTransform(levelObjects["FlipperL"].Geometry().GetCenterPoint() * 2.0f));
-	scene->setVisualizationParameter(physx::PxVisualizationParameter::eJOINT_LOCAL_FRAMES, 1.0f);
-	scene->setVisualizationParameter(physx::PxVisualizationParameter::eJOINT_LIMITS, 1.0f); 
-	flipperJointL->setConstraintFlag(physx::PxConstraintFlag::eVISUALIZATION, true);
-	//flipperJointL->setRevoluteJointFlag(physx::PxRevoluteJointFlag::eDRIVE_ENABLED, true);
-	//flipperJointL->setRevoluteJointFlag(physx::PxRevoluteJointFlag::eDRIVE_FREESPIN, true);
+	// Check mode: load & cook two models under a tiny asset budget and check the registry evicts each as soon as nothing holds it, and not before,
+	// and that evicting them releases their cooked PhysX meshes
+	if (argc > 1 && std::string(argv[1]) == "--check-asset-eviction")
+	{
+		physx::PxDefaultAllocator pxAlloc;
+		physx::PxDefaultErrorCallback pxErrClb;
+		physx::PxFoundation* pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
+		physx::PxPhysics* pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale());
+		PxInitExtensions(*pxPhysics, nullptr);
+		physx::PxCooking* cooking = PxCreateCooking(PX_PHYSICS_VERSION, *pxFoundation, physx::PxCookingParams(physx::PxTolerancesScale()));
+
+		Pinball::AssetRegistry& registry = Pinball::AssetRegistry::Global();
+		registry.SetBudget(1);
+		Pinball::AssetRegistry::ModelOptions options = { Pinball::Mesh::VertexFormat::Float, 1, true, 0, false, 0.0f };
+		Pinball::PhysicsRegistry::LiveCounts before = Pinball::PhysicsRegistry::liveCounts();
+
+		// Held while the second model loads, so it can't be evicted yet
+		Pinball::ModelAsset level = registry.GetModel("Models/level.obj", cooking, options);
+		Pinball::ModelAsset meshes = registry.GetModel("Models/level_meshes.obj", cooking, options);
+		size_t heldEvictions = registry.GetStats().evictions;
+
+		// Dropping the handles lets both go, along with their PhysX meshes
+		level.reset();
+		meshes.reset();
+		registry.Trim();
+		Pinball::AssetRegistry::Stats stats = registry.GetStats();
+		Pinball::PhysicsRegistry::LiveCounts after = Pinball::PhysicsRegistry::liveCounts();
+		registry.PrintReport();
+		std::cout << "PhysX meshes before loading / after eviction: " << before.convexMeshes << " / " << after.convexMeshes << " convex, "
+			<< before.triangleMeshes << " / " << after.triangleMeshes << " triangle, " << before.heightFields << " / " << after.heightFields << " heightfields" << std::endl;
+
+		bool leaked = after.convexMeshes != before.convexMeshes || after.triangleMeshes != before.triangleMeshes || after.heightFields != before.heightFields;
+		bool failed = heldEvictions != 0 || stats.evictions != 2 || stats.bytes != 0 || leaked;
+		std::cout << (failed ? "FAILED" : "OK") << std::endl;
+
+		registry.Clear();
+		cooking->release();
+		Pinball::CookingProfiles::Global().ReleaseAll();
+		PxCloseExtensions();
+		pxPhysics->release();
+		pxFoundation->release();
+		return failed ? 1 : 0;
+	}
 
-	flipperJointL->setLimitCone(physx::PxJointLimitCone(physx::PxPi / 4, physx::PxPi / 4, 0.01f));
-	flipperJointL->setSphericalJointFlag(physx::PxSphericalJointFlag::eLIMIT_ENABLED, true);
+	// Benchmark mode: time parallel cooking & actor creation for a synthetic table, and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-level-load")
+	{
+		physx::PxDefaultAllocator pxAlloc;
+		physx::PxDefaultErrorCallback pxErrClb;
+		physx::PxFoundation* pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
+		physx::PxPhysics* pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale());
+		PxInitExtensions(*pxPhysics, nullptr);
+		physx::PxCooking* cooking = PxCreateCooking(PX_PHYSICS_VERSION, *pxFoundation, physx::PxCookingParams(physx::PxTolerancesScale()));
+
+		Pinball::Level::benchmarkLoad(cooking, argc > 2 ? std::stoul(argv[2]) : 500);
+
+		cooking->release();
+		Pinball::CookingProfiles::Global().ReleaseAll();
+		PxCloseExtensions();
+		pxPhysics->release();
+		pxFoundation->release();
+		return 0;
+	}
 
-	//boxObj.Transform(physx::PxTransform(levelObjects["FlipperL"].Transform().p + levelObjects["FlipperL"].Geometry().GetCenterPoint() * 3.f, physx::PxQuat(physx::PxIdentity)));
+	// Benchmark mode: cook a model's meshes with each cooking profile, roll balls over its table with each, and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-cooking")
+	{
+		physx::PxDefaultAllocator pxAlloc;
+		physx::PxDefaultErrorCallback pxErrClb;
+		physx::PxFoundation* pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
+		physx::PxPhysics* pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale());
+		PxInitExtensions(*pxPhysics, nullptr);
+
+		Pinball::CookingProfiles::benchmark(argc > 2 ? argv[2] : "Models/level_meshes.obj");
+
+		Pinball::CookingProfiles::Global().ReleaseAll();
+		PxCloseExtensions();
+		pxPhysics->release();
+		pxFoundation->release();
+		return 0;
+	}
 
-	/*physx::PxRevoluteJoint* flipperJointLPointer = physx::PxRevoluteJointCreate(*pxPhysics,
-		(physx::PxRigidActor*)levelObjects["FlipperL"].GetPxActor(), physx::PxTransform(levelObjects["FlipperL"].Geometry().GetCenterPoint() * 3.0f),
-		((physx::PxRigidActor*)(boxObj.GetPxActor())), physx::PxTransform(physx::PxIdentity)
-	);*/
-	hingeLocation = gLevel->FlipperR()->Transform().p;
+	// Benchmark mode: A/B the table's triangle meshes against their convex decomposition on recorded ball trajectories, and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-table-collision")
+	{
+		physx::PxDefaultAllocator pxAlloc;
+		physx::PxDefaultErrorCallback pxErrClb;
+		physx::PxFoundation* pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
+		physx::PxPhysics* pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale());
+		PxInitExtensions(*pxPhysics, nullptr);
+		physx::PxCooking* cooking = PxCreateCooking(PX_PHYSICS_VERSION, *pxFoundation, physx::PxCookingParams(physx::PxTolerancesScale()));
+
+		Pinball::ConvexDecomposition::benchmark(cooking, argc > 2 ? argv[2] : "Models/level_meshes.obj", "Models/level_origins.obj");
+
+		cooking->release();
+		Pinball::CookingProfiles::Global().ReleaseAll();
+		PxCloseExtensions();
+		pxPhysics->release();
+		pxFoundation->release();
+		return 0;
+	}
 
-	flipperJointR = physx::PxSphericalJointCreate(*pxPhysics,
-		gLevel->HingeR()->GetPxRigidActor(), physx::PxTransform(hingeLocation - gLevel->HingeR()->Transform().p),
-		gLevel->FlipperR()->GetPxRigidActor(), physx::PxTransform(physx::PxVec3(0.0f)));
-	gLevel->FlipperR()->GetPxActor()->setActorFlag(physx::PxActorFlag::eDISABLE_GRAVITY, true);
-	//((physx::PxRigidDynamic*)levelObjects["FlipperR"].GetPxActor())->setCMassLocalPose(physx::PxTransform(levelObjects["FlipperR"].Geometry().GetCenterPoint() * 2.0f));
+	// Benchmark mode: report each level object's collision triangles & step time with & without its collision proxy, and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-collision-proxies")
+	{
+		physx::PxDefaultAllocator pxAlloc;
+		physx::PxDefaultErrorCallback pxErrClb;
+		physx::PxFoundation* pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
+		physx::PxPhysics* pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale());
+		PxInitExtensions(*pxPhysics, nullptr);
+		physx::PxCooking* cooking = PxCreateCooking(PX_PHYSICS_VERSION, *pxFoundation, physx::PxCookingParams(physx::PxTolerancesScale()));
+
+		Pinball::Level::benchmarkCollisionProxies(cooking, "Models/level_meshes.obj", "Models/level_origins.obj", argc > 2 ? std::stof(argv[2]) : 0.01f);
+
+		cooking->release();
+		Pinball::CookingProfiles::Global().ReleaseAll();
+		PxCloseExtensions();
+		pxPhysics->release();
+		pxFoundation->release();
+		return 0;
+	}
 
+	// Startup task graph: CPU-only work (file reads, image decoding, model import, PhysX setup & cooking) runs on worker threads
+	// while the window & GL context are created here. GL steps come back to the main thread through the pool's completion queue.
+	Pinball::TaskPool startup;
+	std::unique_ptr<Pinball::Renderer> renderer;
 
-	flipperJointR->setLimitCone(physx::PxJointLimitCone(physx::PxPi / 4, physx::PxPi / 4, 0.01f));
-	flipperJointR->setSphericalJointFlag(physx::PxSphericalJointFlag::eLIMIT_ENABLED, true);
+	bool running = true;
+
+	// PhysX: queued first, as cooking & the level load after it are the critical path
+	physx::PxDefaultAllocator pxAlloc;
+	physx::PxDefaultErrorCallback pxErrClb;
+	physx::PxFoundation* pxFoundation = nullptr;
+	physx::PxPvd* pxPvd = nullptr;
+	physx::PxPhysics* pxPhysics = nullptr;
+	physx::PxCooking* cooking = nullptr;
+	physx::PxScene* scene = nullptr;
+
+	// Scenes are created the same way for the first level & the ones loaded in the background (see LevelLoader)
+	MySimulationEventCallback simulationCallback;
+	auto createScene = [&simulationCallback]()
+	{
+		physx::PxSceneDesc sceneDesc = physx::PxSceneDesc(physx::PxTolerancesScale());
+		sceneDesc.gravity = physx::PxVec3(0.0f, -9.81f, 9.81f);
+		sceneDesc.filterShader = MyFilterShader;
+		sceneDesc.cpuDispatcher = physx::PxDefaultCpuDispatcherCreate(1);
+		sceneDesc.flags = physx::PxSceneFlag::eENABLE_CCD;
+		physx::PxScene* scene = PxGetPhysics().createScene(sceneDesc);
+		scene->setSimulationEventCallback(&simulationCallback);
+		return scene;
+	};
+
+	// Futures of the tasks the game can't start without, checked once startup is idle so their exceptions surface.
+	// The level & particle futures are set by the PhysX task, before it finishes.
+	std::future<void> physxReady, particlesReady, levelReady;
+	physxReady = startup.Run("PhysX setup", [&]()
+	{
+		pxFoundation = PxCreateFoundation(PX_FOUNDATION_VERSION, pxAlloc, pxErrClb);
+		pxPvd = physx::PxCreatePvd(*pxFoundation);
+		physx::PxPvdTransport* transport = physx::PxDefaultPvdSocketTransportCreate("localhost", 5425, 10);
+		pxPvd->connect(*transport, physx::PxPvdInstrumentationFlag::eALL);
+
+		pxPhysics = PxCreatePhysics(PX_PHYSICS_VERSION, *pxFoundation, physx::PxTolerancesScale(), false, pxPvd);
+		PxInitExtensions(*pxPhysics, pxPvd);
+		// Used for meshes no cooking profile rule matches
+		physx::PxCookingParams cookingParams = physx::PxCookingParams(physx::PxTolerancesScale());
+		cooking = PxCreateCooking(PX_PHYSICS_VERSION, PxGetPhysics().getFoundation(), cookingParams);
+		if (pxPhysics == nullptr || cooking == nullptr)
+		{
+			throw std::runtime_error("failed to create the PhysX SDK or cooking library");
+		}
 
-	tableObj.Geometry().Color(0.375f, 0.375f, 0.375f);
-	ballObj.Geometry().Color(0.5f, 0.5f, 1.f);
+		scene = createScene();
+
+		// Work that needs cooking can start now. Particle meshes are built now rather than on the first contact.
+		particlesReady = startup.Run("Prewarm particle meshes", [&]() { Pinball::Particle::PrewarmMeshes(cooking); });
+		levelReady = startup.Run("Load level", [&]() { gLevel = new Pinball::Level("Models/level_meshes.obj", "Models/level_origins.obj", cooking); });
+	});
+
+	// Shaders: sources read on workers, compiled on the main thread
+	GLuint diffuseShader = 0, unlitShader = 0, sparkShader = 0, imgShader = 0;
+	struct ShaderTask
+	{
+		const char* name;
+		GLuint* program;
+	};
+	const ShaderTask shaderTasks[] = { { "Diffuse", &diffuseShader }, { "Unlit", &unlitShader }, { "Spark", &sparkShader }, { "Image2D", &imgShader } };
+	for (const ShaderTask& shaderTask : shaderTasks)
+	{
+		startup.Run(std::string("Read ") + shaderTask.name + " shader", [&startup, shaderTask]()
+		{
+			std::string vertexSource = getFileContents(std::string("GLSL/") + shaderTask.name + ".vert");
+			std::string fragmentSource = getFileContents(std::string("GLSL/") + shaderTask.name + ".frag");
+			startup.RunOnMain(std::string("Compile ") + shaderTask.name + " shader", [shaderTask, vertexSource, fragmentSource]()
+			{
+				*shaderTask.program = Pinball::Renderer::compileShader(vertexSource, fragmentSource);
+			});
+		});
+	}
+
+	// game-over screen image: decoded on a worker, uploaded on the main thread
+	Pinball::ImageAsset gameOverImg;
+	startup.Run("Decode Images/gameover.png", [&]()
+	{
+		gameOverImg = Pinball::AssetRegistry::Global().GetImage("Images/gameover.png");
+		startup.RunOnMain("Upload Images/gameover.png", [&]() { renderer->CreateTexture(*gameOverImg); });
+	});
+
+	// Create renderer (window & GL context) while the workers run
+	double rendererStart = startup.ElapsedMs();
+	renderer.reset(new Pinball::Renderer("Pinball Game"));
+	Pinball::Renderer& gfx = *renderer;
+	startup.Mark("Create window & GL context", rendererStart);
+
+	// Run the GL steps as their inputs become ready, until everything has loaded
+	startup.WaitIdle();
+
+	std::future<void>* criticalTasks[] = { &physxReady, &particlesReady, &levelReady };
+	for (std::future<void>* task : criticalTasks)
+	{
+		try
+		{
+			// Not valid if the PhysX task failed before queuing it
+			if (task->valid())
+			{
+				task->get();
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Startup failed: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	Pinball::GameObject boxObj(Pinball::PrimitiveCache::Global().Box(cooking));
+	boxObj.Color(0.0f, 1.0f, 0.0f);
+	boxObj.Transform(physx::PxTransform(physx::PxVec3(0.0f, 3.0f, 0.f), physx::PxQuat(physx::PxIdentity)));
+
+	Pinball::GameObject planeObj(Pinball::PrimitiveCache::Global().Plane(cooking), Pinball::GameObject::Type::Static);
+
+	Pinball::GameObject tableObj;
+	Pinball::GameObject ballObj;
+	std::map<std::string, Pinball::GameObject> levelObjects;
+
+	Pinball::CookingCache::Stats cookingStats = Pinball::CookingCache::Global().GetStats();
+	std::cout << "PhysX cooking cache: " << cookingStats.hits << " hits, " << cookingStats.misses << " misses, "
+		<< cookingStats.cookMs << " ms cooking, " << cookingStats.loadMs << " ms loading cooked meshes, " << cookingStats.savedMs << " ms saved" << std::endl;
+	Pinball::AssetRegistry::Global().PrintReport();
+	gLevel->SetScene(scene);
+	setupLevel(*gLevel, *scene);
+
+	boxObj.Transform(physx::PxTransform(gLevel->FlipperL()->Transform().p));
+	boxObj.GetPxActor()->setActorFlag(physx::PxActorFlag::eDISABLE_GRAVITY, true);
+
+	tableObj.Color(0.375f, 0.375f, 0.375f);
+	ballObj.Color(0.5f, 0.5f, 1.f);
 
 	//scene->addActor(*boxObj.GetPxActor());
 	scene->addActor(*planeObj.GetPxActor());
@@ -329,7 +659,7 @@ int main(int* argc, char** argv)
 
 	//scene->addActor(*testParticle.GetPxActor());
 
-	planeObj.Geometry().Color(1.0f, 1.0f, 1.0f);
+	planeObj.Color(1.0f, 1.0f, 1.0f);
 	planeObj.Transform(physx::PxTransform(physx::PxVec3(0.0f, -3.0f, 0.0f), physx::PxQuat(physx::PxIdentity)));
 
 	double deltaTime = 0.0;
@@ -360,6 +690,32 @@ int main(int* argc, char** argv)
 	gGameState.plungerArea = gLevel->Ball()->Transform().p;
 	gGameState.gameOverArea = gGameState.plungerArea;
 
+	// Print per-frame statistics to the console when F1 is released
+	bool printStats = false;
+
+	// Cycle the vertex format all meshes are drawn with when F2 is released (per-mesh formats, then each Mesh::VertexFormat),
+	// to compare the compact formats' upload size & GPU time against the float layout
+	const char* vertexFormatNames[] = { "Float", "HalfFloat", "Snorm16Oct" };
+
+	// Draw the level's static objects as one merged batch. Toggled with F3, to compare against drawing them one by one.
+	bool staticBatching = true;
+
+	// Time to first frame is reported with the startup timeline
+	bool firstFrame = true;
+
+	// Tables rotated through in attract mode (every --attract-swap seconds, or on Tab). Each one is loaded in the background
+	// while the current one keeps running, then swapped in between frames.
+	const std::pair<std::string, std::string> tables[] = { { "Models/level_meshes.obj", "Models/level_origins.obj" } };
+	const size_t tableCount = sizeof(tables) / sizeof(tables[0]);
+	size_t currentTable = 0;
+	double lastSwapTime = elapsedTime;
+	bool swapKeyPressed = false;
+	std::unique_ptr<Pinball::LevelLoader> tableLoader(new Pinball::LevelLoader(gfx, cooking, createScene, setupLevel));
+
+	// Only count mesh copies & heap allocations made while running, not during loading
+	Pinball::Mesh::ResetCopiedBytes();
+	Pinball::AllocationCounter::Reset();
+
 	while (running)
 	{
 		bool spacePressed = false;
@@ -368,6 +724,29 @@ int main(int* argc, char** argv)
 			spacePressed = true;
 		}
 
+		bool statsKeyPressed = false;
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_F1) == GLFW_PRESS)
+		{
+			statsKeyPressed = true;
+		}
+
+		bool formatKeyPressed = false;
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_F2) == GLFW_PRESS)
+		{
+			formatKeyPressed = true;
+		}
+
+		bool batchKeyPressed = false;
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_F3) == GLFW_PRESS)
+		{
+			batchKeyPressed = true;
+		}
+
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_TAB) == GLFW_PRESS)
+		{
+			swapKeyPressed = true;
+		}
+
 		// Process events
 		glfwPollEvents();
 		if (glfwWindowShouldClose(gfx.Window()))
@@ -380,6 +759,58 @@ int main(int* argc, char** argv)
 			paused = !paused;
 		}
 
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_F1) == GLFW_RELEASE && statsKeyPressed)
+		{
+			printStats = true;
+		}
+
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_F2) == GLFW_RELEASE && formatKeyPressed)
+		{
+			gfx.ForceVertexFormat(gfx.ForcedVertexFormat() + 1);
+			std::cout << "Vertex format: " << (gfx.ForcedVertexFormat() < 0 ? "per mesh" : vertexFormatNames[gfx.ForcedVertexFormat()]) << std::endl;
+		}
+
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_F3) == GLFW_RELEASE && batchKeyPressed)
+		{
+			staticBatching = !staticBatching;
+			std::cout << "Static batching: " << (staticBatching ? "on" : "off") << std::endl;
+		}
+
+		bool swapTable = attractSwapSeconds > 0.0 && elapsedTime - lastSwapTime >= attractSwapSeconds;
+		if (glfwGetKey(gfx.Window(), GLFW_KEY_TAB) == GLFW_RELEASE && swapKeyPressed)
+		{
+			swapTable = true;
+			swapKeyPressed = false;
+		}
+		if (swapTable && !tableLoader->Loading())
+		{
+			currentTable = (currentTable + 1) % tableCount;
+			std::cout << "Loading table " << tables[currentTable].first << " in the background" << std::endl;
+			tableLoader->Load(tables[currentTable].first, tables[currentTable].second);
+			lastSwapTime = elapsedTime;
+		}
+
+		// Swap in a table that finished loading. Everything heavy was done on the loader thread, so this fits in a frame.
+		Pinball::Level* nextLevel = nullptr;
+		physx::PxScene* nextScene = nullptr;
+		if (tableLoader->Poll(nextLevel, nextScene))
+		{
+			double swapStart = glfwGetTime();
+
+			scene->removeActor(*planeObj.GetPxActor());
+			nextScene->addActor(*planeObj.GetPxActor());
+			tableLoader->Release(gLevel, scene);
+			gLevel = nextLevel;
+			scene = nextScene;
+
+			gGameState.notifyLoss = gGameState.rampBoostActive = gGameState.spawnParticles = false;
+			gGameState.gameOverTime = 0.0f;
+			gGameState.plungerArea = gLevel->Ball()->Transform().p;
+			gGameState.gameOverArea = gGameState.plungerArea;
+
+			std::cout << "Swapped tables in " << (glfwGetTime() - swapStart) * 1000.0 << " ms" << std::endl;
+		}
+
 		if (glfwGetKey(gfx.Window(), GLFW_KEY_LEFT) == GLFW_PRESS)
 		{
 			//((physx::PxRigidDynamic*)ballObj.GetPxActor())->addForce(physx::PxVec3(-20.f, 0.0f, 0.0f));
@@ -461,34 +892,91 @@ int main(int* argc, char** argv)
 		}
 
 		// Draw
+		gfx.BeginFrame();
 		glClearColor(100.f / 255.f, 149.f / 255.f, 237.f / 255.f, 1.f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		//gfx.Draw(boxObj, cam, lights, &diffuseShader);
+		if (staticBatching)
+		{
+			gfx.DrawStatic(gLevel->StaticGeometry(), cam, lights, &diffuseShader);
+		}
 		for (size_t i = 0; i < gLevel->NbActors(); i++)
 		{
+			// Static objects are already drawn by the batch, only the dynamic ones (ball, flippers) are drawn separately
+			if (staticBatching && gLevel->StaticGeometry().Contains(gLevel->At(i)))
+			{
+				continue;
+			}
 			gfx.Draw(*gLevel->At(i), cam, lights, &diffuseShader);
 		}
 
 		gfx.DrawParticles(*gLevel, cam, &sparkShader);
 		if (gGameState.notifyLoss)
 		{
-			gfx.DrawImage(gameOverImg, 0.f, 0.f, 1.f, 1.f, &imgShader);
+			gfx.DrawImage(*gameOverImg, 0.f, 0.f, 1.f, 1.f, &imgShader);
 		}
 		//gfx.DrawParticle(*gLevel->Ball(), cam, &sparkShader);
 		//gfx.Draw(planeObj, cam, lights, &unlitShader);
 		//drawMesh(planeObj, glm::vec2(vWidth, vHeight), vao, vbo, ibo, unlitShader);
+		gfx.EndFrame();
 
 		glfwSwapBuffers(gfx.Window());
+
+		if (firstFrame)
+		{
+			startup.Mark("First frame");
+			startup.PrintTimeline();
+			firstFrame = false;
+		}
+
+		// Statistics for the frame that was just drawn
+		if (printStats)
+		{
+			std::cout << "Frame stats:" << std::endl;
+			std::cout << "  Mesh bytes copied: " << Pinball::Mesh::CopiedBytes() << std::endl;
+			std::cout << "  Heap allocations: " << Pinball::AllocationCounter::Count() << " (" << Pinball::AllocationCounter::Bytes() << " bytes)" << std::endl;
+
+			const Pinball::RenderStats& renderStats = gfx.Stats();
+			std::cout << "  Draw calls: " << renderStats.drawCalls << ", triangles: " << renderStats.triangles << std::endl;
+			std::cout << "  Bytes uploaded: " << renderStats.uploadedBytes << ", vertex bytes resident: " << renderStats.residentVertexBytes << std::endl;
+			std::cout << "  GPU time: " << renderStats.gpuTimeMs << " ms" << std::endl;
+			Pinball::PrimitiveCache::Stats cacheStats = Pinball::PrimitiveCache::Global().GetStats();
+			std::cout << "  Primitive cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses, " << cacheStats.entries << " primitives" << std::endl;
+			// Live PhysX objects should stay flat however long the session runs, as sparks & level objects share their shapes & materials
+			Pinball::PhysicsRegistry::LiveCounts pxCounts = Pinball::PhysicsRegistry::liveCounts();
+			Pinball::PhysicsRegistry::Stats pxStats = Pinball::PhysicsRegistry::Global().GetStats();
+			std::cout << "  PhysX objects: " << pxCounts.shapes << " shapes, " << pxCounts.materials << " materials, " << pxCounts.convexMeshes << " convex meshes, "
+				<< pxCounts.triangleMeshes << " triangle meshes, " << pxCounts.heightFields << " heightfields" << std::endl;
+			std::cout << "  Shared shapes: " << pxStats.shapes << " (" << pxStats.shapeHits << " reused, " << pxStats.shapeMisses << " created), shared materials: "
+				<< pxStats.materials << " (" << pxStats.materialHits << " reused, " << pxStats.materialMisses << " created)" << std::endl;
+
+			std::cout << "  Per LOD draw calls (triangles):";
+			for (size_t i = 0; i < Pinball::Mesh::MaxLodCount; i++)
+			{
+				std::cout << " L" << i << " " << renderStats.lodDrawCalls[i] << " (" << renderStats.lodTriangles[i] << ")";
+			}
+			std::cout << std::endl;
+			printStats = false;
+		}
+		Pinball::Mesh::ResetCopiedBytes();
+		Pinball::AllocationCounter::Reset();
 	}
 
+	// Finishes any load or release in progress
+	tableLoader.reset();
+
+	gfx.ReleaseMeshes();
+	Pinball::PrimitiveCache::Global().Clear();
+	Pinball::AssetRegistry::Global().Clear();
 	glfwDestroyWindow(gfx.Window());
 
+	// The level's joints & actors go before their scene
+	delete gLevel;
 	scene->release();
 
+	Pinball::CookingProfiles::Global().ReleaseAll();
 	PxCloseExtensions();
 
-	delete gLevel;
-
 	return 0;
 }
\ No newline at end of file